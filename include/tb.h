@@ -363,6 +363,7 @@ extern "C" {
     typedef struct TB_DebugType         TB_DebugType;
     typedef struct TB_Initializer       TB_Initializer;
     typedef struct TB_FunctionPrototype TB_FunctionPrototype;
+    typedef struct TB_IRArena           TB_IRArena;
 
     // Refers generically to objects within a module
     //
@@ -397,6 +398,9 @@ extern "C" {
             size_t symbol_id;
         };
 
+        // where it lands in the module's symbol lists, see tb_module_set_symbol_order
+        uint64_t order;
+
         // after this point it's tag-specific storage
     } TB_Symbol;
 
@@ -597,14 +601,29 @@ extern "C" {
     } TB_CmpXchgResult;
 
     typedef struct TB_Loop {
-        // refers to another entry in TB_LoopInfo... unless it's -1
+        // refers to another entry in TB_LoopInfo... unless it's -1, parents
+        // always come before their children.
         ptrdiff_t parent_loop;
 
         TB_Label header;
+
+        // the first back edge, all of them are in backedges
         TB_Label backedge;
 
+        // the one block outside the loop which enters it and only goes to the
+        // header, -1 if there's no such block.
+        TB_Label preheader;
+
+        // the header comes first, nested loops' blocks are included
         size_t body_count;
         TB_Label* body;
+
+        size_t backedge_count;
+        TB_Label* backedges;
+
+        // blocks outside the loop which the body branches to
+        size_t exit_count;
+        TB_Label* exits;
     } TB_Loop;
 
     typedef struct TB_LoopInfo {
@@ -617,6 +636,29 @@ extern "C" {
         TB_Label** preds;
     } TB_Predeccesors;
 
+    // Dominator tree plus some numberings so dominance checks are O(1), it's
+    // cached on the function (see tb_function_get_dom_tree).
+    typedef struct TB_DomTree {
+        // immediate dominators (same as tb_get_dominators), unreachable
+        // blocks are parented to the entry.
+        TB_Label* idom;
+
+        // children of bb are kids[kids_start[bb] .. kids_start[bb + 1]]
+        int* kids_start;
+        TB_Label* kids;
+
+        // entry and exit times of a DFS over the dominator tree, a dominates
+        // b iff pre[a] <= pre[b] and post[b] <= post[a].
+        int* pre;
+        int* post;
+
+        // CFG postorder (only the reachable blocks) and where each block
+        // is in it, -1 if it's unreachable.
+        size_t postorder_count;
+        TB_Label* postorder;
+        int* postorder_index;
+    } TB_DomTree;
+
     typedef struct TB_DominanceFrontiers {
         int* count;
         TB_Label** _;
@@ -793,6 +835,28 @@ extern "C" {
     // returns false if it fails.
     TB_API bool tb_module_compile_function(TB_Module* m, TB_Function* f, TB_ISelMode isel_mode);
 
+    // compiles every function in the module which hasn't been compiled yet across
+    // thread_count worker threads (<= 0 means use all cores), the biggest functions
+    // are handed out first. Returns once every function has an output.
+    //
+    // returns false if any of them failed.
+    TB_API bool tb_module_compile_all(TB_Module* m, TB_ISelMode isel_mode, int thread_count);
+
+    // in streaming mode a function's IR is freed (see tb_function_free) as soon as
+    // it's compiled, exporting only needs the machine code and debug info so peak
+    // memory stays flat no matter how many functions go through.
+    TB_API void tb_module_set_streaming(TB_Module* m, bool streaming);
+
+    // symbols end up in the module (and the object file) sorted by this key,
+    // then by creation order on the thread which set it, globals and constants
+    // get laid out in that same order at export time. it applies to every
+    // symbol the calling thread makes from now on, so frontends building on
+    // multiple threads get the same output every run as long as they give
+    // each key (say a translation unit's index) to one thread at a time. 0 is
+    // the default and just means module-wide creation order, those come first
+    // and they're only reproducible if a single thread makes them.
+    TB_API void tb_module_set_symbol_order(TB_Module* m, uint32_t key);
+
     TB_API size_t tb_module_get_function_count(TB_Module* m);
 
     // Frees all resources for the TB_Module and it's functions, globals and
@@ -880,7 +944,8 @@ extern "C" {
     // about to be killed :p), not calling it can only result in leaks on that thread
     // and calling it too early will result in TB potentially reallocating it but there's
     // should be no crashes from this, just potential slowdown or higher than expected memory
-    // usage.
+    // usage. It also gives the thread's slot back (TB only has TB_MAX_THREADS of them at
+    // once), threads which exit without calling it will have it done for them.
     TB_API void tb_free_thread_resources(void);
 
     ////////////////////////////////
@@ -900,6 +965,12 @@ extern "C" {
     TB_API void tb_prototype_add_param(TB_FunctionPrototype* p, TB_DataType dt);
     TB_API void tb_prototype_add_param_named(TB_FunctionPrototype* p, TB_DataType dt, const char* name, TB_DebugType* debug_type);
 
+    // same as tb_prototype_create followed by tb_prototype_add_param for each of
+    // the params except that structurally identical prototypes are shared, don't add
+    // any params to the result. there's no debug info on these so they're mostly
+    // meant for call sites.
+    TB_API TB_FunctionPrototype* tb_prototype_get(TB_Module* m, TB_CallingConv conv, TB_DataType return_dt, int num_params, const TB_DataType* params, bool has_varargs);
+
     ////////////////////////////////
     // Constant Initializers
     ////////////////////////////////
@@ -1023,6 +1094,25 @@ extern "C" {
 
     TB_API TB_Function* tb_function_create(TB_Module* m, const char* name, TB_Linkage linkage);
 
+    // IR arenas: by default each function keeps its IR in a private arena which is
+    // freed along with it, but a batch of functions can share one instead and then
+    // throwing away all of their IR is just a tb_ir_arena_reset. Functions sharing an
+    // arena can be built, optimized and compiled from different threads (which is what
+    // tb_module_optimize_parallel and tb_module_compile_all will do with them), the
+    // arena is locked around each allocation so this costs a bit more than a private
+    // one. Resetting or destroying it isn't synchronized though, it leaves the functions
+    // in it without IR so only do it once they're compiled (or killed) and nobody else
+    // is using them.
+    //
+    // chunk_size of 0 picks a default.
+    TB_API TB_IRArena* tb_ir_arena_create(size_t chunk_size);
+    TB_API void tb_ir_arena_reset(TB_IRArena* arena);
+    TB_API void tb_ir_arena_destroy(TB_IRArena* arena);
+
+    // the function's IR is allocated out of arena which must outlive it, see above
+    // for how this plays with the parallel passes.
+    TB_API TB_Function* tb_function_create_in_arena(TB_Module* m, const char* name, TB_Linkage linkage, TB_IRArena* arena);
+
     TB_API void* tb_function_get_jit_pos(TB_Function* f);
 
     TB_API void tb_symbol_bind_ptr(TB_Symbol* s, void* ptr);
@@ -1043,6 +1133,10 @@ extern "C" {
     TB_API TB_Reg tb_function_append(TB_Function* f, const TB_Node n);
 
     TB_API void tb_function_print(TB_Function* f, TB_PrintCallback callback, void* user_data, bool display_nops);
+
+    // throws away the function's IR, it can't be printed, optimized or compiled
+    // afterwards but if it's already compiled it'll still be exported. if the
+    // function lives in a shared arena the memory comes back on tb_ir_arena_reset.
     TB_API void tb_function_free(TB_Function* f);
 
     TB_API void tb_inst_loc(TB_Function* f, TB_FileID file, int line);
@@ -1205,6 +1299,19 @@ extern "C" {
     ////////////////////////////////
     // Optimizer
     ////////////////////////////////
+    // the analyses a function keeps cached between passes (see tb_function_get_predeccesors
+    // and friends), later ones are derived from the earlier ones so dropping one drops
+    // everything after it too.
+    typedef enum TB_AnalysisFlags {
+        TB_ANALYSIS_PREDS = 1,
+        TB_ANALYSIS_DOMS  = 2,
+        TB_ANALYSIS_LOOPS = 4,
+
+        // anything which doesn't touch the basic blocks or terminators keeps all of these
+        TB_ANALYSIS_CFG   = TB_ANALYSIS_PREDS | TB_ANALYSIS_DOMS | TB_ANALYSIS_LOOPS,
+        TB_ANALYSIS_ALL   = TB_ANALYSIS_CFG,
+    } TB_AnalysisFlags;
+
     typedef struct TB_Pass {
         // the pass modes tell us what things the pass can modify
         // and what it's being scheduled to run on
@@ -1223,6 +1330,13 @@ extern "C" {
             // unstructured and applied to the entire module
             // can modify the entire module data
             TB_MODULE_PASS,
+
+            // applied to each function bottom-up over the call graph, it can modify
+            // the function it's given and read (but not modify) the functions it
+            // calls directly. it can't add or remove functions. the scheduler starts
+            // it on a function as soon as everything it calls has been processed,
+            // recursive functions are handled together on one thread.
+            TB_CALL_GRAPH_PASS,
         } mode;
         const char* name;
 
@@ -1232,13 +1346,28 @@ extern "C" {
             bool(*bb_run)(TB_Function* f, TB_Reg bb);
             bool(*loop_run)(TB_Function* f, const TB_Loop* l);
             bool(*func_run)(TB_Function* f);
+            bool(*cg_run)(TB_Module* m, TB_Function* f);
             bool(*mod_run)(TB_Module* m);
         };
+
+        // set this if the pass writes to node operands directly instead of only
+        // building new nodes, replacing values and killing nodes. the def-use
+        // index is kept across every other pass but it's thrown out for these.
+        bool edits_operands;
+
+        // which cached analyses are still valid after the pass makes changes,
+        // the rest are recomputed the next time someone asks for them.
+        TB_AnalysisFlags preserves;
     } TB_Pass;
 
     // Applies optimizations to the entire module
     TB_API bool tb_module_optimize(TB_Module* m, size_t pass_count, const TB_Pass passes[]);
 
+    // Same as tb_module_optimize except the passes are spread across thread_count
+    // worker threads (<= 0 means use all cores). Function and call graph passes
+    // only wait on the functions they touch, module passes act as sync points.
+    TB_API bool tb_module_optimize_parallel(TB_Module* m, size_t pass_count, const TB_Pass passes[], int thread_count);
+
     #ifdef TB_USE_LUAJIT
     TB_API TB_Pass tb_opt_load_lua_pass(const char* path, enum TB_PassMode mode);
     TB_API void tb_opt_unload_lua_pass(TB_Pass* p);
@@ -1274,6 +1403,16 @@ extern "C" {
     TB_API TB_LoopInfo tb_get_loop_info(TB_Function* f, TB_Predeccesors preds, TB_Label* doms);
     TB_API void tb_free_loop_info(TB_LoopInfo loops);
 
+    // Cached versions of the above, they're owned by the function and stay around until
+    // they're invalidated (the optimizer does this between passes based on TB_Pass.preserves)
+    // so don't free them. If you change the CFG yourself you'll need to invalidate them.
+    TB_API TB_Predeccesors tb_function_get_predeccesors(TB_Function* f);
+    TB_API TB_Label* tb_function_get_dominators(TB_Function* f);
+    TB_API const TB_DomTree* tb_function_get_dom_tree(TB_Function* f);
+    TB_API bool tb_function_dominates(TB_Function* f, TB_Label expected_dom, TB_Label bb);
+    TB_API const TB_LoopInfo* tb_function_get_loop_info(TB_Function* f);
+    TB_API void tb_function_invalidate_analysis(TB_Function* f, TB_AnalysisFlags flags);
+
     ////////////////////////////////
     // Transformation pass library
     ////////////////////////////////
@@ -1288,9 +1427,13 @@ extern "C" {
     TB_API TB_Pass tb_opt_dead_block_elim(void);
     TB_API TB_Pass tb_opt_dead_expr_elim(void);
     TB_API TB_Pass tb_opt_load_store_elim(void);
+    TB_API TB_Pass tb_opt_global_load_elim(void);
+    TB_API TB_Pass tb_opt_dead_store_elim(void);
+    TB_API TB_Pass tb_opt_global_value_numbering(void);
+    TB_API TB_Pass tb_opt_sccp(void);
 
     // module level
-    // TB_API TB_Pass tb_opt_inline(void);
+    TB_API TB_Pass tb_opt_inline(void);
 
     ////////////////////////////////
     // IR access
@@ -1343,6 +1486,7 @@ extern "C" {
     #ifdef TB_COMPILE_TESTS
     bool tb_x64_test_suite(void);
     bool tb_aarch64_test_suite(void);
+    bool tb_opt_test_suite(void);
     #endif /* TB_COMPILE_TESTS */
 
     #ifdef __cplusplus
@@ -18,8 +18,9 @@ typedef struct {
     // technically NULLable, just can't use patches if NULL
     TB_Function* f;
 
-    // this is mapped to a giant buffer and is technically allow to use the entire rest
-    // of said buffer
+    // this is mapped into the thread's code region, once it runs out of space it'll
+    // ask the region to grow which might move the buffer (which is why everything
+    // refers to it with offsets).
     size_t count, capacity;
     uint8_t* data;
 
@@ -44,7 +45,11 @@ typedef struct {
 
 inline static void* tb_cgemit_reserve(TB_CGEmitter* restrict e, size_t count) {
     if (e->count + count >= e->capacity) {
-        tb_panic("tb_cgemit_reserve: Out of memory!");
+        if (e->f == NULL) {
+            tb_panic("tb_cgemit_reserve: Out of memory!");
+        }
+
+        e->data = tb__code_region_grow(e->f->super.module, e->data, e->count, count, &e->capacity);
     }
 
     return &e->data[e->count];
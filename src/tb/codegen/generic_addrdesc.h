@@ -46,6 +46,7 @@ struct Ctx {
     size_t active_count;
 
     // some analysis
+    TB_Liveness live;
     int* intervals; // [reg] = last_use
     int* ordinal;   // [reg] = timeline position
 
@@ -250,14 +251,8 @@ typedef struct {
 } LiveInterval;
 
 static LiveInterval get_live_interval(Ctx* restrict ctx, TB_Reg r) {
-    LiveInterval li;
-    li.start = ctx->ordinal[r];
-    li.end = ctx->ordinal[ctx->intervals[r]];
-
-    if (li.start > li.end) {
-        tb_swap(int, li.start, li.end);
-    }
-    return li;
+    TB_LiveInterval li = ctx->live.intervals[r];
+    return (LiveInterval){ li.start, li.end };
 }
 
 static void GAD_FN(explicit_steal)(Ctx* restrict ctx, TB_Function* f, TB_Reg r, TB_Reg spill_reg, ptrdiff_t active_i) {
@@ -562,13 +557,12 @@ static TB_FunctionOutput GAD_FN(compile_function)(TB_Function* restrict f, const
                 .ret_patches = tb_tls_push(tls, tally.return_count * sizeof(ReturnPatch)),
             },
             .preds = preds,
-            .ordinal = tb_tls_push(tls, f->node_count * sizeof(int)),
             .intervals = tb_tls_push(tls, f->node_count * sizeof(int)),
             .spills = tb_tls_push(tls, f->node_count * sizeof(GAD_VAL))
         };
 
         f->line_count = 0;
-        f->lines = tb_platform_arena_alloc(tally.line_info_count * sizeof(TB_Line));
+        f->lines = tb__arena_alloc(f->super.module, tally.line_info_count * sizeof(TB_Line));
 
         memset(ctx->values, 0, f->node_count * sizeof(GAD_VAL));
     }
@@ -578,37 +572,12 @@ static TB_FunctionOutput GAD_FN(compile_function)(TB_Function* restrict f, const
     // Compute register allocation
     {
         // Find live intervals (and create a timeline for the nodes)
-        FOREACH_N(i, 0, f->node_count) ctx->intervals[i] = 0;
-
-        size_t time = 0;
-        TB_FOR_BASIC_BLOCK(bb, f) {
-            TB_FOR_NODE(r, f, bb) {
-                TB_Node* n = &f->nodes[r];
-
-                if (tb_node_is_phi_node(f, r)) {
-                    // for phi nodes just extend the lifetime to the basic block terminator
-                    int count = tb_node_get_phi_width(f, r);
-                    TB_PhiInput* inputs = tb_node_get_phi_inputs(f, r);
-
-                    FOREACH_N(j, 0, count) {
-                        TB_Reg src = inputs[j].val;
-                        TB_Reg bb_end = f->bbs[inputs[j].label].end;
+        ctx->live = tb_get_liveness(f);
+        ctx->ordinal = ctx->live.order;
 
-                        if (ctx->ordinal[ctx->intervals[src]] < ctx->ordinal[bb_end]) {
-                            ctx->intervals[src] = bb_end;
-                        } else if (ctx->intervals[src] == 0) {
-                            ctx->intervals[src] = r;
-                        }
-                    }
-                } else {
-                    // mark latest use
-                    TB_FOR_INPUT_IN_NODE(it, f, n) {
-                        ctx->intervals[it.r] = r;
-                    }
-                }
-
-                ctx->ordinal[r] = time++;
-            }
+        FOREACH_N(i, 0, f->node_count) {
+            int end = ctx->live.intervals[i].end;
+            ctx->intervals[i] = end >= 0 ? ctx->live.timeline[end] : 0;
         }
 
         // Linear scan
@@ -618,12 +587,7 @@ static TB_FunctionOutput GAD_FN(compile_function)(TB_Function* restrict f, const
         GAD_FN(resolve_params)(ctx, f, ctx->values);
     }
 
-    // calculate the order of the nodes, it helps since node indices
-    // don't actually tell us this especially once the optimizer has
-    // taken a jab at it.
-    //
-    // also calculate the maximum parameter usage for a call
-    int counter = 0;
+    // calculate the maximum parameter usage for a call
     size_t caller_usage = 0;
     TB_FOR_BASIC_BLOCK(bb, f) {
         TB_FOR_NODE(r, f, bb) {
@@ -635,8 +599,6 @@ static TB_FunctionOutput GAD_FN(compile_function)(TB_Function* restrict f, const
                 int param_usage = CALL_NODE_PARAM_COUNT(n);
                 if (caller_usage < param_usage) caller_usage = param_usage;
             }
-
-            ctx->ordinal[n - f->nodes] = counter++;
         }
     }
 
@@ -668,6 +630,8 @@ static TB_FunctionOutput GAD_FN(compile_function)(TB_Function* restrict f, const
     }
 
     // we're done, clean up
+    tb_free_liveness(&ctx->live);
+
     TB_FunctionOutput func_out = {
         .linkage = f->linkage,
         .code = ctx->emit.data,
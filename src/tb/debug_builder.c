@@ -3,7 +3,7 @@
 #define NEW(...) memcpy(make_type(m), &(TB_DebugType){ __VA_ARGS__ }, sizeof(TB_DebugType))
 
 static TB_DebugType* make_type(TB_Module* m) {
-    int tid = tb__get_local_tid();
+    int tid = tb__get_module_tid(m);
     return pool_put(m->thread_info[tid].debug_types);
 }
 
@@ -72,7 +72,7 @@ TB_API TB_DebugType* tb_debug_create_union(TB_Module* m, const char* tag) {
 
 TB_API TB_DebugType* tb_debug_create_field(TB_Module* m, TB_DebugType* type, const char* name, TB_CharUnits offset) {
     assert(name);
-    return NEW(TB_DEBUG_TYPE_FIELD, .field = { tb_platform_string_alloc(name), offset, type });
+    return NEW(TB_DEBUG_TYPE_FIELD, .field = { tb__intern(m, name), offset, type });
 }
 
 TB_API void tb_debug_complete_record(TB_DebugType* type, TB_DebugType** members, size_t count, TB_CharUnits size, TB_CharUnits align) {
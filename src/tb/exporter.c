@@ -27,6 +27,8 @@ TB_API TB_Exports tb_exporter_write_output(TB_Module* m, TB_OutputFlavor flavor,
     };
 
     assert(fn[flavor][m->target_system] != NULL && "TODO");
+    tb__merge_symbols(m);
+    tb_helper_layout_data(m);
     return fn[flavor][m->target_system](m, find_debug_format(debug_fmt));
 }
 
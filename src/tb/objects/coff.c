@@ -62,6 +62,9 @@ TB_API TB_Exports tb_coff_write_output(TB_Module* m, const IDebugFormat* dbg) {
     e->code_gen = tb__find_code_generator(m);
     e->string_table_mark = 4;
 
+    // this also merges any symbols that are still sitting in the thread shards
+    const TB_SymbolArrays* syms = tb_helper_gather_symbols(m);
+
     const char* path = "fallback.obj";
 
     ////////////////////////////////
@@ -92,17 +95,15 @@ TB_API TB_Exports tb_coff_write_output(TB_Module* m, const IDebugFormat* dbg) {
     size_t external_sym_start = function_sym_start + m->compiled_function_count;
 
     size_t text_section_size = tb_helper_get_text_section_layout(m, function_sym_start);
+
+    // externals then globals, COFF doesn't care about the linkage order
     size_t unique_id_counter = 0;
-    FOREACH_N(i, 0, m->max_threads) {
-        pool_for(TB_External, ext, m->thread_info[i].externals) {
-            ext->super.symbol_id = external_sym_start + unique_id_counter;
-            unique_id_counter += 1;
-        }
+    FOREACH_N(i, 0, syms->external_count) {
+        syms->externals[i]->super.symbol_id = external_sym_start + unique_id_counter++;
+    }
 
-        pool_for(TB_Global, g, m->thread_info[i].globals) {
-            g->super.symbol_id = external_sym_start + unique_id_counter;
-            unique_id_counter += 1;
-        }
+    FOREACH_N(i, 0, syms->global_count) {
+        syms->globals[i]->super.symbol_id = external_sym_start + unique_id_counter++;
     }
 
     e->string_table_cap += unique_id_counter;
@@ -116,12 +117,10 @@ TB_API TB_Exports tb_coff_write_output(TB_Module* m, const IDebugFormat* dbg) {
     // create headers
     ////////////////////////////////
     size_t num_of_relocs[S_MAX] = { 0 };
-    FOREACH_N(t, 0, m->max_threads) {
-        pool_for(TB_Global, g, m->thread_info[t].globals) {
-            TB_Initializer* init = g->init;
-            FOREACH_N(k, 0, init->obj_count) {
-                num_of_relocs[S_DATA] += (init->objects[k].type != TB_INIT_OBJ_REGION);
-            }
+    FOREACH_N(i, 0, syms->global_count) {
+        TB_Initializer* init = syms->globals[i]->init;
+        FOREACH_N(k, 0, init->obj_count) {
+            num_of_relocs[S_DATA] += (init->objects[k].type != TB_INIT_OBJ_REGION);
         }
     }
 
@@ -268,16 +267,14 @@ TB_API TB_Exports tb_coff_write_output(TB_Module* m, const IDebugFormat* dbg) {
         if (name_len >= 8) string_table_size += name_len + 1;
     }
 
-    FOREACH_N(i, 0, m->max_threads) {
-        pool_for(TB_External, ext, m->thread_info[i].externals) {
-            size_t name_len = strlen(ext->super.name);
-            if (name_len >= 8) string_table_size += name_len + 1;
-        }
+    FOREACH_N(i, 0, syms->external_count) {
+        size_t name_len = strlen(syms->externals[i]->super.name);
+        if (name_len >= 8) string_table_size += name_len + 1;
+    }
 
-        pool_for(TB_Global, g, m->thread_info[i].globals) {
-            size_t name_len = strlen(g->super.name);
-            if (name_len >= 8) string_table_size += name_len + 1;
-        }
+    FOREACH_N(i, 0, syms->global_count) {
+        size_t name_len = strlen(syms->globals[i]->super.name);
+        if (name_len >= 8) string_table_size += name_len + 1;
     }
 
     // Allocate memory now
@@ -328,20 +325,19 @@ TB_API TB_Exports tb_coff_write_output(TB_Module* m, const IDebugFormat* dbg) {
             uint8_t* tls = &output[e->write_pos];
             e->write_pos += m->tls_region_size;
 
-            FOREACH_N(i, 0, m->max_threads) {
-                pool_for(TB_Global, g, m->thread_info[i].globals) {
-                    if (g->storage != TB_STORAGE_TLS) continue;
+            FOREACH_N(i, 0, syms->global_count) {
+                TB_Global* g = syms->globals[i];
+                if (g->storage != TB_STORAGE_TLS) continue;
 
-                    TB_Initializer* init = g->init;
+                TB_Initializer* init = g->init;
 
-                    // clear out space
-                    memset(&tls[g->pos], 0, init->size);
+                // clear out space
+                memset(&tls[g->pos], 0, init->size);
 
-                    FOREACH_N(k, 0, init->obj_count) {
-                        const TB_InitObj* o = &init->objects[k];
-                        if (o->type == TB_INIT_OBJ_REGION) {
-                            memcpy(&tls[g->pos + o->offset], o->region.ptr, o->region.size);
-                        }
+                FOREACH_N(k, 0, init->obj_count) {
+                    const TB_InitObj* o = &init->objects[k];
+                    if (o->type == TB_INIT_OBJ_REGION) {
+                        memcpy(&tls[g->pos + o->offset], o->region.ptr, o->region.size);
                     }
                 }
             }
@@ -418,23 +414,22 @@ TB_API TB_Exports tb_coff_write_output(TB_Module* m, const IDebugFormat* dbg) {
             };
 
             assert(e->write_pos == sections[S_DATA].pointer_to_reloc);
-            FOREACH_N(i, 0, m->max_threads) {
-                pool_for(TB_Global, g, m->thread_info[i].globals) {
-                    TB_Initializer* init = g->init;
-
-                    FOREACH_N(k, 0, init->obj_count) {
-                        size_t actual_pos = g->pos + init->objects[k].offset;
-
-                        if (init->objects[k].type == TB_INIT_OBJ_RELOC) {
-                            const TB_Symbol* s = init->objects[k].reloc;
-
-                            COFF_ImageReloc r = {
-                                .Type = IMAGE_REL_AMD64_ADDR64,
-                                .SymbolTableIndex = s->symbol_id,
-                                .VirtualAddress = actual_pos
-                            };
-                            TB_FIXED_ARRAY_APPEND(relocs, r);
-                        }
+            FOREACH_N(i, 0, syms->global_count) {
+                TB_Global* g = syms->globals[i];
+                TB_Initializer* init = g->init;
+
+                FOREACH_N(k, 0, init->obj_count) {
+                    size_t actual_pos = g->pos + init->objects[k].offset;
+
+                    if (init->objects[k].type == TB_INIT_OBJ_RELOC) {
+                        const TB_Symbol* s = init->objects[k].reloc;
+
+                        COFF_ImageReloc r = {
+                            .Type = IMAGE_REL_AMD64_ADDR64,
+                            .SymbolTableIndex = s->symbol_id,
+                            .VirtualAddress = actual_pos
+                        };
+                        TB_FIXED_ARRAY_APPEND(relocs, r);
                     }
                 }
             }
@@ -596,55 +591,55 @@ TB_API TB_Exports tb_coff_write_output(TB_Module* m, const IDebugFormat* dbg) {
                 symbols[count++].s = sym;
             }
 
-            FOREACH_N(i, 0, m->max_threads) {
-                pool_for(TB_External, ext, m->thread_info[i].externals) {
-                    COFF_Symbol sym = {
-                        .value = 0,
-                        .section_number = 0,
-                        .storage_class = IMAGE_SYM_CLASS_EXTERNAL
-                    };
-
-                    size_t name_len = strlen(ext->super.name);
-                    assert(name_len < UINT16_MAX);
+            FOREACH_N(i, 0, syms->external_count) {
+                TB_External* ext = syms->externals[i];
+                COFF_Symbol sym = {
+                    .value = 0,
+                    .section_number = 0,
+                    .storage_class = IMAGE_SYM_CLASS_EXTERNAL
+                };
 
-                    if (name_len >= 8) {
-                        sym.long_name[0] = 0; // this value is 0 for long names
-                        sym.long_name[1] = e->string_table_mark;
+                size_t name_len = strlen(ext->super.name);
+                assert(name_len < UINT16_MAX);
 
-                        e->string_table[e->string_table_length++] = ext->super.name;
-                        e->string_table_mark += name_len + 1;
-                    } else {
-                        memcpy(sym.short_name, ext->super.name, name_len + 1);
-                    }
+                if (name_len >= 8) {
+                    sym.long_name[0] = 0; // this value is 0 for long names
+                    sym.long_name[1] = e->string_table_mark;
 
-                    assert(count < capacity);
-                    symbols[count++].s = sym;
+                    e->string_table[e->string_table_length++] = ext->super.name;
+                    e->string_table_mark += name_len + 1;
+                } else {
+                    memcpy(sym.short_name, ext->super.name, name_len + 1);
                 }
 
-                pool_for(TB_Global, g, m->thread_info[i].globals) {
-                    bool is_extern = g->linkage == TB_LINKAGE_PUBLIC;
-                    COFF_Symbol sym = {
-                        .value = g->pos,
-                        .section_number = g->storage == TB_STORAGE_TLS ? e->tls_section_num : 3, // data or tls section
-                        .storage_class = is_extern ? IMAGE_SYM_CLASS_EXTERNAL : IMAGE_SYM_CLASS_STATIC
-                    };
+                assert(count < capacity);
+                symbols[count++].s = sym;
+            }
 
-                    size_t name_len = strlen(g->super.name);
-                    assert(name_len < UINT16_MAX);
+            FOREACH_N(i, 0, syms->global_count) {
+                TB_Global* g = syms->globals[i];
+                bool is_extern = g->linkage == TB_LINKAGE_PUBLIC;
+                COFF_Symbol sym = {
+                    .value = g->pos,
+                    .section_number = g->storage == TB_STORAGE_TLS ? e->tls_section_num : 3, // data or tls section
+                    .storage_class = is_extern ? IMAGE_SYM_CLASS_EXTERNAL : IMAGE_SYM_CLASS_STATIC
+                };
 
-                    if (name_len >= 8) {
-                        sym.long_name[0] = 0; // this value is 0 for long names
-                        sym.long_name[1] = e->string_table_mark;
+                size_t name_len = strlen(g->super.name);
+                assert(name_len < UINT16_MAX);
 
-                        e->string_table[e->string_table_length++] = g->super.name;
-                        e->string_table_mark += name_len + 1;
-                    } else {
-                        memcpy(sym.short_name, g->super.name, name_len + 1);
-                    }
+                if (name_len >= 8) {
+                    sym.long_name[0] = 0; // this value is 0 for long names
+                    sym.long_name[1] = e->string_table_mark;
 
-                    assert(count < capacity);
-                    symbols[count++].s = sym;
+                    e->string_table[e->string_table_length++] = g->super.name;
+                    e->string_table_mark += name_len + 1;
+                } else {
+                    memcpy(sym.short_name, g->super.name, name_len + 1);
                 }
+
+                assert(count < capacity);
+                symbols[count++].s = sym;
             }
 
             assert(count == capacity);
@@ -69,51 +69,28 @@ TB_API TB_Exports tb_elf64obj_write_output(TB_Module* m, const IDebugFormat* dbg
         }
     }*/
 
-    // mark each with a unique id
-    uint32_t function_sym_start = S_MAX;
-    size_t unique_id_counter = function_sym_start;
-
-    // all the local function symbols
-    TB_FOR_FUNCTIONS(f, m) {
-        if (f->linkage != TB_LINKAGE_PUBLIC) {
-            f->compiled_symbol_id = unique_id_counter++;
-        }
-    }
-
-    // TODO(NeGate): Doing all these iterations like this probably isn't good... speed up?
-    FOREACH_N(i, 0, m->max_threads) {
-        pool_for(TB_Global, g, m->thread_info[i].globals) {
-            if (g->linkage != TB_LINKAGE_PUBLIC) {
-                g->super.symbol_id = unique_id_counter++;
-            }
-        }
+    // mark each with a unique id, the arrays are already split by linkage so
+    // it's just walking them in the order the symbol table wants: local
+    // functions, local globals, public globals, public functions then externals.
+    const TB_SymbolArrays* syms = tb_helper_gather_symbols(m);
+    size_t unique_id_counter = S_MAX;
+
+    FOREACH_N(i, 0, syms->private_function_count) {
+        syms->functions[i]->compiled_symbol_id = unique_id_counter++;
     }
 
-    // public symbols need to fit at the end
-    uint32_t first_nonlocal_symbol_id = unique_id_counter;
-    FOREACH_N(i, 0, m->max_threads) {
-        pool_for(TB_Global, g, m->thread_info[i].globals) {
-            if (g->linkage == TB_LINKAGE_PUBLIC) {
-                g->super.symbol_id = unique_id_counter;
-                unique_id_counter += 1;
-            }
-        }
+    FOREACH_N(i, 0, syms->global_count) {
+        // public symbols need to fit at the end
+        syms->globals[i]->super.symbol_id = unique_id_counter++;
     }
+    uint32_t first_nonlocal_symbol_id = S_MAX + syms->private_function_count + syms->private_global_count;
 
-    // all the nonlocal function symbols
-    // uint32_t last_nonlocal_global_id = unique_id_counter;
-    TB_FOR_FUNCTIONS(f, m) {
-        if (f->linkage == TB_LINKAGE_PUBLIC) {
-            f->compiled_symbol_id = unique_id_counter;
-            unique_id_counter += 1;
-        }
+    FOREACH_N(i, syms->private_function_count, syms->function_count) {
+        syms->functions[i]->compiled_symbol_id = unique_id_counter++;
     }
 
-    FOREACH_N(i, 0, m->max_threads) {
-        pool_for(TB_External, ext, m->thread_info[i].externals) {
-            ext->super.address = (void*) (uintptr_t) unique_id_counter;
-            unique_id_counter += 1;
-        }
+    FOREACH_N(i, 0, syms->external_count) {
+        syms->externals[i]->super.address = (void*) (uintptr_t) unique_id_counter++;
     }
 
     uint16_t machine = 0;
@@ -229,12 +206,10 @@ TB_API TB_Exports tb_elf64obj_write_output(TB_Module* m, const IDebugFormat* dbg
     }
     sections[S_TEXT_REL].sh_size -= local_patch_count * sizeof(Elf64_Rela);
 
-    FOREACH_N(t, 0, m->max_threads) {
-        pool_for(TB_Global, g, m->thread_info[t].globals) {
-            TB_Initializer* init = g->init;
-            FOREACH_N(k, 0, init->obj_count) {
-                sections[S_DATA_REL].sh_size += (init->objects[k].type != TB_INIT_OBJ_REGION) * sizeof(Elf64_Rela);
-            }
+    FOREACH_N(i, 0, syms->global_count) {
+        TB_Initializer* init = syms->globals[i]->init;
+        FOREACH_N(k, 0, init->obj_count) {
+            sections[S_DATA_REL].sh_size += (init->objects[k].type != TB_INIT_OBJ_REGION) * sizeof(Elf64_Rela);
         }
     }
 
@@ -247,44 +222,26 @@ TB_API TB_Exports tb_elf64obj_write_output(TB_Module* m, const IDebugFormat* dbg
         put_symbol(&strtbl, &stab, SECTION_NAMES[i], ELF64_ST_INFO(ELF64_STB_LOCAL, ELF64_STT_SECTION), i, 0, 0);
     }
 
-    TB_FOR_FUNCTIONS(f, m) {
-        TB_FunctionOutput* out_f = f->output;
-
-        if (out_f != NULL && f->linkage != TB_LINKAGE_PUBLIC) {
-            put_symbol(&strtbl, &stab, f->super.name, ELF64_ST_INFO(ELF64_STB_GLOBAL, ELF64_STT_FUNC), 2, out_f->code_pos, out_f->code_size);
-        }
-    }
-
-    // static-linkage globals
-    FOREACH_N(i, 0, m->max_threads) {
-        pool_for(TB_Global, g, m->thread_info[i].globals) {
-            if (g->linkage != TB_LINKAGE_PUBLIC) {
-                put_symbol(&strtbl, &stab, g->super.name, ELF64_ST_INFO(ELF64_STB_LOCAL, ELF64_STT_OBJECT), S_DATA, g->pos, 0);
-            }
-        }
+    FOREACH_N(i, 0, syms->private_function_count) {
+        TB_Function* f = syms->functions[i];
+        put_symbol(&strtbl, &stab, f->super.name, ELF64_ST_INFO(ELF64_STB_GLOBAL, ELF64_STT_FUNC), 2, f->output->code_pos, f->output->code_size);
     }
 
-    // nonlocal globals
-    FOREACH_N(i, 0, m->max_threads) {
-        pool_for(TB_Global, g, m->thread_info[i].globals) {
-            if (g->linkage == TB_LINKAGE_PUBLIC) {
-                put_symbol(&strtbl, &stab, g->super.name, ELF64_ST_INFO(ELF64_STB_GLOBAL, ELF64_STT_OBJECT), S_DATA, g->pos, 0);
-            }
-        }
+    // static-linkage globals then nonlocal ones
+    FOREACH_N(i, 0, syms->global_count) {
+        TB_Global* g = syms->globals[i];
+        int bind = i < syms->private_global_count ? ELF64_STB_LOCAL : ELF64_STB_GLOBAL;
+        put_symbol(&strtbl, &stab, g->super.name, ELF64_ST_INFO(bind, ELF64_STT_OBJECT), S_DATA, g->pos, 0);
     }
 
     // nonlocal functions
-    TB_FOR_FUNCTIONS(f, m) {
-        TB_FunctionOutput* out_f = f->output;
-        if (out_f != NULL && f->linkage == TB_LINKAGE_PUBLIC) {
-            put_symbol(&strtbl, &stab, f->super.name, ELF64_ST_INFO(ELF64_STB_GLOBAL, ELF64_STT_FUNC), 2, out_f->code_pos, out_f->code_size);
-        }
+    FOREACH_N(i, syms->private_function_count, syms->function_count) {
+        TB_Function* f = syms->functions[i];
+        put_symbol(&strtbl, &stab, f->super.name, ELF64_ST_INFO(ELF64_STB_GLOBAL, ELF64_STT_FUNC), 2, f->output->code_pos, f->output->code_size);
     }
 
-    FOREACH_N(i, 0, m->max_threads) {
-        pool_for(TB_External, external, m->thread_info[i].externals) {
-            put_symbol(&strtbl, &stab, external->super.name, ELF64_ST_INFO(ELF64_STB_GLOBAL, 0), 0, 0, 0);
-        }
+    FOREACH_N(i, 0, syms->external_count) {
+        put_symbol(&strtbl, &stab, syms->externals[i]->super.name, ELF64_ST_INFO(ELF64_STB_GLOBAL, 0), 0, 0, 0);
     }
 
     // set some sizes and pass the stab and string table to the context
@@ -327,6 +284,10 @@ TB_API TB_Exports tb_elf64obj_write_output(TB_Module* m, const IDebugFormat* dbg
             FOREACH_N(i, 0, m->max_threads) {
                 dyn_array_for(j, m->thread_info[i].symbol_patches) {
                     TB_SymbolPatch* p = &m->thread_info[i].symbol_patches[j];
+
+                    // calls within the module were already resolved by emit_call_patches
+                    if (p->target->tag == TB_SYMBOL_FUNCTION) continue;
+
                     size_t symbol_id = p->target->symbol_id;
                     assert(symbol_id != 0);
 
@@ -385,56 +346,55 @@ TB_API TB_Exports tb_elf64obj_write_output(TB_Module* m, const IDebugFormat* dbg
                 .elems = (Elf64_Rela*) &output[sections[S_DATA_REL].sh_offset]
             };
 
-            FOREACH_N(i, 0, m->max_threads) {
-                pool_for(TB_Global, g, m->thread_info[i].globals) {
-                    TB_Initializer* init = g->init;
-
-                    FOREACH_N(k, 0, init->obj_count) {
-                        size_t actual_pos = g->pos + init->objects[k].offset;
-
-                        // load the addend from the buffer
-                        uint64_t addend;
-                        memcpy(&addend, &data[actual_pos], sizeof(addend));
-
-                        if (init->objects[k].type == TB_INIT_OBJ_RELOC) {
-                            const TB_Symbol* s = init->objects[k].reloc;
-
-                            switch (s->tag) {
-                                case TB_SYMBOL_GLOBAL: {
-                                    const TB_Global* g = (const TB_Global*) s;
-
-                                    Elf64_Rela rela = {
-                                        .r_offset = actual_pos,
-                                        .r_info   = ELF64_R_INFO(g->super.symbol_id, R_X86_64_64),
-                                        .r_addend = addend,
-                                    };
-                                    TB_FIXED_ARRAY_APPEND(relocs, rela);
-                                    break;
-                                }
-                                case TB_SYMBOL_EXTERNAL: {
-                                    const TB_External* e = (const TB_External*) s;
-
-                                    Elf64_Rela rela = {
-                                        .r_offset = actual_pos,
-                                        .r_info   = ELF64_R_INFO(e->super.address, R_X86_64_64),
-                                        .r_addend = addend,
-                                    };
-                                    TB_FIXED_ARRAY_APPEND(relocs, rela);
-                                    break;
-                                }
-                                case TB_SYMBOL_FUNCTION: {
-                                    const TB_Function* f = (const TB_Function*) s;
+            FOREACH_N(i, 0, syms->global_count) {
+                TB_Global* g = syms->globals[i];
+                TB_Initializer* init = g->init;
+
+                FOREACH_N(k, 0, init->obj_count) {
+                    size_t actual_pos = g->pos + init->objects[k].offset;
+
+                    // load the addend from the buffer
+                    uint64_t addend;
+                    memcpy(&addend, &data[actual_pos], sizeof(addend));
+
+                    if (init->objects[k].type == TB_INIT_OBJ_RELOC) {
+                        const TB_Symbol* s = init->objects[k].reloc;
+
+                        switch (s->tag) {
+                            case TB_SYMBOL_GLOBAL: {
+                                const TB_Global* g = (const TB_Global*) s;
+
+                                Elf64_Rela rela = {
+                                    .r_offset = actual_pos,
+                                    .r_info   = ELF64_R_INFO(g->super.symbol_id, R_X86_64_64),
+                                    .r_addend = addend,
+                                };
+                                TB_FIXED_ARRAY_APPEND(relocs, rela);
+                                break;
+                            }
+                            case TB_SYMBOL_EXTERNAL: {
+                                const TB_External* e = (const TB_External*) s;
+
+                                Elf64_Rela rela = {
+                                    .r_offset = actual_pos,
+                                    .r_info   = ELF64_R_INFO(e->super.address, R_X86_64_64),
+                                    .r_addend = addend,
+                                };
+                                TB_FIXED_ARRAY_APPEND(relocs, rela);
+                                break;
+                            }
+                            case TB_SYMBOL_FUNCTION: {
+                                const TB_Function* f = (const TB_Function*) s;
 
-                                    Elf64_Rela rela = {
-                                        .r_offset = actual_pos,
-                                        .r_info   = ELF64_R_INFO(f->compiled_symbol_id, R_X86_64_64),
-                                        .r_addend = addend,
-                                    };
-                                    TB_FIXED_ARRAY_APPEND(relocs, rela);
-                                    break;
-                                }
-                                default: break;
+                                Elf64_Rela rela = {
+                                    .r_offset = actual_pos,
+                                    .r_info   = ELF64_R_INFO(f->compiled_symbol_id, R_X86_64_64),
+                                    .r_addend = addend,
+                                };
+                                TB_FIXED_ARRAY_APPEND(relocs, rela);
+                                break;
                             }
+                            default: break;
                         }
                     }
                 }
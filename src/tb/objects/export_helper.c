@@ -67,3 +67,173 @@ size_t tb_helper_get_text_section_layout(TB_Module* m, size_t symbol_id_start) {
 
     return offset;
 }
+
+static int compare_const_patch(const void* a, const void* b) {
+    const TB_ConstPoolPatch* x = a;
+    const TB_ConstPoolPatch* y = b;
+    uint64_t xo = x->source->super.order, yo = y->source->super.order;
+    if (xo != yo) return (xo > yo) - (xo < yo);
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static int compare_symbol_patch(const void* a, const void* b) {
+    const TB_SymbolPatch* x = a;
+    const TB_SymbolPatch* y = b;
+    uint64_t xo = x->source->super.order, yo = y->source->super.order;
+    if (xo != yo) return (xo > yo) - (xo < yo);
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+// moves every thread's patches into the first slot, sorted by the function
+// which made them, the exporters walk them in that order.
+#define GATHER_PATCHES(m, field, cmp) do {                                     \
+    size_t total = 0;                                                          \
+    FOREACH_N(i, 0, (m)->max_threads) total += dyn_array_length((m)->thread_info[i].field); \
+    FOREACH_N(i, 1, (m)->max_threads) {                                        \
+        size_t len = dyn_array_length((m)->thread_info[i].field);              \
+        if (len == 0) continue;                                                \
+                                                                               \
+        size_t old = dyn_array_length((m)->thread_info[0].field);              \
+        dyn_array_put_uninit((m)->thread_info[0].field, len);                  \
+        memcpy(&(m)->thread_info[0].field[old], (m)->thread_info[i].field, len * sizeof(*(m)->thread_info[i].field)); \
+        dyn_array_clear((m)->thread_info[i].field);                            \
+    }                                                                          \
+    assert(dyn_array_length((m)->thread_info[0].field) == total);              \
+    if (total) qsort((m)->thread_info[0].field, total, sizeof(*(m)->thread_info[0].field), cmp); \
+} while (0)
+
+void tb_helper_layout_data(TB_Module* m) {
+    // globals get placed in symbol order, that way it doesn't matter which
+    // thread set the initializer first.
+    size_t data_size = 0, tls_size = 0;
+    TB_FOR_SYMBOL_WITH_TAG(s, m, TB_SYMBOL_GLOBAL) {
+        TB_Global* g = (TB_Global*) s;
+        if (s->tag != TB_SYMBOL_GLOBAL || g->init == NULL) continue;
+
+        size_t* region_size = g->storage == TB_STORAGE_TLS ? &tls_size : &data_size;
+        size_t align = g->init->align ? g->init->align : 1;
+
+        // TODO(NeGate): Assert on non power of two alignment
+        size_t pos = align_up(*region_size, align);
+        assert((pos + g->init->size) < UINT32_MAX && "Cannot fit global into space");
+
+        g->pos = pos;
+        *region_size = pos + g->init->size;
+    }
+    m->data_region_size = data_size;
+    m->tls_region_size = tls_size;
+
+    GATHER_PATCHES(m, symbol_patches, compare_symbol_patch);
+    GATHER_PATCHES(m, const_patches, compare_const_patch);
+
+    // constants go in the order of the functions which use them, the code
+    // already refers to wherever the last layout (or codegen) put them so we
+    // just add the difference. we start a little off the start just because.
+    size_t rdata_size = 16;
+    dyn_array_for(i, m->thread_info[0].const_patches) {
+        TB_ConstPoolPatch* p = &m->thread_info[0].const_patches[i];
+        TB_FunctionOutput* out_f = p->source->output;
+
+        size_t pos = p->length > 8 ? align_up(rdata_size, 16) : rdata_size;
+        assert(pos == (uint32_t) pos);
+
+        uint8_t* disp = &out_f->code[out_f->prologue_length + p->pos];
+        uint32_t v;
+        memcpy(&v, disp, sizeof(v));
+        v += (uint32_t) (pos - p->rdata_pos);
+        memcpy(disp, &v, sizeof(v));
+
+        p->rdata_pos = pos;
+        rdata_size = pos + p->length;
+    }
+    m->rdata_region_size = rdata_size;
+}
+
+// private symbols are filled in from the front and public ones from the back,
+// then the back half is flipped so both halves keep creation order.
+static size_t split_by_linkage(void** arr, size_t count, size_t private_count) {
+    void **lo = &arr[private_count], **hi = &arr[count - 1];
+    while (lo < hi) {
+        void* tmp = *lo;
+        *lo++ = *hi;
+        *hi-- = tmp;
+    }
+
+    return private_count;
+}
+
+const TB_SymbolArrays* tb_helper_gather_symbols(TB_Module* m) {
+    TB_SymbolArrays* arr = &m->symbol_arrays;
+    tb_helper_free_symbol_arrays(m);
+    tb__merge_symbols(m);
+
+    // functions
+    {
+        size_t cap = m->symbol_count[TB_SYMBOL_FUNCTION];
+        TB_Function** funcs = tb_platform_heap_alloc(cap * sizeof(TB_Function*));
+
+        size_t lo = 0, hi = cap;
+        TB_FOR_FUNCTIONS(f, m) {
+            // only the compiled ones make it into the object file
+            if (f->super.tag != TB_SYMBOL_FUNCTION || f->output == NULL) continue;
+
+            assert(lo < hi);
+            if (f->linkage == TB_LINKAGE_PUBLIC) funcs[--hi] = f;
+            else funcs[lo++] = f;
+        }
+
+        // close the gap between the halves if anything was skipped
+        size_t count = lo + (cap - hi);
+        memmove(&funcs[lo], &funcs[hi], (cap - hi) * sizeof(TB_Function*));
+
+        arr->functions = funcs;
+        arr->function_count = count;
+        arr->private_function_count = count ? split_by_linkage((void**) funcs, count, lo) : 0;
+    }
+
+    // globals & externals
+    {
+        size_t global_cap = m->symbol_count[TB_SYMBOL_GLOBAL];
+        size_t external_cap = m->symbol_count[TB_SYMBOL_EXTERNAL];
+
+        TB_Global** globals = tb_platform_heap_alloc(global_cap * sizeof(TB_Global*));
+        TB_External** externals = tb_platform_heap_alloc(external_cap * sizeof(TB_External*));
+
+        size_t lo = 0, hi = global_cap, ext_count = 0;
+        TB_FOR_SYMBOL_WITH_TAG(s, m, TB_SYMBOL_GLOBAL) {
+            TB_Global* g = (TB_Global*) s;
+            if (s->tag != TB_SYMBOL_GLOBAL) continue;
+
+            assert(lo < hi);
+            if (g->linkage == TB_LINKAGE_PUBLIC) globals[--hi] = g;
+            else globals[lo++] = g;
+        }
+
+        TB_FOR_SYMBOL_WITH_TAG(s, m, TB_SYMBOL_EXTERNAL) {
+            if (s->tag != TB_SYMBOL_EXTERNAL) continue;
+
+            assert(ext_count < external_cap);
+            externals[ext_count++] = (TB_External*) s;
+        }
+
+        size_t count = lo + (global_cap - hi);
+        memmove(&globals[lo], &globals[hi], (global_cap - hi) * sizeof(TB_Global*));
+
+        arr->globals = globals;
+        arr->global_count = count;
+        arr->private_global_count = count ? split_by_linkage((void**) globals, count, lo) : 0;
+
+        arr->externals = externals;
+        arr->external_count = ext_count;
+    }
+
+    return arr;
+}
+
+void tb_helper_free_symbol_arrays(TB_Module* m) {
+    TB_SymbolArrays* arr = &m->symbol_arrays;
+    tb_platform_heap_free(arr->functions);
+    tb_platform_heap_free(arr->globals);
+    tb_platform_heap_free(arr->externals);
+    *arr = (TB_SymbolArrays){ 0 };
+}
@@ -135,8 +135,8 @@ typedef struct TB_Linker {
 
 // also finds the entrypoints (kill two birds amirite)
 static size_t layout_text_section(TB_Module* m, ptrdiff_t* restrict entrypoint) {
-    const char* entrypoint_name = "mainCRTStartup";
-    char entrypoint_name_first_char = entrypoint_name[0];
+    // names are interned, if nobody's made it there's no entrypoint
+    const char* entrypoint_name = tb__intern_find(m, "mainCRTStartup");
 
     size_t size = 0;
     *entrypoint = -1;
@@ -145,7 +145,7 @@ static size_t layout_text_section(TB_Module* m, ptrdiff_t* restrict entrypoint)
         TB_FunctionOutput* out_f = f->output;
         if (out_f == NULL) continue;
 
-        if (f->super.name[0] == entrypoint_name_first_char && strcmp(f->super.name, entrypoint_name) == 0) {
+        if (entrypoint_name != NULL && f->super.name == entrypoint_name) {
             *entrypoint = size;
         }
 
@@ -394,6 +394,9 @@ TB_API void tb_linker_append_library(TB_Linker* l, TB_Slice ar_file) {
 }
 
 TB_API void tb_linker_append_module(TB_Linker* l, TB_Module* m) {
+    tb__merge_symbols(m);
+    tb_helper_layout_data(m);
+
     // Convert module into sections which we can then append to the output
     ptrdiff_t entry;
     TB_LinkerSection* text = find_or_create_section(l, ".text", IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_CNT_CODE);
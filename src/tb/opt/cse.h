@@ -1,23 +1,10 @@
 #include "../tb_internal.h"
 
-// this is a conservative algorithm, if we don't handle a node in here
-// it'll just fail to compare
-static bool is_node_the_same(TB_Node* a, TB_Node* b) {
-    if (a->type != b->type) return false;
-    if (!TB_DATA_TYPE_EQUALS(a->dt, b->dt)) return false;
-
-    size_t bytes = 0;
-    switch (a->type) {
-        case TB_INTEGER_CONST:
-        if (a->integer.num_words == 1 &&
-            b->integer.num_words == 1 &&
-            a->integer.single_word == b->integer.single_word) {
-            return true;
-        }
-
-        // TODO: handle large integer comparisons
-        return false;
-
+// how many bytes of the node's payload make up its identity, 0 if we don't
+// know how to compare it. integer constants are handled on their own since
+// the big ones are behind a pointer.
+static size_t node_payload_size(TB_NodeTypeEnum type) {
+    switch (type) {
         case TB_KEEPALIVE:
         case TB_VA_START:
         case TB_NOT:
@@ -35,8 +22,7 @@ static bool is_node_the_same(TB_Node* a, TB_Node* b) {
         case TB_BITCAST:
         case TB_ZERO_EXT:
         case TB_SIGN_EXT:
-        bytes = sizeof(struct TB_NodeUnary);
-        break;
+        return sizeof(struct TB_NodeUnary);
 
         case TB_ATOMIC_LOAD:
         case TB_ATOMIC_XCHG:
@@ -45,16 +31,13 @@ static bool is_node_the_same(TB_Node* a, TB_Node* b) {
         case TB_ATOMIC_AND:
         case TB_ATOMIC_XOR:
         case TB_ATOMIC_OR:
-        bytes = sizeof(struct TB_NodeAtomicRMW);
-        break;
+        return sizeof(struct TB_NodeAtomicRMW);
 
         case TB_MEMBER_ACCESS:
-        bytes = sizeof(struct TB_NodeMemberAccess);
-        break;
+        return sizeof(struct TB_NodeMemberAccess);
 
         case TB_ARRAY_ACCESS:
-        bytes = sizeof(struct TB_NodeArrayAccess);
-        break;
+        return sizeof(struct TB_NodeArrayAccess);
 
         case TB_AND:
         case TB_OR:
@@ -69,15 +52,13 @@ static bool is_node_the_same(TB_Node* a, TB_Node* b) {
         case TB_SAR:
         case TB_SHL:
         case TB_SHR:
-        bytes = sizeof(struct TB_NodeIArith);
-        break;
+        return sizeof(struct TB_NodeIArith);
 
         case TB_FADD:
         case TB_FSUB:
         case TB_FMUL:
         case TB_FDIV:
-        bytes = sizeof(struct TB_NodeFArith);
-        break;
+        return sizeof(struct TB_NodeFArith);
 
         case TB_CMP_EQ:
         case TB_CMP_NE:
@@ -87,18 +68,58 @@ static bool is_node_the_same(TB_Node* a, TB_Node* b) {
         case TB_CMP_ULE:
         case TB_CMP_FLT:
         case TB_CMP_FLE:
-        bytes = sizeof(struct TB_NodeCompare);
-        break;
+        return sizeof(struct TB_NodeCompare);
 
-        default: return false;
+        default: return 0;
     }
-    assert(bytes != 0 && "this shouldn't be possible");
+}
+
+// this is a conservative algorithm, if we don't handle a node in here
+// it'll just fail to compare
+static bool is_node_the_same(TB_Node* a, TB_Node* b) {
+    if (a->type != b->type) return false;
+    if (!TB_DATA_TYPE_EQUALS(a->dt, b->dt)) return false;
+
+    if (a->type == TB_INTEGER_CONST) {
+        size_t num_words = a->integer.num_words;
+        if (num_words != b->integer.num_words) return false;
+
+        if (num_words == 1) {
+            return a->integer.single_word == b->integer.single_word;
+        } else {
+            return memcmp(a->integer.words, b->integer.words, num_words * sizeof(uint64_t)) == 0;
+        }
+    }
+
+    size_t bytes = node_payload_size(a->type);
+    if (bytes == 0) return false;
 
     void* a_start = &a->integer;
     void* b_start = &b->integer;
     return memcmp(a_start, b_start, bytes) == 0;
 }
 
+// hashes exactly what is_node_the_same looks at so equal nodes always collide,
+// returns false for the nodes it wouldn't compare.
+static bool hash_node(TB_Node* n, uint32_t* out_hash) {
+    uint32_t h = tb__crc32(0, sizeof(n->type), &n->type);
+    h = tb__crc32(h, sizeof(n->dt), &n->dt);
+
+    if (n->type == TB_INTEGER_CONST) {
+        size_t num_words = n->integer.num_words;
+        const uint64_t* words = num_words == 1 ? &n->integer.single_word : n->integer.words;
+
+        *out_hash = tb__crc32(h, num_words * sizeof(uint64_t), words);
+        return true;
+    }
+
+    size_t bytes = node_payload_size(n->type);
+    if (bytes == 0) return false;
+
+    *out_hash = tb__crc32(h, bytes, &n->integer);
+    return true;
+}
+
 typedef struct {
     size_t count;
     TB_Reg* regs;
@@ -108,15 +129,20 @@ static BasicBlockDefs* generate_def_table(TB_Function* f, TB_TemporaryStorage* t
     BasicBlockDefs* table = tb_tls_push(tls, f->bb_count * sizeof(BasicBlockDefs));
 
     TB_FOR_BASIC_BLOCK(bb, f) {
+        // count first, the pushes need to be in one piece
+        size_t count = 0;
+        TB_FOR_NODE(r, f, bb) {
+            TB_Node* n = &f->nodes[r];
+            count += (!TB_IS_NODE_SIDE_EFFECT(n->type) && n->type != TB_LOAD);
+        }
+
         table[bb].count = 0;
-        table[bb].regs = tb_tls_push(tls, 0);
+        table[bb].regs = tb_tls_push(tls, count * sizeof(TB_Reg));
 
         TB_FOR_NODE(r, f, bb) {
             TB_Node* n = &f->nodes[r];
 
             if (!TB_IS_NODE_SIDE_EFFECT(n->type) && n->type != TB_LOAD) {
-                tb_tls_push(tls, sizeof(TB_Reg));
-
                 size_t i = table[bb].count++;
                 table[bb].regs[i] = r;
             }
@@ -165,17 +191,17 @@ typedef struct {
 static void cse_create(CSE_Context* ctx, TB_TemporaryStorage* tls, TB_Function* f) {
     memset(ctx, 0, sizeof(CSE_Context));
 
-    TB_Predeccesors preds = tb_get_temp_predeccesors(f, tls);
-    ctx->doms = tb_tls_push(tls, f->bb_count * sizeof(TB_Label));
-    tb_get_dominators(f, preds, ctx->doms);
+    // CSE doesn't touch the CFG so these stay cached for the next pass
+    ctx->doms = tb_function_get_dominators(f);
 
     // list of defined nodes in for every basic block relevant to global CSE
-    ctx->start = tb_tls_push(tls, 0);
+    ctx->start = tb_tls_mark(tls);
     ctx->defs = generate_def_table(f, tls);
 
-    // list of resolved nodes in this basic block, used for local CSE
+    // list of resolved nodes in this basic block, used for local CSE. it's
+    // reset every block so the worst case is every node in the function.
     ctx->resolved_reg_count = 0;
-    ctx->resolved_regs = tb_tls_push(tls, 0);
+    ctx->resolved_regs = tb_tls_push(tls, f->node_count * sizeof(TB_Reg));
 }
 
 static void cse_destroy(CSE_Context* ctx, TB_TemporaryStorage* tls) {
@@ -186,17 +212,20 @@ static void cse_set_bb(CSE_Context* ctx, TB_TemporaryStorage* tls, TB_Label id)
     ctx->bb = id;
 
     // reset list
-    tb_tls_restore(tls, ctx->resolved_regs);
     ctx->resolved_reg_count = 0;
 }
 
 static TB_Reg cse_attempt(TB_Function* f, CSE_Context* ctx, TB_TemporaryStorage* tls, TB_Node* n) {
+    // following a PASS can take us out of the current block
+    bool chased = false;
     while (n->type == TB_PASS) {
         n = &f->nodes[n->pass.value];
+        chased = true;
     }
 
     if (!TB_IS_NODE_SIDE_EFFECT(n->type) && n->type != TB_LOAD) {
         TB_Reg r = n - f->nodes;
+        TB_Label bb = chased ? tb_find_label_from_reg(f, r) : ctx->bb;
 
         // try the Global CSE:
         // check dominators for value, we dont need the same checks of resolution
@@ -204,7 +233,7 @@ static TB_Reg cse_attempt(TB_Function* f, CSE_Context* ctx, TB_TemporaryStorage*
         TB_Reg found = walk_dominators_for_similar_def(f, ctx->defs, ctx->doms, ctx->doms[ctx->bb], r);
         if (found != TB_NULL_REG && r != found) {
             OPTIMIZER_LOG(r, "Removed BB-global duplicate expression");
-            tb_function_find_replace_reg(f, r, found);
+            tb_function_find_replace_reg(f, bb, r, found);
             tb_murder_reg(f, r);
             return true;
         }
@@ -215,13 +244,12 @@ static TB_Reg cse_attempt(TB_Function* f, CSE_Context* ctx, TB_TemporaryStorage*
 
             if (r != other && is_node_the_same(n, &f->nodes[other])) {
                 OPTIMIZER_LOG(r, "Removed BB-local duplicate expression");
-                tb_function_find_replace_reg(f, r, other);
+                tb_function_find_replace_reg(f, bb, r, other);
                 tb_murder_reg(f, r);
                 return true;
             }
         }
 
-        tb_tls_push(tls, sizeof(TB_Reg));
         ctx->resolved_regs[ctx->resolved_reg_count++] = r;
     }
 
@@ -231,6 +259,10 @@ static TB_Reg cse_attempt(TB_Function* f, CSE_Context* ctx, TB_TemporaryStorage*
 static bool cse(TB_Function* f) {
     TB_TemporaryStorage* tls = tb_tls_allocate();
 
+    // we only ever replace and murder nodes so the def-use index stays valid
+    // and the replacements don't have to rescan the function every time.
+    tb_function_build_uses(f);
+
     CSE_Context cse;
     cse_create(&cse, tls, f);
 
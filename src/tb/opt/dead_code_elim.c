@@ -1,12 +1,10 @@
 #include "../tb_internal.h"
 
 static bool dead_expr_elim(TB_Function* f) {
-    TB_TemporaryStorage* tls = tb_tls_allocate();
+    // the def-use index keeps the counts up to date as we kill nodes
+    tb_function_build_uses(f);
 
     bool changes = false;
-    int* use_count = tb_tls_push(tls, f->node_count * sizeof(int));
-    tb_function_calculate_use_count(f, use_count);
-
     bool local_changes;
     do {
         local_changes = false;
@@ -15,7 +13,7 @@ static bool dead_expr_elim(TB_Function* f) {
             TB_FOR_NODE(r, f, bb) {
                 TB_Node* n = &f->nodes[r];
 
-                if (use_count[r] == 0) {
+                if (f->uses[r].count == 0) {
                     switch (n->type) {
                         // keep
                         case TB_NULL:
@@ -66,8 +64,6 @@ static bool dead_expr_elim(TB_Function* f) {
                                 OPTIMIZER_LOG(r, "FAILURE could not remove volatile load");
                             } else {
                                 OPTIMIZER_LOG(r, "removed unused expression node");
-
-                                use_count[n->load.address] -= 1;
                                 tb_murder_node(f, n);
                                 local_changes = true;
                             }
@@ -119,11 +115,6 @@ static bool dead_expr_elim(TB_Function* f) {
                         case TB_CMP_FLT:
                         case TB_CMP_FLE: {
                             OPTIMIZER_LOG(r, "removed unused expression node");
-
-                            TB_FOR_INPUT_IN_NODE(it, f, n) {
-                                use_count[it.r] -= 1;
-                            }
-
                             tb_murder_node(f, n);
                             local_changes = true;
                             break;
@@ -151,17 +142,21 @@ static bool dead_block_elim(TB_Function* f) {
 
         TB_Predeccesors preds = tb_get_temp_predeccesors(f, tls);
         int kill_count = 0;
-        TB_Reg* mark_to_kill = tb_tls_push(tls, 0);
+        TB_Reg* mark_to_kill = tb_tls_push(tls, f->bb_count * sizeof(TB_Reg));
 
         TB_FOR_BASIC_BLOCK(bb, f) {
             if (bb > 0 && f->bbs[bb].end != 0 && preds.count[bb] == 0) {
-                tb_tls_push(tls, sizeof(int));
                 mark_to_kill[kill_count++] = bb;
             }
         }
 
-        // actually delete them
+        // actually delete them, the nodes get murdered too so the def-use
+        // index stops counting whatever they used.
         FOREACH_N(i, 0, kill_count) {
+            TB_FOR_NODE(r, f, mark_to_kill[i]) {
+                tb_murder_reg(f, r);
+            }
+
             f->bbs[mark_to_kill[i]] = (TB_BasicBlock){ 0 };
         }
 
@@ -186,5 +181,6 @@ TB_API TB_Pass tb_opt_dead_expr_elim(void) {
         .mode = TB_FUNCTION_PASS,
         .name = "DeadExprElimination",
         .func_run = dead_expr_elim,
+        .preserves = TB_ANALYSIS_CFG,
     };
 }
@@ -0,0 +1,108 @@
+// Dead store elimination, built on memory SSA.
+//
+// a store is dead if no path out of it reads the bytes it wrote before they
+// get written over. we just chase the memory state forward through its users:
+// reads that might see the store keep it alive, stores which cover it end the
+// path and everything else passes the state along. returning counts as a read
+// unless the store was to some stack object nobody else can see.
+#include "../tb_internal.h"
+
+// how many accesses we'll visit per store before just assuming it's live
+#define WALK_BUDGET 512
+
+typedef struct {
+    TB_Function* f;
+    TB_AliasInfo ai;
+    TB_MemorySSA mssa;
+
+    // [access_count] stamped with the store we're looking at
+    int* visited;
+    int* stack;
+} DeadStoreCtx;
+
+static bool overwrites(DeadStoreCtx* ctx, TB_MemoryAccess* acc, TB_Reg addr, int size) {
+    if (acc->kind != TB_MEMORY_DEF) return false;
+
+    TB_Function* f = ctx->f;
+    TB_Node* n = &f->nodes[acc->node];
+    switch (n->type) {
+        case TB_STORE:
+        return tb_alias_must_cover(f, n->store.address, tb_alias_access_size(&ctx->ai, n->dt), addr, size);
+
+        case TB_MEMCLR:
+        return tb_alias_must_cover(f, n->clear.dst, n->clear.size, addr, size);
+
+        default:
+        return false;
+    }
+}
+
+static bool is_store_read(DeadStoreCtx* ctx, int store, TB_Reg addr, int size) {
+    TB_MemorySSA* mssa = &ctx->mssa;
+
+    int top = 0, budget = WALK_BUDGET;
+    ctx->stack[top++] = store;
+    ctx->visited[store] = store;
+
+    while (top > 0) {
+        int a = ctx->stack[--top];
+
+        FOREACH_N(i, mssa->user_start[a], mssa->user_start[a + 1]) {
+            int u = mssa->users[i];
+            if (ctx->visited[u] == store) continue;
+            ctx->visited[u] = store;
+
+            if (budget-- <= 0) return true;
+
+            TB_MemoryAccess* acc = &mssa->accesses[u];
+            if (tb_memssa_may_read(ctx->f, &ctx->ai, acc, addr, size)) return true;
+
+            // uses don't produce a new state so there's nothing past them
+            if (acc->kind == TB_MEMORY_USE || overwrites(ctx, acc, addr, size)) continue;
+
+            ctx->stack[top++] = u;
+        }
+    }
+
+    return false;
+}
+
+static bool dead_store_elim(TB_Function* f) {
+    TB_TemporaryStorage* tls = tb_tls_allocate();
+
+    DeadStoreCtx ctx = { .f = f, .ai = tb_get_alias_info(f, tls), .mssa = tb_get_memory_ssa(f, tls) };
+    size_t access_count = ctx.mssa.access_count;
+
+    ctx.visited = tb_tls_push(tls, access_count * sizeof(int));
+    ctx.stack = tb_tls_push(tls, access_count * sizeof(int));
+    FOREACH_N(i, 0, access_count) ctx.visited[i] = -1;
+
+    // find them all first, the memory SSA doesn't know about murdered stores
+    // but killing them doesn't change the answer for the others: anything that
+    // was covering a dead store is still covering what it covered.
+    int changes = 0;
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(r, f, bb) {
+            TB_Node* n = &f->nodes[r];
+            if (n->type != TB_STORE || n->store.is_volatile) continue;
+
+            int size = tb_alias_access_size(&ctx.ai, n->dt);
+            if (!is_store_read(&ctx, ctx.mssa.node_access[r], n->store.address, size)) {
+                OPTIMIZER_LOG(r, "Removed dead store");
+                tb_murder_reg(f, r);
+                changes++;
+            }
+        }
+    }
+
+    return changes;
+}
+
+TB_API TB_Pass tb_opt_dead_store_elim(void) {
+    return (TB_Pass){
+        .mode = TB_FUNCTION_PASS,
+        .name = "DeadStoreElimination",
+        .func_run = dead_store_elim,
+        .preserves = TB_ANALYSIS_CFG,
+    };
+}
@@ -19,8 +19,7 @@ bool tb_opt_deshort_circuit(TB_Function* f) {
         preds[0] = NULL;
 
         loop_range(j, 1, f->label_count) {
-            preds[j] = (TB_Label*)tb_tls_push(tls, 0);
-            tb_calculate_immediate_predeccessors(f, tls, j, &pred_count[j]);
+            preds[j] = tb_calculate_immediate_predeccessors(f, tls, j, &pred_count[j]);
         }
     }
 
@@ -217,7 +217,7 @@ static bool phi_motion(TB_Function* f, TB_Node* n) {
             f->nodes[shared_op].i_arith.b = 0;
             f->nodes[shared_op].i_arith.arith_behavior = shared_ab;
 
-            tb_function_find_replace_reg(f, r, shared_op);
+            tb_function_find_replace_reg(f, bb, r, shared_op);
 
             // set after the replace op
             f->nodes[shared_op].i_arith.b = r;
@@ -277,7 +277,7 @@ static bool const_fold(TB_Function* f, TB_Node* n) {
                 if (src->integer.num_words == 1) {
                     n->integer.single_word = ~src->integer.single_word + 1;
                 } else {
-                    BigInt_t* words = tb_platform_heap_alloc(BigIntWordSize * src->integer.num_words);
+                    BigInt_t* words = tb__ir_alloc(f, BigIntWordSize * src->integer.num_words);
                     BigInt_copy(src->integer.num_words, words, src->integer.words);
                     BigInt_not(src->integer.num_words, words);
                     BigInt_inc(src->integer.num_words, words);
@@ -301,7 +301,7 @@ static bool const_fold(TB_Function* f, TB_Node* n) {
                 if (src->integer.num_words == 1) {
                     n->integer.single_word = ~src->integer.single_word;
                 } else {
-                    BigInt_t* words = tb_platform_heap_alloc(BigIntWordSize * src->integer.num_words);
+                    BigInt_t* words = tb__ir_alloc(f, BigIntWordSize * src->integer.num_words);
                     BigInt_copy(src->integer.num_words, words, src->integer.words);
                     BigInt_not(src->integer.num_words, words);
                     n->integer.words = words;
@@ -326,7 +326,7 @@ static bool const_fold(TB_Function* f, TB_Node* n) {
                 }
 
                 BigInt_t temp;
-                BigInt_t* words = dst_num_words == 1 ? &temp : tb_platform_heap_alloc(BigIntWordSize * dst_num_words);
+                BigInt_t* words = dst_num_words == 1 ? &temp : tb__ir_alloc(f, BigIntWordSize * dst_num_words);
                 BigInt_copy(src_num_words, words, src_words);
 
                 FOREACH_N(i, src_num_words, dst_num_words) {
@@ -356,7 +356,7 @@ static bool const_fold(TB_Function* f, TB_Node* n) {
                 BigInt_t* src_words = src->integer.num_words == 1 ? &src->integer.single_word : src->integer.words;
 
                 BigInt_t temp;
-                BigInt_t* words = dst_num_words == 1 ? &temp : tb_platform_heap_alloc(BigIntWordSize * dst_num_words);
+                BigInt_t* words = dst_num_words == 1 ? &temp : tb__ir_alloc(f, BigIntWordSize * dst_num_words);
                 BigInt_copy(dst_num_words, words, src_words);
 
                 // fixup the bits here
@@ -449,7 +449,7 @@ static bool const_fold(TB_Function* f, TB_Node* n) {
                     assert(num_a_words == num_b_words);
 
                     BigInt_t temp;
-                    BigInt_t* words = num_a_words == 1 ? &temp : tb_platform_heap_alloc(BigIntWordSize * num_a_words);
+                    BigInt_t* words = num_a_words == 1 ? &temp : tb__ir_alloc(f, BigIntWordSize * num_a_words);
 
                     switch (n->type) {
                         case TB_ADD: BigInt_add(num_a_words, a_words, num_b_words, b_words, num_a_words, words); break;
@@ -473,9 +473,8 @@ static bool const_fold(TB_Function* f, TB_Node* n) {
                         n->integer.words = words;
                     }
 
-                    // if we fail, delete our allocation, we probably should avoid failing in the future
-                    fail:
-                    if (num_a_words > 1) tb_platform_heap_free(words);
+                    // if we fail, the words just sit in the IR arena until it's freed
+                    fail:;
                 } else {
                     // partial binary operations e.g.
                     //   a * 0 = 0
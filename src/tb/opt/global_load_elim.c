@@ -0,0 +1,164 @@
+// Redundant load elimination across blocks, built on memory SSA.
+//
+// for every load we walk up the memory states until we find whatever might've
+// written to its address (the clobber). if that's a store to the same spot we
+// forward the stored value, if some other load which dominates us has the same
+// address and the same clobber then it already read the same value.
+#include "../tb_internal.h"
+
+// phis we're willing to look through per load, keeps loops of loops sane
+#define PHI_BUDGET 64
+
+// how many of the loads sharing a clobber we'll compare against
+#define MAX_CANDIDATES 32
+
+typedef struct {
+    TB_Reg load;
+    int next;
+} Candidate;
+
+typedef struct {
+    TB_Function* f;
+    TB_AliasInfo ai;
+    TB_MemorySSA mssa;
+
+    // [access_count] phis we're currently walking through
+    bool* visiting;
+    int budget;
+    bool gave_up;
+} GlobalLoadCtx;
+
+// returns -1 if every path led back to a phi we're already in the middle of,
+// those don't count since whatever flows around the cycle is the phi itself.
+static int find_clobber(GlobalLoadCtx* ctx, int a, TB_Reg addr, int size) {
+    for (;;) {
+        if (a == 0) return 0;
+
+        TB_MemoryAccess* acc = &ctx->mssa.accesses[a];
+        if (acc->kind == TB_MEMORY_DEF) {
+            if (tb_memssa_may_write(ctx->f, &ctx->ai, acc, addr, size)) return a;
+
+            a = acc->defining;
+            continue;
+        }
+
+        assert(acc->kind == TB_MEMORY_PHI);
+        if (ctx->visiting[a]) return -1;
+        if (ctx->budget-- <= 0) {
+            ctx->gave_up = true;
+            return a;
+        }
+
+        // if every way in agrees on the clobber then we can skip the phi
+        ctx->visiting[a] = true;
+        int result = -1;
+        FOREACH_N(i, 0, acc->operand_count) {
+            int c = find_clobber(ctx, acc->operands[i], addr, size);
+            if (c < 0 || c == result) continue;
+
+            if (result >= 0) {
+                result = a;
+                break;
+            }
+            result = c;
+        }
+        ctx->visiting[a] = false;
+
+        return result;
+    }
+}
+
+static bool global_load_elim(TB_Function* f) {
+    TB_TemporaryStorage* tls = tb_tls_allocate();
+
+    // we only ever replace and murder loads so the def-use index stays valid
+    tb_function_build_uses(f);
+
+    GlobalLoadCtx ctx = { .f = f, .ai = tb_get_alias_info(f, tls), .mssa = tb_get_memory_ssa(f, tls) };
+    size_t access_count = ctx.mssa.access_count;
+
+    ctx.visiting = tb_tls_push(tls, access_count * sizeof(bool));
+    memset(ctx.visiting, 0, access_count * sizeof(bool));
+
+    // loads which survived, chained by their clobber
+    int* heads = tb_tls_push(tls, access_count * sizeof(int));
+    FOREACH_N(i, 0, access_count) heads[i] = -1;
+
+    Candidate* candidates = tb_tls_push(tls, access_count * sizeof(Candidate));
+    int candidate_count = 0;
+
+    // reverse postorder means anything that dominates us was already seen
+    const TB_DomTree* doms = tb_function_get_dom_tree(f);
+
+    int changes = 0;
+    FOREACH_REVERSE_N(i, 0, doms->postorder_count) {
+        TB_Label bb = doms->postorder[i];
+
+        TB_FOR_NODE(r, f, bb) {
+            TB_Node* n = &f->nodes[r];
+            if (n->type != TB_LOAD || n->load.is_volatile) continue;
+
+            TB_Reg addr = n->load.address;
+            int size = tb_alias_access_size(&ctx.ai, n->dt);
+
+            ctx.budget = PHI_BUDGET;
+            ctx.gave_up = false;
+            int clobber = find_clobber(&ctx, ctx.mssa.accesses[ctx.mssa.node_access[r]].defining, addr, size);
+            if (ctx.gave_up || clobber < 0) continue;
+
+            // STORE *p, _1 # on every path
+            // ...          #
+            // _2 = LOAD *p # then _2 = _1
+            TB_Reg found = TB_NULL_REG;
+            TB_MemoryAccess* c = &ctx.mssa.accesses[clobber];
+            if (c->kind == TB_MEMORY_DEF) {
+                TB_Node* store = &f->nodes[c->node];
+
+                if (store->type == TB_STORE && !store->store.is_volatile &&
+                    TB_DATA_TYPE_EQUALS(store->dt, n->dt) &&
+                    tb_alias_must_alias(f, store->store.address, addr) &&
+                    tb_memssa_node_dominates(f, &ctx.mssa, c->node, r)) {
+                    found = store->store.value;
+                }
+            }
+
+            // _1 = LOAD *p # which dominates us and nothing
+            // ...          # wrote to p in between
+            // _2 = LOAD *p # then _2 = _1
+            if (found == TB_NULL_REG) {
+                int steps = 0;
+                for (int j = heads[clobber]; j >= 0 && steps < MAX_CANDIDATES; j = candidates[j].next, steps++) {
+                    TB_Reg other = candidates[j].load;
+
+                    if (TB_DATA_TYPE_EQUALS(f->nodes[other].dt, n->dt) &&
+                        tb_alias_must_alias(f, f->nodes[other].load.address, addr) &&
+                        tb_memssa_node_dominates(f, &ctx.mssa, other, r)) {
+                        found = other;
+                        break;
+                    }
+                }
+            }
+
+            if (found != TB_NULL_REG) {
+                OPTIMIZER_LOG(r, "Replaced redundant load with r%d", found);
+                tb_function_find_replace_reg(f, bb, r, found);
+                tb_murder_reg(f, r);
+                changes++;
+            } else {
+                candidates[candidate_count] = (Candidate){ r, heads[clobber] };
+                heads[clobber] = candidate_count++;
+            }
+        }
+    }
+
+    return changes;
+}
+
+TB_API TB_Pass tb_opt_global_load_elim(void) {
+    return (TB_Pass){
+        .mode = TB_FUNCTION_PASS,
+        .name = "GlobalLoadElimination",
+        .func_run = global_load_elim,
+        .preserves = TB_ANALYSIS_CFG,
+    };
+}
@@ -0,0 +1,127 @@
+// Global value numbering
+//
+// we walk the dominator tree keeping a hash table of every pure node that's
+// available at that point, anything that matches an entry was already computed
+// by something which dominates it. entries get popped as we leave the block
+// that added them so siblings in the tree never see each other's values.
+#include "cse.h"
+
+typedef struct {
+    TB_Label bb;
+    int next_kid;
+
+    // how many entries the table had before we entered bb
+    size_t undo_mark;
+} GVNFrame;
+
+typedef struct {
+    TB_Function* f;
+
+    // open addressing, 0 means empty
+    size_t mask;
+    TB_Reg* table;
+
+    // the slots we filled, in order, so scopes can be popped
+    size_t undo_count;
+    size_t* undo;
+} GVNCtx;
+
+// LDMXCSR writes the control register so two of them aren't the same value
+static bool is_gvn_candidate(TB_Node* n) {
+    return !TB_IS_NODE_SIDE_EFFECT(n->type) && n->type != TB_LOAD && n->type != TB_X86INTRIN_LDMXCSR;
+}
+
+// returns the available node equivalent to r or inserts r if there's none
+static TB_Reg gvn_lookup(GVNCtx* ctx, TB_Reg r, uint32_t hash) {
+    TB_Function* f = ctx->f;
+
+    size_t i = hash & ctx->mask;
+    for (; ctx->table[i] != 0; i = (i + 1) & ctx->mask) {
+        TB_Reg other = ctx->table[i];
+        if (is_node_the_same(&f->nodes[r], &f->nodes[other])) return other;
+    }
+
+    // we only ever remove the newest entries so leaving holes in the middle
+    // of a probe sequence can't happen.
+    ctx->table[i] = r;
+    ctx->undo[ctx->undo_count++] = i;
+    return TB_NULL_REG;
+}
+
+static int gvn_block(GVNCtx* ctx, TB_Label bb) {
+    TB_Function* f = ctx->f;
+
+    int changes = 0;
+    TB_FOR_NODE(r, f, bb) {
+        TB_Node* n = &f->nodes[r];
+
+        uint32_t hash;
+        if (!is_gvn_candidate(n) || !hash_node(n, &hash)) continue;
+
+        TB_Reg found = gvn_lookup(ctx, r, hash);
+        if (found != TB_NULL_REG) {
+            // the users get rewritten right away so anything that used r
+            // hashes the same as if it had used found from the start.
+            OPTIMIZER_LOG(r, "Replaced with equivalent value r%d", found);
+            tb_function_find_replace_reg(f, bb, r, found);
+            tb_murder_reg(f, r);
+            changes++;
+        }
+    }
+
+    return changes;
+}
+
+static bool gvn(TB_Function* f) {
+    TB_TemporaryStorage* tls = tb_tls_allocate();
+
+    // we only ever replace and murder nodes so the def-use index stays valid
+    tb_function_build_uses(f);
+
+    const TB_DomTree* doms = tb_function_get_dom_tree(f);
+
+    size_t capacity = tb_next_pow2(f->node_count * 2);
+    GVNCtx ctx = {
+        .f = f,
+        .mask = capacity - 1,
+        .table = tb_tls_push(tls, capacity * sizeof(TB_Reg)),
+        .undo = tb_tls_push(tls, f->node_count * sizeof(size_t)),
+    };
+    memset(ctx.table, 0, capacity * sizeof(TB_Reg));
+
+    GVNFrame* stack = tb_tls_push(tls, f->bb_count * sizeof(GVNFrame));
+    int top = 0;
+
+    int changes = gvn_block(&ctx, 0);
+    stack[top++] = (GVNFrame){ 0, doms->kids_start[0], 0 };
+
+    while (top > 0) {
+        GVNFrame* fr = &stack[top - 1];
+
+        if (fr->next_kid < doms->kids_start[fr->bb + 1]) {
+            TB_Label kid = doms->kids[fr->next_kid++];
+
+            size_t mark = ctx.undo_count;
+            changes += gvn_block(&ctx, kid);
+            stack[top++] = (GVNFrame){ kid, doms->kids_start[kid], mark };
+            continue;
+        }
+
+        // leaving the block, whatever it defined isn't available anymore
+        while (ctx.undo_count > fr->undo_mark) {
+            ctx.table[ctx.undo[--ctx.undo_count]] = 0;
+        }
+        top -= 1;
+    }
+
+    return changes;
+}
+
+TB_API TB_Pass tb_opt_global_value_numbering(void) {
+    return (TB_Pass){
+        .mode = TB_FUNCTION_PASS,
+        .name = "GlobalValueNumbering",
+        .func_run = gvn,
+        .preserves = TB_ANALYSIS_CFG,
+    };
+}
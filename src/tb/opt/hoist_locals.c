@@ -14,6 +14,8 @@ static bool hoist_locals(TB_Function* f) {
         return false;
     }
 
+    tb_function_build_uses(f);
+
     // check where in the entry label we should place the locals
     //
     // place to start putting all the locals
@@ -49,7 +51,7 @@ static bool hoist_locals(TB_Function* f) {
                 locals_to_move--;
 
                 OPTIMIZER_LOG(n - f->nodes, "hoisted local");
-                tb_function_find_replace_reg(f, n - f->nodes, new_reg);
+                tb_function_find_replace_reg(f, bb, n - f->nodes, new_reg);
 
                 if (locals_to_move == 0) {
                     // ran out of stuff to do, early exit
@@ -67,5 +69,6 @@ TB_API TB_Pass tb_opt_hoist_locals(void) {
         .mode = TB_FUNCTION_PASS,
         .name = "HoistLocals",
         .func_run = hoist_locals,
+        .preserves = TB_ANALYSIS_CFG,
     };
 }
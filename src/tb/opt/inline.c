@@ -0,0 +1,134 @@
+// Function inlining
+//
+// we walk the call graph bottom-up so by the time we get to a caller all of
+// its callees are done (and as big as they're gonna get), then every direct
+// call to a small enough function gets its body copied in. nothing in an SCC
+// is inlined into something else in the same SCC so recursion can't blow us up.
+#include "../tb_internal.h"
+
+// callees with more nodes than this aren't worth copying around
+#define INLINE_THRESHOLD 40
+
+// how many nodes any one caller is allowed to grow by, on top of that nothing
+// gets past INLINE_MAX_SIZE.
+#define INLINE_GROWTH_BUDGET 400
+#define INLINE_MAX_SIZE 8000
+
+// roughly how much code a function turns into, params and debug info are free
+static int inline_cost(TB_Function* f) {
+    int cost = 0;
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(r, f, bb) {
+            switch (f->nodes[r].type) {
+                case TB_NULL:
+                case TB_PARAM:
+                case TB_LINE_INFO:
+                break;
+
+                default:
+                cost += 1;
+                break;
+            }
+        }
+    }
+
+    return cost;
+}
+
+static bool can_inline(TB_Function* f, TB_Node* call, TB_Function* callee) {
+    const TB_FunctionPrototype* p = callee->prototype;
+    if (p->has_varargs || callee->bb_count == 0 || callee->bbs[0].start == 0) {
+        return false;
+    }
+
+    // calls through mismatched prototypes get left alone
+    if (!TB_DATA_TYPE_EQUALS(call->dt, p->return_dt) || CALL_NODE_PARAM_COUNT(call) != p->param_count) {
+        return false;
+    }
+
+    FOREACH_N(i, 0, p->param_count) {
+        TB_Reg arg = f->vla.data[call->call.param_start + i];
+        if (!TB_DATA_TYPE_EQUALS(f->nodes[arg].dt, p->params[i].dt)) return false;
+    }
+
+    return true;
+}
+
+static int inline_into(TB_CallGraph* cg, const int* costs, size_t caller) {
+    TB_Function* f = cg->funcs[caller];
+
+    int size = costs[caller];
+    int limit = size + INLINE_GROWTH_BUDGET;
+    if (limit > INLINE_MAX_SIZE) limit = INLINE_MAX_SIZE;
+
+    // we only look at the calls that were there to begin with, anything which
+    // came in with a callee already had its chance when we did that callee.
+    // the callee's blocks land between the call's block and its continuation
+    // so jumping to the continuation skips over them.
+    int changes = 0;
+    for (TB_Label bb = 0; bb < f->bb_count; bb++) {
+        retry:
+        TB_FOR_NODE(r, f, bb) {
+            TB_Node* n = &f->nodes[r];
+            if (n->type != TB_CALL || n->call.target->tag != TB_SYMBOL_FUNCTION) continue;
+
+            size_t callee = tb_call_graph_find(cg, (TB_Function*) n->call.target);
+            if (callee == SIZE_MAX || cg->scc_of[callee] == cg->scc_of[caller]) continue;
+            if (costs[callee] > INLINE_THRESHOLD || size + costs[callee] > limit) continue;
+            if (!can_inline(f, n, cg->funcs[callee])) continue;
+
+            OPTIMIZER_LOG(r, "Inlined call to %s", cg->funcs[callee]->super.name);
+            if (changes == 0) tb_function_free_uses(f);
+
+            bb = tb_insert_copy_ops(f, bb, r, cg->funcs[callee]);
+            size += costs[callee];
+            changes++;
+            goto retry;
+        }
+    }
+
+    if (changes) {
+        tb_function_invalidate_analysis(f, TB_ANALYSIS_ALL);
+    }
+    return changes;
+}
+
+static bool inline_module(TB_Module* m) {
+    DynArray(TB_Function*) funcs = dyn_array_create(TB_Function*, m->symbol_count[TB_SYMBOL_FUNCTION] + 1);
+    TB_FOR_FUNCTIONS(f, m) {
+        dyn_array_put(funcs, f);
+    }
+
+    size_t func_count = dyn_array_length(funcs);
+    TB_CallGraph cg = tb_build_call_graph(func_count, funcs);
+
+    int* costs = tb_platform_heap_alloc(func_count * sizeof(int));
+    FOREACH_N(i, 0, func_count) costs[i] = inline_cost(funcs[i]);
+
+    // SCCs come out callees first
+    int changes = 0;
+    FOREACH_N(scc, 0, cg.scc_count) {
+        FOREACH_N(i, cg.scc_start[scc], cg.scc_start[scc + 1]) {
+            size_t caller = cg.scc_funcs[i];
+
+            int k = inline_into(&cg, costs, caller);
+            if (k) {
+                costs[caller] = inline_cost(funcs[caller]);
+                changes += k;
+            }
+        }
+    }
+
+    tb_platform_heap_free(costs);
+    tb_free_call_graph(&cg);
+    dyn_array_destroy(funcs);
+    return changes;
+}
+
+TB_API TB_Pass tb_opt_inline(void) {
+    return (TB_Pass){
+        .mode = TB_MODULE_PASS,
+        .name = "Inline",
+        .mod_run = inline_module,
+    };
+}
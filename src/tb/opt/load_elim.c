@@ -1,86 +1,168 @@
 #include "../tb_internal.h"
 
-// TODO(NeGate): implement restrict semantics
-static bool tb_address_may_alias(TB_Function* f, TB_Reg r, TB_Reg target) {
-    return true;
+// we don't wanna end up scanning a massive list for every load in a giant block
+#define MAX_AVAILABLE 256
+
+// a value we know is sitting at some address
+typedef struct {
+    TB_Reg addr;
+    TB_DataType dt;
+    int size;
+
+    TB_Reg value;
+} Available;
+
+typedef struct {
+    TB_Function* f;
+    TB_AliasInfo ai;
+
+    size_t count;
+    Available* entries;
+} LoadElimCtx;
+
+static void add_available(LoadElimCtx* ctx, TB_Reg addr, TB_DataType dt, int size, TB_Reg value) {
+    if (ctx->count == MAX_AVAILABLE) {
+        // drop the oldest
+        memmove(&ctx->entries[0], &ctx->entries[1], (MAX_AVAILABLE - 1) * sizeof(Available));
+        ctx->count -= 1;
+    }
+
+    ctx->entries[ctx->count++] = (Available){ addr, dt, size, value };
+}
+
+// size <= 0 means we don't know how much is being written
+static void kill_aliasing(LoadElimCtx* ctx, TB_Reg addr, int size) {
+    size_t j = 0;
+    FOREACH_N(i, 0, ctx->count) {
+        Available* e = &ctx->entries[i];
+        if (!tb_alias_may_alias(ctx->f, &ctx->ai, addr, size, e->addr, e->size)) {
+            ctx->entries[j++] = *e;
+        }
+    }
+    ctx->count = j;
+}
+
+// calls and such can write to anything that's visible outside of the function
+static void kill_escaping(LoadElimCtx* ctx) {
+    size_t j = 0;
+    FOREACH_N(i, 0, ctx->count) {
+        Available* e = &ctx->entries[i];
+        if (tb_alias_is_local_only(ctx->f, &ctx->ai, e->addr)) {
+            ctx->entries[j++] = *e;
+        }
+    }
+    ctx->count = j;
 }
 
 static bool load_store_elim(TB_Function* f) {
-    int changes = 0;
+    TB_TemporaryStorage* tls = tb_tls_allocate();
+
+    // we only ever replace and murder loads so the def-use index stays valid
+    tb_function_build_uses(f);
 
-    #if 0
+    LoadElimCtx ctx = {
+        .f = f,
+        .ai = tb_get_alias_info(f, tls),
+        .entries = tb_tls_push(tls, MAX_AVAILABLE * sizeof(Available)),
+    };
+
+    // STORE *p, _1 #
+    // ...          # anything but a possible store to p, or a
+    // _2 = LOAD *p # call which can see p, then _2 = _1
+    //
+    // _1 = LOAD *p #
+    // ...          # same deal
+    // _2 = LOAD *p # then _2 = _1
+    int changes = 0;
     TB_FOR_BASIC_BLOCK(bb, f) {
+        ctx.count = 0;
+
         TB_FOR_NODE(r, f, bb) {
             TB_Node* n = &f->nodes[r];
+            TB_NodeTypeEnum t = n->type;
+
+            if (t == TB_LOAD) {
+                if (n->load.is_volatile) continue;
 
-            if (n->type == TB_LOAD) {
-                TB_DataType dt = n->dt;
                 TB_Reg addr = n->load.address;
-                uint32_t alignment = n->load.alignment;
-
-                // Find any duplicates
-                for (TB_Node* other = &f->nodes[n->next]; other != &f->nodes[0]; other = &f->nodes[other->next]) {
-                    TB_NodeTypeEnum t = other->type;
-
-                    if (t == TB_LOAD &&
-                        other->load.alignment == alignment &&
-                        other->load.address == addr &&
-                        TB_DATA_TYPE_EQUALS(dt, other->dt)) {
-                        other->type = TB_PASS;
-                        other->pass.value = i;
-                        changes++;
-                    } else if (TB_IS_NODE_TERMINATOR(t) || TB_IS_NODE_SIDE_EFFECT(t)) {
-                        // Can't read past side effects or terminators, don't
-                        // know what might happen
-                        if (t != TB_STORE || (t == TB_STORE && !tb_address_may_alias(f, n->store.address, addr))) {
-                            break;
-                        }
+                TB_Reg found = TB_NULL_REG;
+                FOREACH_REVERSE_N(i, 0, ctx.count) {
+                    Available* e = &ctx.entries[i];
+                    if (TB_DATA_TYPE_EQUALS(e->dt, n->dt) && tb_alias_must_alias(f, e->addr, addr)) {
+                        found = e->value;
+                        break;
                     }
                 }
-            }
-        }
 
-        // STORE *p, _1 #
-        // ...          # anything but a possible store to addr, terminator,
-        // _2 = LOAD *p # or side effect then _2 = _1
-        TB_FOR_NODE(n, f, bb) {
-            if (n->type == TB_STORE) {
-                TB_DataType dt = n->dt;
-                TB_Reg value = n->store.value;
+                if (found != TB_NULL_REG) {
+                    OPTIMIZER_LOG(r, "Replaced redundant load with r%d", found);
+                    tb_function_find_replace_reg(f, bb, r, found);
+                    tb_murder_reg(f, r);
+                    changes++;
+                } else {
+                    add_available(&ctx, addr, n->dt, tb_alias_access_size(&ctx.ai, n->dt), r);
+                }
+            } else if (t == TB_STORE) {
                 TB_Reg addr = n->store.address;
-                uint32_t alignment = n->store.alignment;
-
-                // Find any duplicates
-                TB_FOR_NODE_AFTER(other, n, bb) {
-                    TB_NodeTypeEnum t = other->type;
-
-                    if (t == TB_LOAD &&
-                        other->load.alignment == alignment &&
-                        other->load.address == addr &&
-                        TB_DATA_TYPE_EQUALS(dt, other->dt)) {
-                        other->type = TB_PASS;
-                        other->pass.value = value;
-                        changes++;
-                    } else if (TB_IS_NODE_TERMINATOR(t) || TB_IS_NODE_SIDE_EFFECT(t)) {
-                        // Can't read past side effects or terminators, don't
-                        // know what might happen
-                        if (t != TB_STORE || (t == TB_STORE && !tb_address_may_alias(f, other->store.address, addr))) {
-                            break;
-                        }
-                    }
+                int size = tb_alias_access_size(&ctx.ai, n->dt);
+
+                kill_aliasing(&ctx, addr, size);
+                if (!n->store.is_volatile) {
+                    add_available(&ctx, addr, n->dt, size, n->store.value);
                 }
+            } else if (t == TB_MEMSET || t == TB_MEMCPY) {
+                kill_aliasing(&ctx, n->mem_op.dst, tb_alias_mem_op_size(f, n->mem_op.size));
+            } else if (t == TB_MEMCLR) {
+                kill_aliasing(&ctx, n->clear.dst, n->clear.size);
+            } else if (t == TB_INITIALIZE) {
+                kill_aliasing(&ctx, n->init.addr, 0);
+            } else if (t >= TB_ATOMIC_TEST_AND_SET && t <= TB_ATOMIC_CMPXCHG2) {
+                // atomics don't leak their address so a local which is only
+                // ever touched through them still counts as local only, we
+                // have to kill it ourselves.
+                kill_escaping(&ctx);
+                kill_aliasing(&ctx, n->atomic.addr, 0);
+            } else if (t == TB_LINE_INFO || t == TB_KEEPALIVE || t == TB_POISON || t == TB_MEMCMP) {
+                // doesn't write to memory
+            } else if (TB_IS_NODE_SIDE_EFFECT(t)) {
+                // calls, anything else we don't understand
+                kill_escaping(&ctx);
             }
         }
     }
-    #endif
 
     return changes;
 }
 
+#ifdef TB_COMPILE_TESTS
+// store L, 1; atomic_add L, 5; load L can't see the 1 anymore
+bool tb_opt_test_suite(void) {
+    TB_FeatureSet features = { 0 };
+    TB_Module* m = tb_module_create(TB_ARCH_X86_64, TB_SYSTEM_LINUX, &features, false);
+
+    TB_Function* f = tb_function_create(m, "atomic_local", TB_LINKAGE_PRIVATE);
+    tb_function_set_prototype(f, tb_prototype_create(m, TB_CDECL, TB_TYPE_I32, NULL, 0, false));
+
+    TB_Reg local = tb_inst_local(f, 4, 4);
+    tb_inst_store(f, TB_TYPE_I32, local, tb_inst_sint(f, TB_TYPE_I32, 1), 4);
+    tb_inst_atomic_add(f, local, tb_inst_sint(f, TB_TYPE_I32, 5), TB_MEM_ORDER_SEQ_CST);
+    TB_Reg ld = tb_inst_load(f, TB_TYPE_I32, local, 4);
+    tb_inst_ret(f, ld);
+
+    load_store_elim(f);
+    tb_function_free_uses(f);
+
+    bool success = (f->nodes[ld].type == TB_LOAD);
+    tb_module_destroy(m);
+    return success;
+}
+#endif /* TB_COMPILE_TESTS */
+
 TB_API TB_Pass tb_opt_load_store_elim(void) {
     return (TB_Pass){
         .mode = TB_FUNCTION_PASS,
         .name = "LoadStoreElimination",
         .func_run = load_store_elim,
+        .preserves = TB_ANALYSIS_CFG,
     };
 }
@@ -28,6 +28,10 @@ typedef struct Mem2Reg_Ctx {
     TB_Predeccesors preds;
     // [bb_count]
     TB_Label* doms;
+
+    // every node from here on is one of our phis, the ones which were already
+    // in the function can still end up as a variable's value.
+    TB_Reg first_phi;
 } Mem2Reg_Ctx;
 
 static int bits_in_data_type(int pointer_size, TB_DataType dt);
@@ -42,6 +46,10 @@ static int get_variable_id(Mem2Reg_Ctx* restrict c, TB_Reg r) {
     return -1;
 }
 
+static bool is_new_phi(Mem2Reg_Ctx* restrict c, TB_Function* f, TB_Reg r) {
+    return r >= c->first_phi && tb_node_is_phi_node(f, r);
+}
+
 // This doesn't really generate a PHI node, it just produces a NULL node which will
 // be mutated into a PHI node by the rest of the code.
 static TB_Reg new_phi(Mem2Reg_Ctx* restrict c, TB_Function* f, int var, TB_Label block, TB_DataType dt) {
@@ -91,7 +99,7 @@ static void add_phi_operand(Mem2Reg_Ctx* restrict c, TB_Function* f, TB_Reg phi_
     } else if (count == 2) {
         phi_node->type = TB_PHIN;
 
-        TB_PhiInput* new_inputs = tb_platform_heap_alloc(3 * sizeof(TB_PhiInput));
+        TB_PhiInput* new_inputs = tb__ir_alloc(f, 3 * sizeof(TB_PhiInput));
         new_inputs[0] = inputs[0];
         new_inputs[1] = inputs[1];
         new_inputs[2] = (TB_PhiInput){ label, reg };
@@ -100,10 +108,7 @@ static void add_phi_operand(Mem2Reg_Ctx* restrict c, TB_Function* f, TB_Reg phi_
         phi_node->phi.inputs = new_inputs;
     } else {
         size_t index = phi_node->phi.count++;
-        phi_node->phi.inputs = tb_platform_heap_realloc(phi_node->phi.inputs, phi_node->phi.count * sizeof(TB_PhiInput));
-        if (phi_node->phi.inputs == NULL) {
-            tb_panic("add_phi_operand: Out of memory!");
-        }
+        phi_node->phi.inputs = tb__ir_realloc(f, phi_node->phi.inputs, index * sizeof(TB_PhiInput), phi_node->phi.count * sizeof(TB_PhiInput));
 
         phi_node->phi.inputs[index] = (TB_PhiInput) { label, reg };
     }
@@ -116,7 +121,7 @@ static void write_variable(Mem2Reg_Ctx* c, int var, TB_Label block, TB_Reg value
 static void ssa_replace_phi_arg(Mem2Reg_Ctx* c, TB_Function* f, TB_Label bb, TB_Label dst, DynArray(TB_Reg)* stack) {
     FOREACH_N(var, 0, c->to_promote_count) {
         TB_Reg phi_reg = c->current_def[(var * f->bb_count) + dst];
-        if (!tb_node_is_phi_node(f, phi_reg)) continue;
+        if (!is_new_phi(c, f, phi_reg)) continue;
 
         int count = tb_node_get_phi_width(f, phi_reg);
         TB_PhiInput* inputs = tb_node_get_phi_inputs(f, phi_reg);
@@ -143,7 +148,7 @@ static void ssa_rename(Mem2Reg_Ctx* c, TB_Function* f, TB_Label bb, DynArray(TB_
     size_t* old_len = tb_tls_push(c->tls, sizeof(size_t) * f->bb_count);
     FOREACH_N(var, 0, c->to_promote_count) {
         TB_Reg value = c->current_def[(var * f->bb_count) + bb];
-        if (tb_node_is_phi_node(f, value)) {
+        if (is_new_phi(c, f, value)) {
             dyn_array_put(stack[var], value);
         }
 
@@ -263,8 +268,9 @@ static ptrdiff_t compatible_with_configs(size_t config_count, AggregateConfig* c
 }
 
 static bool attempt_sroa(TB_Function* f, TB_TemporaryStorage* tls, TB_Reg address, int use_count) {
+    // every config comes from at least one use so that's the cap
     size_t config_count = 0;
-    AggregateConfig* configs = tb_tls_push(tls, 0);
+    AggregateConfig* configs = tb_tls_push(tls, use_count * sizeof(AggregateConfig));
 
     int pointer_size = tb__find_code_generator(f->super.module)->pointer_size;
 
@@ -300,8 +306,10 @@ static bool attempt_sroa(TB_Function* f, TB_TemporaryStorage* tls, TB_Reg addres
                 if (match == -1) {
                     return false;
                 } else if (match == -2) {
+                    // more configs than uses means some use wasn't acceptable
+                    if ((int) config_count == use_count) return false;
+
                     // add new config
-                    tb_tls_push(tls, sizeof(AggregateConfig));
                     configs[config_count++] = (AggregateConfig){ TB_NULL_REG, offset, size, n->dt };
                 }
                 acceptable_use_count += 1;
@@ -362,8 +370,8 @@ bool mem2reg(TB_Function* f) {
     ////////////////////////////////
     // Decide which stack slots to promote
     ////////////////////////////////
-    size_t to_promote_count = 0;
-    TB_Reg* to_promote = tb_tls_push(tls, 0);
+    size_t to_promote_count = 0, to_promote_cap = f->node_count;
+    TB_Reg* to_promote = tb_tls_push(tls, to_promote_cap * sizeof(TB_Reg));
 
     int changes = 0;
     TB_FOR_BASIC_BLOCK(bb, f) {
@@ -377,8 +385,16 @@ bool mem2reg(TB_Function* f) {
 
                 switch (coherence) {
                     case COHERENCY_GOOD: {
-                        *((TB_Reg*)tb_tls_push(tls, sizeof(TB_Reg))) = r;
-                        to_promote_count++;
+                        if (to_promote_count == to_promote_cap) {
+                            // SROA makes new locals so we might outgrow the guess
+                            to_promote_cap = to_promote_cap ? to_promote_cap * 2 : 16;
+
+                            TB_Reg* new_to_promote = tb_tls_push(tls, to_promote_cap * sizeof(TB_Reg));
+                            memcpy(new_to_promote, to_promote, to_promote_count * sizeof(TB_Reg));
+                            to_promote = new_to_promote;
+                        }
+
+                        to_promote[to_promote_count++] = r;
 
                         n->dt = dt;
 
@@ -394,7 +410,12 @@ bool mem2reg(TB_Function* f) {
                         break;
                     }
                     case COHERENCY_USES_ADDRESS: {
-                        if (n->type == TB_LOCAL && attempt_sroa(f, tls, r, use_count)) {
+                        // the SROA configs are only needed while we're in there
+                        void* mark = tb_tls_mark(tls);
+                        bool split = n->type == TB_LOCAL && attempt_sroa(f, tls, r, use_count);
+                        tb_tls_restore(tls, mark);
+
+                        if (split) {
                             // tb_function_print(f, tb_default_print_callback, stdout, false);
 
                             OPTIMIZER_LOG(r, "SROA on stack structure");
@@ -430,12 +451,10 @@ bool mem2reg(TB_Function* f) {
     c.current_def = tb_tls_push(tls, to_promote_count * c.bb_count * sizeof(TB_Reg));
     memset(c.current_def, 0, to_promote_count * c.bb_count * sizeof(TB_Reg));
 
-    // Calculate all the immediate predecessors
-    c.preds = tb_get_temp_predeccesors(f, tls);
-
-    // find dominators
-    c.doms = tb_tls_push(tls, f->bb_count * sizeof(TB_Label));
-    tb_get_dominators(f, c.preds, c.doms);
+    // Calculate all the immediate predecessors and dominators, we don't
+    // modify the CFG so they're still good for whoever runs after us.
+    c.preds = tb_function_get_predeccesors(f);
+    c.doms = tb_function_get_dominators(f);
 
     TB_DominanceFrontiers df = tb_get_dominance_frontiers(f, c.preds, c.doms);
 
@@ -494,6 +513,8 @@ bool mem2reg(TB_Function* f) {
     }
 
     // for each global name we'll insert phi nodes
+    c.first_phi = f->node_count;
+
     size_t queue_count;
     TB_Label* queue = tb_tls_push(tls, f->bb_count * sizeof(TB_Label));
     Set ever_worked = set_create(f->bb_count);
@@ -528,7 +549,7 @@ bool mem2reg(TB_Function* f) {
                     TB_Reg phi_reg = c.current_def[(var * f->bb_count) + l];
                     if (phi_reg == 0) {
                         phi_reg = new_phi(&c, f, var, l, dt);
-                    } else if (!tb_node_is_phi_node(f, phi_reg)) {
+                    } else if (!is_new_phi(&c, f, phi_reg)) {
                         TB_Reg old_reg = phi_reg;
                         phi_reg = new_phi(&c, f, var, l, dt);
                         add_phi_operand(&c, f, phi_reg, l, old_reg);
@@ -559,6 +580,10 @@ bool mem2reg(TB_Function* f) {
     }
 
     ssa_rename(&c, f, 0, stack);
+
+    FOREACH_N(var, 0, c.to_promote_count) {
+        dyn_array_destroy(stack[var]);
+    }
     tb_free_dominance_frontiers(f, &df);
     return true;
 }
@@ -663,5 +688,7 @@ TB_API TB_Pass tb_opt_mem2reg(void) {
         .mode = TB_FUNCTION_PASS,
         .name = "Mem2Reg",
         .func_run = mem2reg,
+        .preserves = TB_ANALYSIS_CFG,
+        .edits_operands = true,
     };
 }
@@ -14,7 +14,7 @@ static bool merge_rets(TB_Function* f) {
 
             if (n->type == TB_RET) {
                 int index = count++;
-                inputs = tb_platform_heap_realloc(inputs, count * sizeof(TB_PhiInput));
+                inputs = tb__ir_realloc(f, inputs, index * sizeof(TB_PhiInput), count * sizeof(TB_PhiInput));
                 inputs[index] = (TB_PhiInput){ bb, n->ret.value };
 
                 dt = n->dt;
@@ -61,8 +61,6 @@ static bool merge_rets(TB_Function* f) {
             n->type = TB_RET;
             n->dt = dt;
             n->ret.value = inputs[0].val;
-
-            tb_platform_heap_free(inputs);
         }
 
         return false;
@@ -74,5 +72,6 @@ TB_API TB_Pass tb_opt_merge_rets(void) {
         .mode = TB_FUNCTION_PASS,
         .name = "MergeReturns",
         .func_run = merge_rets,
+        .edits_operands = true,
     };
 }
@@ -0,0 +1,612 @@
+// Sparse conditional constant propagation
+//
+// every value starts out as TOP (not computed yet) and only ever moves down
+// to a known constant or BOTTOM (overdefined). blocks only get looked at once
+// an edge into them is proven executable and phis ignore inputs from edges
+// which aren't, so constants flow through phis and branches on constants only
+// ever open up the side they'd actually take. once it settles the constant
+// values get rewritten in place, decided branches turn into gotos and anything
+// we never reached is thrown away.
+#include "../tb_internal.h"
+
+enum {
+    LATTICE_TOP,
+    LATTICE_CONST,
+    LATTICE_BOTTOM,
+};
+
+// floats are stored as their bit pattern, ints are masked to their width
+typedef struct {
+    uint8_t kind;
+    uint64_t bits;
+} Lattice;
+
+typedef struct {
+    TB_Function* f;
+
+    Lattice* values;
+    TB_Label* block_of;
+    bool* executable;
+
+    // blocks which just became executable
+    size_t block_count;
+    TB_Label* block_worklist;
+
+    // values which moved down the lattice, each can only do so twice
+    size_t ssa_count;
+    TB_Reg* ssa_worklist;
+} SCCPCtx;
+
+static const Lattice TOP = { LATTICE_TOP };
+static const Lattice BOTTOM = { LATTICE_BOTTOM };
+
+static Lattice lattice_const(uint64_t bits) {
+    return (Lattice){ LATTICE_CONST, bits };
+}
+
+static Lattice lattice_meet(Lattice a, Lattice b) {
+    if (a.kind == LATTICE_TOP) return b;
+    if (b.kind == LATTICE_TOP) return a;
+    if (a.kind == LATTICE_CONST && b.kind == LATTICE_CONST && a.bits == b.bits) return a;
+    return BOTTOM;
+}
+
+// pointers are just 64bit ints here, 0 means we don't track it
+static int int_bits(TB_DataType dt) {
+    if (dt.type == TB_PTR) return 64;
+    if (dt.type == TB_INT && dt.data > 0 && dt.data <= 64) return dt.data;
+    return 0;
+}
+
+static uint64_t int_mask(int bits) {
+    return ~UINT64_C(0) >> (64 - bits);
+}
+
+static int64_t sext(uint64_t x, int bits) {
+    return bits == 64 ? (int64_t) x : (int64_t) tb__sxt(x, bits, 64);
+}
+
+static bool sign_of(uint64_t x, int bits) {
+    return (x >> (bits - 1)) & 1;
+}
+
+// returns false if the result is poison or would trap, we just give up on those
+static bool fold_int_binop(TB_NodeTypeEnum type, TB_ArithmaticBehavior ab, int bits, uint64_t a, uint64_t b, uint64_t* out) {
+    uint64_t mask = int_mask(bits);
+    uint64_t r;
+
+    switch (type) {
+        case TB_AND: r = a & b; break;
+        case TB_OR:  r = a | b; break;
+        case TB_XOR: r = a ^ b; break;
+        case TB_ADD: {
+            r = (a + b) & mask;
+            if ((ab & TB_ARITHMATIC_NUW) && r < a) return false;
+            if ((ab & TB_ARITHMATIC_NSW) && sign_of(a, bits) == sign_of(b, bits) && sign_of(r, bits) != sign_of(a, bits)) return false;
+            break;
+        }
+        case TB_SUB: {
+            r = (a - b) & mask;
+            if ((ab & TB_ARITHMATIC_NUW) && a < b) return false;
+            if ((ab & TB_ARITHMATIC_NSW) && sign_of(a, bits) != sign_of(b, bits) && sign_of(r, bits) != sign_of(a, bits)) return false;
+            break;
+        }
+        case TB_MUL: {
+            r = (a * b) & mask;
+            if (ab & (TB_ARITHMATIC_NUW | TB_ARITHMATIC_NSW)) {
+                // the full product only fits in 64bits for the small types
+                if (bits > 32) return false;
+                if ((ab & TB_ARITHMATIC_NUW) && a * b > mask) return false;
+                if ((ab & TB_ARITHMATIC_NSW) && sext(r, bits) != sext(a, bits) * sext(b, bits)) return false;
+            }
+            break;
+        }
+        case TB_UDIV: case TB_UMOD: {
+            if (b == 0) return false;
+            r = type == TB_UDIV ? a / b : a % b;
+            break;
+        }
+        case TB_SDIV: case TB_SMOD: {
+            int64_t sa = sext(a, bits), sb = sext(b, bits);
+            if (sb == 0 || (sb == -1 && sa == sext(UINT64_C(1) << (bits - 1), bits))) return false;
+            r = (type == TB_SDIV ? sa / sb : sa % sb) & mask;
+            break;
+        }
+        case TB_SHL: case TB_SHR: case TB_SAR: {
+            if (b >= bits) return false;
+            if (type == TB_SHL) r = (a << b) & mask;
+            else if (type == TB_SHR) r = a >> b;
+            else r = (sext(a, bits) >> b) & mask;
+            break;
+        }
+        default: return false;
+    }
+
+    *out = r;
+    return true;
+}
+
+static bool fold_int_cmp(TB_NodeTypeEnum type, int bits, uint64_t a, uint64_t b) {
+    switch (type) {
+        case TB_CMP_EQ:  return a == b;
+        case TB_CMP_NE:  return a != b;
+        case TB_CMP_SLT: return sext(a, bits) < sext(b, bits);
+        case TB_CMP_SLE: return sext(a, bits) <= sext(b, bits);
+        case TB_CMP_ULT: return a < b;
+        case TB_CMP_ULE: return a <= b;
+        default: tb_unreachable(); return false;
+    }
+}
+
+static Lattice fold_float(TB_NodeTypeEnum type, TB_DataType dt, uint64_t ai, uint64_t bi) {
+    double a, b;
+    if (dt.data == TB_FLT_32) {
+        float x, y;
+        uint32_t xi = ai, yi = bi;
+        memcpy(&x, &xi, sizeof(float));
+        memcpy(&y, &yi, sizeof(float));
+        a = x, b = y;
+    } else {
+        memcpy(&a, &ai, sizeof(double));
+        memcpy(&b, &bi, sizeof(double));
+    }
+
+    switch (type) {
+        case TB_CMP_EQ:  return lattice_const(a == b);
+        case TB_CMP_NE:  return lattice_const(a != b);
+        case TB_CMP_FLT: return lattice_const(a < b);
+        case TB_CMP_FLE: return lattice_const(a <= b);
+        default: break;
+    }
+
+    // do the math in the actual type so the rounding matches runtime
+    if (dt.data == TB_FLT_32) {
+        float x = a, y = b, r;
+        switch (type) {
+            case TB_FADD: r = x + y; break;
+            case TB_FSUB: r = x - y; break;
+            case TB_FMUL: r = x * y; break;
+            case TB_FDIV: r = x / y; break;
+            default: return BOTTOM;
+        }
+
+        uint32_t ri;
+        memcpy(&ri, &r, sizeof(float));
+        return lattice_const(ri);
+    } else {
+        double r;
+        switch (type) {
+            case TB_FADD: r = a + b; break;
+            case TB_FSUB: r = a - b; break;
+            case TB_FMUL: r = a * b; break;
+            case TB_FDIV: r = a / b; break;
+            default: return BOTTOM;
+        }
+
+        uint64_t ri;
+        memcpy(&ri, &r, sizeof(double));
+        return lattice_const(ri);
+    }
+}
+
+// which way a terminator goes given what we know about its condition
+static TB_Label switch_target(TB_Function* f, TB_Node* n, uint64_t key) {
+    int bits = int_bits(f->nodes[n->switch_.key].dt);
+    size_t entry_count = (n->switch_.entries_end - n->switch_.entries_start) / 2;
+    TB_SwitchEntry* entries = (TB_SwitchEntry*) &f->vla.data[n->switch_.entries_start];
+
+    FOREACH_N(i, 0, entry_count) {
+        if (((uint64_t) (int64_t) entries[i].key & int_mask(bits)) == key) return entries[i].value;
+    }
+
+    return n->switch_.default_label;
+}
+
+static Lattice branch_key(SCCPCtx* ctx, TB_Reg key) {
+    // we can't decide on keys we don't know how to compare
+    if (int_bits(ctx->f->nodes[key].dt) == 0) return BOTTOM;
+    return ctx->values[key];
+}
+
+static bool is_edge_feasible(SCCPCtx* ctx, TB_Label from, TB_Label to) {
+    TB_Function* f = ctx->f;
+    if (!ctx->executable[from]) return false;
+
+    TB_Node* end = &f->nodes[f->bbs[from].end];
+    switch (end->type) {
+        case TB_GOTO: return end->goto_.label == to;
+
+        case TB_IF: {
+            Lattice cond = branch_key(ctx, end->if_.cond);
+            if (cond.kind == LATTICE_CONST) {
+                return (cond.bits ? end->if_.if_true : end->if_.if_false) == to;
+            }
+
+            return cond.kind == LATTICE_BOTTOM && (end->if_.if_true == to || end->if_.if_false == to);
+        }
+
+        case TB_SWITCH: {
+            Lattice key = branch_key(ctx, end->switch_.key);
+            if (key.kind == LATTICE_CONST) {
+                return switch_target(f, end, key.bits) == to;
+            } else if (key.kind == LATTICE_TOP) {
+                return false;
+            }
+
+            size_t entry_count = (end->switch_.entries_end - end->switch_.entries_start) / 2;
+            TB_SwitchEntry* entries = (TB_SwitchEntry*) &f->vla.data[end->switch_.entries_start];
+            FOREACH_N(i, 0, entry_count) {
+                if (entries[i].value == to) return true;
+            }
+
+            return end->switch_.default_label == to;
+        }
+
+        default: return false;
+    }
+}
+
+static Lattice eval_node(SCCPCtx* ctx, TB_Reg r) {
+    TB_Function* f = ctx->f;
+    TB_Node* n = &f->nodes[r];
+
+    switch (n->type) {
+        case TB_INTEGER_CONST: {
+            int bits = int_bits(n->dt);
+            if (bits == 0 || n->integer.num_words != 1) return BOTTOM;
+
+            return lattice_const(n->integer.single_word & int_mask(bits));
+        }
+
+        case TB_FLOAT32_CONST: {
+            uint32_t bits;
+            memcpy(&bits, &n->flt32.value, sizeof(float));
+            return lattice_const(bits);
+        }
+
+        case TB_FLOAT64_CONST: {
+            uint64_t bits;
+            memcpy(&bits, &n->flt64.value, sizeof(double));
+            return lattice_const(bits);
+        }
+
+        case TB_PASS: return ctx->values[n->pass.value];
+
+        case TB_PHI1: case TB_PHI2: case TB_PHIN: {
+            TB_Label bb = ctx->block_of[r];
+            int count = tb_node_get_phi_width(f, r);
+            TB_PhiInput* inputs = tb_node_get_phi_inputs(f, r);
+
+            Lattice result = TOP;
+            FOREACH_N(i, 0, count) {
+                if (is_edge_feasible(ctx, inputs[i].label, bb)) {
+                    result = lattice_meet(result, ctx->values[inputs[i].val]);
+                }
+            }
+
+            return result;
+        }
+
+        case TB_NOT: case TB_NEG:
+        case TB_ZERO_EXT: case TB_SIGN_EXT: case TB_TRUNCATE:
+        case TB_AND: case TB_OR: case TB_XOR:
+        case TB_ADD: case TB_SUB: case TB_MUL:
+        case TB_UDIV: case TB_SDIV: case TB_UMOD: case TB_SMOD:
+        case TB_SHL: case TB_SHR: case TB_SAR:
+        case TB_FADD: case TB_FSUB: case TB_FMUL: case TB_FDIV:
+        case TB_CMP_EQ: case TB_CMP_NE:
+        case TB_CMP_SLT: case TB_CMP_SLE: case TB_CMP_ULT: case TB_CMP_ULE:
+        case TB_CMP_FLT: case TB_CMP_FLE:
+        break;
+
+        default: return BOTTOM;
+    }
+
+    // it's only constant once all the operands are
+    bool has_top = false;
+    TB_FOR_INPUT_IN_NODE(it, f, n) {
+        Lattice v = ctx->values[it.r];
+        if (v.kind == LATTICE_BOTTOM) return BOTTOM;
+        has_top |= (v.kind == LATTICE_TOP);
+    }
+
+    if (has_top) return TOP;
+
+    switch (n->type) {
+        case TB_NOT: case TB_NEG:
+        case TB_ZERO_EXT: case TB_SIGN_EXT: case TB_TRUNCATE: {
+            int bits = int_bits(n->dt);
+            int src_bits = int_bits(f->nodes[n->unary.src].dt);
+            if (bits == 0 || src_bits == 0) return BOTTOM;
+
+            uint64_t a = ctx->values[n->unary.src].bits;
+            switch (n->type) {
+                case TB_NOT:      a = ~a; break;
+                case TB_NEG:      a = -a; break;
+                case TB_SIGN_EXT: a = sext(a, src_bits); break;
+                default: break;
+            }
+
+            return lattice_const(a & int_mask(bits));
+        }
+
+        case TB_FADD: case TB_FSUB: case TB_FMUL: case TB_FDIV: {
+            if (n->dt.type != TB_FLOAT) return BOTTOM;
+
+            return fold_float(n->type, n->dt, ctx->values[n->f_arith.a].bits, ctx->values[n->f_arith.b].bits);
+        }
+
+        case TB_CMP_EQ: case TB_CMP_NE:
+        case TB_CMP_SLT: case TB_CMP_SLE: case TB_CMP_ULT: case TB_CMP_ULE:
+        case TB_CMP_FLT: case TB_CMP_FLE: {
+            uint64_t a = ctx->values[n->cmp.a].bits;
+            uint64_t b = ctx->values[n->cmp.b].bits;
+
+            if (n->cmp.dt.type == TB_FLOAT) {
+                return fold_float(n->type, n->cmp.dt, a, b);
+            }
+
+            int bits = int_bits(n->cmp.dt);
+            if (bits == 0 || n->type == TB_CMP_FLT || n->type == TB_CMP_FLE) return BOTTOM;
+
+            return lattice_const(fold_int_cmp(n->type, bits, a, b));
+        }
+
+        default: {
+            int bits = int_bits(n->dt);
+            if (bits == 0) return BOTTOM;
+
+            uint64_t result;
+            uint64_t a = ctx->values[n->i_arith.a].bits;
+            uint64_t b = ctx->values[n->i_arith.b].bits;
+            if (!fold_int_binop(n->type, n->i_arith.arith_behavior, bits, a, b, &result)) return BOTTOM;
+
+            return lattice_const(result);
+        }
+    }
+}
+
+static void set_value(SCCPCtx* ctx, TB_Reg r, Lattice v) {
+    Lattice old = ctx->values[r];
+
+    // we only ever move down, two different constants just means BOTTOM
+    if (v.kind == LATTICE_TOP || old.kind == LATTICE_BOTTOM) return;
+    if (old.kind == LATTICE_CONST) {
+        if (v.kind == LATTICE_CONST && v.bits == old.bits) return;
+        v = BOTTOM;
+    }
+
+    ctx->values[r] = v;
+    ctx->ssa_worklist[ctx->ssa_count++] = r;
+}
+
+static void visit_edge(SCCPCtx* ctx, TB_Label from, TB_Label to) {
+    TB_Function* f = ctx->f;
+    if (!ctx->executable[to]) {
+        ctx->executable[to] = true;
+        ctx->block_worklist[ctx->block_count++] = to;
+        return;
+    }
+
+    // the block's already live, the new edge can only change its phis
+    TB_FOR_NODE(r, f, to) {
+        if (tb_node_is_phi_node(f, r)) set_value(ctx, r, eval_node(ctx, r));
+    }
+}
+
+static void visit_terminator(SCCPCtx* ctx, TB_Label bb) {
+    TB_Function* f = ctx->f;
+    TB_Node* end = &f->nodes[f->bbs[bb].end];
+
+    switch (end->type) {
+        case TB_GOTO:
+        visit_edge(ctx, bb, end->goto_.label);
+        break;
+
+        case TB_IF:
+        if (is_edge_feasible(ctx, bb, end->if_.if_true)) visit_edge(ctx, bb, end->if_.if_true);
+        if (is_edge_feasible(ctx, bb, end->if_.if_false)) visit_edge(ctx, bb, end->if_.if_false);
+        break;
+
+        case TB_SWITCH: {
+            size_t entry_count = (end->switch_.entries_end - end->switch_.entries_start) / 2;
+            TB_SwitchEntry* entries = (TB_SwitchEntry*) &f->vla.data[end->switch_.entries_start];
+
+            FOREACH_N(i, 0, entry_count) {
+                if (is_edge_feasible(ctx, bb, entries[i].value)) visit_edge(ctx, bb, entries[i].value);
+            }
+
+            if (is_edge_feasible(ctx, bb, end->switch_.default_label)) visit_edge(ctx, bb, end->switch_.default_label);
+            break;
+        }
+
+        default: break;
+    }
+}
+
+static void propagate(SCCPCtx* ctx) {
+    TB_Function* f = ctx->f;
+
+    while (ctx->block_count > 0 || ctx->ssa_count > 0) {
+        if (ctx->block_count > 0) {
+            TB_Label bb = ctx->block_worklist[--ctx->block_count];
+
+            TB_FOR_NODE(r, f, bb) {
+                if (r == f->bbs[bb].end) visit_terminator(ctx, bb);
+                else set_value(ctx, r, eval_node(ctx, r));
+            }
+            continue;
+        }
+
+        TB_Reg r = ctx->ssa_worklist[--ctx->ssa_count];
+        for (TB_Use* u = f->uses[r].first; u != NULL; u = u->next) {
+            TB_Label bb = ctx->block_of[u->user];
+
+            // dead blocks get visited properly once they're reachable
+            if (bb < 0 || !ctx->executable[bb]) continue;
+
+            if (u->user == f->bbs[bb].end) visit_terminator(ctx, bb);
+            else set_value(ctx, u->user, eval_node(ctx, u->user));
+        }
+    }
+}
+
+// anything still TOP in a live block was never defined on any path (phi
+// cycles with nothing coming in), if a branch hangs on one of those we can't
+// pick a side so it's treated as unknown and we go again.
+static bool resolve_undefined_branches(SCCPCtx* ctx) {
+    TB_Function* f = ctx->f;
+
+    bool progress = false;
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        if (!ctx->executable[bb] || f->bbs[bb].end == 0) continue;
+
+        TB_Node* end = &f->nodes[f->bbs[bb].end];
+        TB_Reg key = TB_NULL_REG;
+        if (end->type == TB_IF) key = end->if_.cond;
+        else if (end->type == TB_SWITCH) key = end->switch_.key;
+
+        if (key != TB_NULL_REG && ctx->values[key].kind == LATTICE_TOP) {
+            ctx->values[key] = BOTTOM;
+            ctx->ssa_worklist[ctx->ssa_count++] = key;
+            progress = true;
+        }
+    }
+
+    return progress;
+}
+
+static void rewrite_as_const(TB_Function* f, TB_Reg r, uint64_t bits) {
+    TB_Node* n = &f->nodes[r];
+    TB_DataType dt = n->dt;
+
+    if (dt.type == TB_FLOAT && dt.data == TB_FLT_32) {
+        uint32_t lo = bits;
+        n->type = TB_FLOAT32_CONST;
+        memcpy(&n->flt32.value, &lo, sizeof(float));
+    } else if (dt.type == TB_FLOAT) {
+        n->type = TB_FLOAT64_CONST;
+        memcpy(&n->flt64.value, &bits, sizeof(double));
+    } else {
+        n->type = TB_INTEGER_CONST;
+        n->integer.num_words = 1;
+        n->integer.single_word = bits;
+    }
+}
+
+// drops the phi inputs coming in from edges we proved are never taken
+static bool prune_phi(SCCPCtx* ctx, TB_Reg r) {
+    TB_Function* f = ctx->f;
+    TB_Node* n = &f->nodes[r];
+    TB_Label bb = ctx->block_of[r];
+
+    int count = tb_node_get_phi_width(f, r);
+    TB_PhiInput* inputs = tb_node_get_phi_inputs(f, r);
+
+    int kept = 0;
+    FOREACH_N(i, 0, count) {
+        if (is_edge_feasible(ctx, inputs[i].label, bb)) inputs[kept++] = inputs[i];
+    }
+
+    if (kept == count || kept == 0) return false;
+
+    if (n->type == TB_PHIN) {
+        n->phi.count = kept;
+    } else {
+        TB_PhiInput in = inputs[0];
+        n->type = TB_PHI1;
+        n->phi1.inputs[0] = in;
+    }
+    return true;
+}
+
+static bool sccp(TB_Function* f) {
+    TB_TemporaryStorage* tls = tb_tls_allocate();
+    tb_function_build_uses(f);
+
+    SCCPCtx ctx = {
+        .f = f,
+        .values = tb_tls_push(tls, f->node_count * sizeof(Lattice)),
+        .block_of = tb_tls_push(tls, f->node_count * sizeof(TB_Label)),
+        .executable = tb_tls_push(tls, f->bb_count * sizeof(bool)),
+        .block_worklist = tb_tls_push(tls, f->bb_count * sizeof(TB_Label)),
+        .ssa_worklist = tb_tls_push(tls, 2 * f->node_count * sizeof(TB_Reg)),
+    };
+    memset(ctx.values, 0, f->node_count * sizeof(Lattice));
+    memset(ctx.executable, 0, f->bb_count * sizeof(bool));
+
+    FOREACH_N(r, 0, f->node_count) ctx.block_of[r] = -1;
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(r, f, bb) ctx.block_of[r] = bb;
+    }
+
+    ctx.executable[0] = true;
+    ctx.block_worklist[ctx.block_count++] = 0;
+    do {
+        propagate(&ctx);
+    } while (resolve_undefined_branches(&ctx));
+
+    // we're about to rewrite operands by hand, it's dropped here rather than
+    // marking the whole pass so the analysis above gets to reuse it.
+    tb_function_free_uses(f);
+
+    int changes = 0;
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        if (!ctx.executable[bb]) {
+            if (f->bbs[bb].start != 0) {
+                OPTIMIZER_LOG(f->bbs[bb].start, "Removed unreachable block L%d", bb);
+
+                // kill the nodes too, otherwise they'd still count as users
+                // once the def-use index gets rebuilt.
+                TB_FOR_NODE(r, f, bb) tb_murder_reg(f, r);
+                f->bbs[bb] = (TB_BasicBlock){ 0 };
+                changes++;
+            }
+            continue;
+        }
+
+        TB_Reg end = f->bbs[bb].end;
+        TB_FOR_NODE(r, f, bb) {
+            TB_Node* n = &f->nodes[r];
+
+            if (r == end) {
+                Lattice key = BOTTOM;
+                if (n->type == TB_IF) key = branch_key(&ctx, n->if_.cond);
+                else if (n->type == TB_SWITCH) key = branch_key(&ctx, n->switch_.key);
+
+                if (key.kind == LATTICE_CONST) {
+                    // (if K A B) => (goto X) where X is whichever side K picks
+                    TB_Label target = n->type == TB_IF ? (key.bits ? n->if_.if_true : n->if_.if_false) : switch_target(f, n, key.bits);
+                    OPTIMIZER_LOG(r, "Branch always goes to L%d", target);
+
+                    n->type = TB_GOTO;
+                    n->dt = TB_TYPE_VOID;
+                    n->goto_.label = target;
+                    changes++;
+                }
+                continue;
+            }
+
+            if (tb_node_is_phi_node(f, r)) {
+                changes += prune_phi(&ctx, r);
+            }
+
+            Lattice v = ctx.values[r];
+            if (v.kind == LATTICE_CONST && n->type != TB_INTEGER_CONST && n->type != TB_FLOAT32_CONST && n->type != TB_FLOAT64_CONST) {
+                OPTIMIZER_LOG(r, "Proven constant 0x%llx", (unsigned long long) v.bits);
+                rewrite_as_const(f, r, v.bits);
+                changes++;
+            }
+        }
+    }
+
+    return changes;
+}
+
+TB_API TB_Pass tb_opt_sccp(void) {
+    return (TB_Pass){
+        .mode = TB_FUNCTION_PASS,
+        .name = "SCCP",
+        .func_run = sccp,
+    };
+}
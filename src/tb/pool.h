@@ -1,79 +1,89 @@
 #include "builtins.h"
 
+// Slab pool: objects are bump allocated out of a chain of slabs which double
+// in size as the pool grows, nothing ever moves so the pointers are stable.
+// Nothing is freed individually (killed symbols are just tombstoned) so every
+// slot below a slab's count is live and iterating is just walking arrays.
+//
+// The pool handle points right after the PoolHeader (similar to DynArray) and
+// is typed as T* so the macros can figure out the element size.
 enum {
-    MAX_SLOTS = 508
+    POOL_FIRST_SLAB = 64,
+    POOL_MAX_SLAB   = 65536,
 };
 
+typedef struct PoolSlab {
+    struct PoolSlab* next;
+    size_t count, capacity;
+
+    alignas(16) char data[];
+} PoolSlab;
+
 typedef struct PoolHeader {
-    // population count
-    uint64_t used;
-    // each bit represents an allocated
-    uint64_t allocated[MAX_SLOTS];
-    struct PoolHeader* next;
-
-    // in 32bit builds, this would be padded so
-    // regardless the header is 4096 bytes
-    char data[];
+    PoolSlab* first;
+    PoolSlab* last;
+
+    // total live objects
+    size_t count;
 } PoolHeader;
 
-inline static void* pool__alloc_slot(void** ptr, size_t type_size) {
-    // find the slot which isn't just filled
-    PoolHeader* hdr = *ptr ? ((PoolHeader*) *ptr) - 1 : NULL;
-    while (hdr != NULL && hdr->used >= MAX_SLOTS) hdr = hdr->next;
-
-    // if it's null allocate it
-    if (hdr == NULL) {
-        hdr = tb_platform_valloc(sizeof(PoolHeader) + (MAX_SLOTS * type_size));
-        hdr->allocated[0] = 1;
-        hdr->used = 1;
-
-        // if it's NULL then it's the first element and thus
-        // we wanna actually store it back to the pointer
-        if (*ptr == NULL) {
-            *ptr = hdr->data;
-        }
-
-        return hdr->data;
+inline static PoolSlab* pool__new_slab(size_t capacity, size_t type_size) {
+    PoolSlab* s = tb_platform_heap_alloc(sizeof(PoolSlab) + (capacity * type_size));
+    if (s == NULL) {
+        fprintf(stderr, "pool: Out of memory!\n");
+        abort();
     }
 
-    for (size_t i = 0; i < MAX_SLOTS; i++) {
-        if (hdr->allocated[i] == UINT64_MAX) continue;
+    s->next = NULL;
+    s->count = 0;
+    s->capacity = capacity;
+    return s;
+}
 
-        // find some unallocated slot
-        int index = hdr->allocated[i] ? tb_ffs64(~hdr->allocated[i]) - 1 : 0;
+inline static void* pool__alloc_slot(void** ptr, size_t type_size) {
+    PoolHeader* hdr;
+    if (*ptr == NULL) {
+        hdr = tb_platform_heap_alloc(sizeof(PoolHeader));
+        hdr->first = hdr->last = pool__new_slab(POOL_FIRST_SLAB, type_size);
+        hdr->count = 0;
+
+        *ptr = hdr + 1;
+    } else {
+        hdr = ((PoolHeader*) *ptr) - 1;
+    }
 
-        hdr->allocated[i] |= (1ull << index);
-        hdr->used += 1;
+    PoolSlab* s = hdr->last;
+    if (s->count == s->capacity) {
+        size_t capacity = s->capacity * 2;
+        if (capacity > POOL_MAX_SLAB) capacity = POOL_MAX_SLAB;
 
-        return &hdr->data[((i * 64) + index) * type_size];
+        PoolSlab* new_s = pool__new_slab(capacity, type_size);
+        s->next = new_s;
+        hdr->last = s = new_s;
     }
 
-    assert(0 && "TODO: implement the rest of the pool allocator");
-    return NULL;
+    hdr->count += 1;
+    return &s->data[(s->count++) * type_size];
 }
 
-inline static void pool__destroy(void** ptr, size_t type_size) {
+inline static void pool__destroy(void** ptr) {
     if (*ptr == NULL) return;
 
     PoolHeader* hdr = ((PoolHeader*) *ptr) - 1;
-    while (hdr != NULL) {
-        PoolHeader* next = hdr->next;
-        tb_platform_vfree(hdr, sizeof(PoolHeader) + (MAX_SLOTS * type_size));
-        hdr = next;
+    PoolSlab* s = hdr->first;
+    while (s != NULL) {
+        PoolSlab* next = s->next;
+        tb_platform_heap_free(s);
+        s = next;
     }
+
+    tb_platform_heap_free(hdr);
     *ptr = NULL;
 }
 
+// number of live objects
 inline static size_t pool_popcount(void* ptr) {
-    if (ptr == NULL) {
-        return 0;
-    }
-
-    size_t c = 0;
-    for (PoolHeader* hdr = ((PoolHeader*) ptr) - 1; hdr != NULL; hdr = hdr->next) {
-        c += tb_popcount64(hdr->used);
-    }
-    return c;
+    return ptr ? (((PoolHeader*) ptr) - 1)->count : 0;
 }
 
 #define Pool(T) T*
@@ -81,12 +91,8 @@ inline static size_t pool_popcount(void* ptr) {
 #define pool_put(p) \
 pool__alloc_slot((void**) &(p), sizeof(*(p)))
 
-#define pool_destroy(p) pool__destroy((void**) &(p), sizeof(*(p)))
+#define pool_destroy(p) pool__destroy((void**) &(p))
 
 #define pool_for(T, it, p) \
-for (PoolHeader *p_ = (PoolHeader*)(p), *hdr_ = p_ ? (p_ - 1) : NULL; hdr_; hdr_ = hdr_->next) \
-for (size_t a_ = 0; a_ < MAX_SLOTS; a_++) \
-if (hdr_->allocated[a_] != 0) \
-for (size_t b_ = 0; b_ < 64; b_++) \
-if (hdr_->allocated[a_] & (1ull << b_)) \
-for (T *it = (T*) &hdr_->data[((a_ * 64) + b_) * sizeof(T)]; it; it = NULL)
+for (PoolSlab* s_ = (p) ? (((PoolHeader*) (p)) - 1)->first : NULL; s_; s_ = s_->next) \
+for (T *it = (T*) s_->data, *end_ = it + s_->count; it != end_; it++)
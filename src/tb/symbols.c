@@ -7,27 +7,118 @@ TB_Symbol* tb_symbol_alloc(TB_Module* m, enum TB_SymbolTag tag, const char* name
     memset(s, 0, size);
 
     s->tag = tag;
-    s->name = tb_platform_string_alloc(name);
+    s->name = tb__intern(m, name);
     s->module = m;
+    tb_symbol_append(m, s);
+    return s;
+}
+
+TB_API void tb_module_set_symbol_order(TB_Module* m, uint32_t key) {
+    int tid = tb__get_module_tid(m);
+    m->thread_info[tid].order_key = key;
+    m->thread_info[tid].order_seq = 0;
+}
+
+void tb_symbol_append(TB_Module* m, TB_Symbol* s) {
+    int tid = tb__get_module_tid(m);
+    struct TB_ThreadInfo* info = &m->thread_info[tid];
+
+    // keyed symbols sort after the unkeyed ones, those just go by when they
+    // were made across the whole module.
+    if (info->order_key != 0) {
+        s->order = ((uint64_t) info->order_key << 32) | info->order_seq++;
+    } else {
+        s->order = tb_atomic_size_add(&m->symbol_seq, 1);
+    }
+
+    // the lock is basically never contended, it's only so a merge on some
+    // other thread can't steal the shard out from under us.
+    tb__spin_lock(&info->symbol_lock);
+    TB_SymbolShard* shard = &info->symbols[s->tag];
+
     s->next = NULL;
+    if (shard->last != NULL) {
+        shard->last->next = s;
+    } else {
+        shard->first = s;
+    }
 
-    tb_atomic_size_add(&m->symbol_count[tag], 1);
-    tb_atomic_ptr_cmpxchg((void**) &m->first_symbol_of_tag[tag], NULL, s);
+    shard->last = s;
+    shard->count += 1;
+    tb__spin_unlock(&info->symbol_lock);
+}
 
-    // atomic append (linked lists are kinda based ngl)
-    TB_Symbol* last = tb_atomic_ptr_exchange((void**) &m->last_symbol_of_tag[tag], s);
-    if (last) last->next = s;
-    return s;
+static int compare_symbol_order(const void* a, const void* b) {
+    uint64_t x = (*(TB_Symbol**) a)->order;
+    uint64_t y = (*(TB_Symbol**) b)->order;
+    return (x > y) - (x < y);
 }
 
-void tb_symbol_append(TB_Module* m, TB_Symbol* s) {
-    enum TB_SymbolTag tag = s->tag;
-    tb_atomic_size_add(&m->symbol_count[tag], 1);
-    tb_atomic_ptr_cmpxchg((void**) &m->first_symbol_of_tag[tag], NULL, s);
+void tb__merge_symbols(TB_Module* m) {
+    // merges can come from multiple threads (iterating, compiling...) so they
+    // take turns, it's a tiny critical section.
+    tb__spin_lock(&m->symbol_merge_lock);
+
+    // steal everything that's pending, the order we pick it up in doesn't
+    // matter since it all gets sorted anyways.
+    TB_SymbolShard pending[TB_SYMBOL_MAX] = { 0 };
+    int max_threads = tb_atomic_int_load(&m->max_threads);
+    FOREACH_N(i, 0, max_threads) {
+        tb__spin_lock(&m->thread_info[i].symbol_lock);
+        FOREACH_N(tag, 0, TB_SYMBOL_MAX) {
+            TB_SymbolShard* shard = &m->thread_info[i].symbols[tag];
+            if (shard->first == NULL) continue;
+
+            if (pending[tag].last != NULL) {
+                pending[tag].last->next = shard->first;
+            } else {
+                pending[tag].first = shard->first;
+            }
+
+            pending[tag].last = shard->last;
+            pending[tag].count += shard->count;
+            *shard = (TB_SymbolShard){ 0 };
+        }
+        tb__spin_unlock(&m->thread_info[i].symbol_lock);
+    }
+
+    FOREACH_N(tag, 0, TB_SYMBOL_MAX) {
+        size_t count = pending[tag].count;
+        if (count == 0) continue;
+
+        TB_Symbol** syms = tb_platform_heap_alloc(count * sizeof(TB_Symbol*));
+        size_t j = 0;
+        for (TB_Symbol* s = pending[tag].first; s != NULL; s = s->next) {
+            syms[j++] = s;
+        }
+        assert(j == count);
+        qsort(syms, count, sizeof(TB_Symbol*), compare_symbol_order);
+
+        // the module's list is already sorted so this is just a merge, that
+        // way it doesn't matter when the merges happened. every symbol gets
+        // its next filled in before it's linked so anyone walking the list
+        // either sees it or doesn't.
+        TB_Symbol* prev = NULL;
+        TB_Symbol* curr = m->first_symbol_of_tag[tag];
+        FOREACH_N(k, 0, count) {
+            TB_Symbol* s = syms[k];
+            while (curr != NULL && curr->order < s->order) {
+                prev = curr, curr = curr->next;
+            }
+
+            s->next = curr;
+            if (prev != NULL) prev->next = s;
+            else m->first_symbol_of_tag[tag] = s;
+            prev = s;
+
+            if (curr == NULL) m->last_symbol_of_tag[tag] = s;
+        }
+
+        m->symbol_count[tag] += count;
+        tb_platform_heap_free(syms);
+    }
 
-    // atomic append (linked lists are kinda based ngl)
-    TB_Symbol* last = tb_atomic_ptr_exchange((void**) &m->last_symbol_of_tag[tag], s);
-    if (last) last->next = s;
+    tb__spin_unlock(&m->symbol_merge_lock);
 }
 
 TB_API TB_Function* tb_symbol_as_function(TB_Symbol* s) {
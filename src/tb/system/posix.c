@@ -1,5 +1,6 @@
 #ifndef _WIN32
 #include "../tb_internal.h"
+#include <sched.h>
 
 void* tb_platform_valloc(size_t size) {
     return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
@@ -13,6 +14,15 @@ void tb_platform_vfree(void* ptr, size_t size) {
     munmap(ptr, size);
 }
 
+void* tb_platform_vreserve(size_t size) {
+    void* ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return ptr != MAP_FAILED ? ptr : NULL;
+}
+
+bool tb_platform_vcommit(void* ptr, size_t size) {
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
 bool tb_platform_vprotect(void* ptr, size_t size, TB_MemProtect prot) {
     uint32_t protect;
     switch (prot) {
@@ -25,103 +35,105 @@ bool tb_platform_vprotect(void* ptr, size_t size, TB_MemProtect prot) {
     return mprotect(ptr, size, protect) == 0;
 }
 
-void* tb_platform_heap_alloc(size_t size) {
-    return malloc(size);
-}
-
-void* tb_platform_heap_realloc(void* ptr, size_t size) {
-    return realloc(ptr, size);
-}
-
-void tb_platform_heap_free(void* ptr) {
-    free(ptr);
+////////////////////////////////
+// Threads
+////////////////////////////////
+struct TB_Thread {
+    pthread_t handle;
+    TB_ThreadFunc* func;
+    void* arg;
+};
+
+static void* thread_entry(void* arg) {
+    TB_Thread* t = arg;
+    t->func(t->arg);
+    return NULL;
 }
 
-static char* string_buffer;
-static tb_atomic_size_t string_head;
-
-char* tb_platform_string_alloc(const char* str) {
-    if (!string_buffer) { string_buffer = tb_platform_valloc(64 << 20); }
-
-    size_t len = strlen(str) + 1;
-    size_t pos = tb_atomic_size_add(&string_head, len);
+TB_Thread* tb_platform_thread_create(TB_ThreadFunc* func, void* arg) {
+    TB_Thread* t = tb_platform_heap_alloc(sizeof(TB_Thread));
+    t->func = func;
+    t->arg  = arg;
 
-    char* new_str = &string_buffer[pos];
-    strcpy(new_str, str);
+    if (pthread_create(&t->handle, NULL, thread_entry, t) != 0) {
+        tb_platform_heap_free(t);
+        return NULL;
+    }
 
-    return new_str;
+    return t;
 }
 
-void tb_platform_string_free() { tb_platform_vfree(string_buffer, 64 << 20); }
-
-////////////////////////////////
-// Persistent arena allocator
-////////////////////////////////
-#define ARENA_SEGMENT_SIZE (4 * 1024 * 1024)
-
-// It's a linked list :)
-typedef struct Segment {
-    struct Segment* next;
-    size_t          used;
-    unsigned char   data[];
-} Segment;
+void tb_platform_thread_join(TB_Thread* t) {
+    pthread_join(t->handle, NULL);
+    tb_platform_heap_free(t);
+}
 
-static Segment* arena_base;
-static Segment* arena_top;
+void tb_platform_thread_yield(void) {
+    sched_yield();
+}
 
-// weird bootleg mutex because i dont get threads.h on windows :(
-static tb_atomic_int arena_lock = 0;
+// unnamed POSIX semaphores aren't a thing on macOS so it's just a counter
+// behind a mutex + condvar.
+struct TB_Semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+};
+
+TB_Semaphore* tb_platform_sema_create(int initial) {
+    TB_Semaphore* s = tb_platform_heap_alloc(sizeof(TB_Semaphore));
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->count = initial;
+    return s;
+}
 
-void tb_platform_arena_init(void) {
-    Segment* s = (Segment*)mmap(NULL, ARENA_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (!s) abort();
+void tb_platform_sema_destroy(TB_Semaphore* s) {
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    tb_platform_heap_free(s);
+}
 
-    arena_base = arena_top = s;
+void tb_platform_sema_post(TB_Semaphore* s, int count) {
+    pthread_mutex_lock(&s->lock);
+    s->count += count;
+    if (count == 1) {
+        pthread_cond_signal(&s->cond);
+    } else {
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
 }
 
-void* tb_platform_arena_alloc(size_t size) {
-    // align to max_align
-    size_t align_mask = _Alignof(max_align_t) - 1;
-    size = (size + align_mask) & ~align_mask;
+void tb_platform_sema_wait(TB_Semaphore* s) {
+    pthread_mutex_lock(&s->lock);
+    while (s->count == 0) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    s->count -= 1;
+    pthread_mutex_unlock(&s->lock);
+}
 
-    // If this ever happens... literally how...
-    assert(size < ARENA_SEGMENT_SIZE);
+int tb_platform_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
 
-    // lock
-    int expected = 0;
-    while (!__atomic_compare_exchange_n(&arena_lock, &expected, 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) { }
+static pthread_key_t thread_exit_key;
+static pthread_once_t thread_exit_once = PTHREAD_ONCE_INIT;
 
-    void* ptr;
-    if (arena_top->used + size - sizeof(Segment) < ARENA_SEGMENT_SIZE) {
-        ptr = &arena_top->data[arena_top->used];
-        arena_top->used += size;
-    } else {
-        // Add new page
-        Segment* s = (Segment*)mmap(NULL, ARENA_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-        if (!s) {
-            tb_panic("tb_platform_arena_alloc: Out of memory!");
-        }
-
-        s->next = NULL;
-        s->used = size;
-        ptr = s->data;
-
-        // Insert to top of nodes
-        arena_top->next = s;
-        arena_top       = s;
-    }
+static void thread_exit_callback(void* arg) {
+    tb_free_thread_resources();
+}
 
-    // unlock
-    __atomic_exchange_n(&arena_lock, 0, __ATOMIC_SEQ_CST);
-    return ptr;
+static void thread_exit_init(void) {
+    pthread_key_create(&thread_exit_key, thread_exit_callback);
 }
 
-void tb_platform_arena_free(void) {
-    Segment* c = arena_base;
-    while (c) {
-        Segment* next = c->next;
-        munmap(c, ARENA_SEGMENT_SIZE);
-        c = next;
-    }
+void tb_platform_free_at_thread_exit(void) {
+    pthread_once(&thread_exit_once, thread_exit_init);
+
+    // destructors only run on non-NULL values
+    pthread_setspecific(thread_exit_key, (void*) 1);
 }
 #endif
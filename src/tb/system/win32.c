@@ -15,6 +15,14 @@ void tb_platform_vfree(void* ptr, size_t size) {
     VirtualFree(ptr, 0, MEM_RELEASE);
 }
 
+void* tb_platform_vreserve(size_t size) {
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool tb_platform_vcommit(void* ptr, size_t size) {
+    return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
 bool tb_platform_vprotect(void* ptr, size_t size, TB_MemProtect prot) {
     DWORD protect;
     switch (prot) {
@@ -28,111 +36,86 @@ bool tb_platform_vprotect(void* ptr, size_t size, TB_MemProtect prot) {
     return VirtualProtect(ptr, size, protect, &old_protect);
 }
 
-static char*  string_buffer;
-static size_t string_head;
+////////////////////////////////
+// Threads
+////////////////////////////////
+struct TB_Thread {
+    HANDLE handle;
+    TB_ThreadFunc* func;
+    void* arg;
+};
+
+static DWORD WINAPI thread_entry(LPVOID arg) {
+    TB_Thread* t = arg;
+    t->func(t->arg);
+    return 0;
+}
+
+TB_Thread* tb_platform_thread_create(TB_ThreadFunc* func, void* arg) {
+    TB_Thread* t = tb_platform_heap_alloc(sizeof(TB_Thread));
+    t->func = func;
+    t->arg  = arg;
 
-char* tb_platform_string_alloc(const char* str) {
-    if (!string_buffer) {
-        string_buffer = tb_platform_valloc(32 << 20);
+    t->handle = CreateThread(NULL, 0, thread_entry, t, 0, NULL);
+    if (t->handle == NULL) {
+        tb_platform_heap_free(t);
+        return NULL;
     }
 
-    size_t len = strlen(str);
-    size_t pos = tb_atomic_size_add(&string_head, len + 1);
+    return t;
+}
 
-    char* new_str = &string_buffer[pos];
-    memcpy(new_str, str, len);
-    new_str[len] = '\0';
-    return new_str;
+void tb_platform_thread_join(TB_Thread* t) {
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    tb_platform_heap_free(t);
 }
 
-void tb_platform_string_free() {
-    tb_platform_vfree(string_buffer, 32 << 20);
-    string_buffer = NULL;
+void tb_platform_thread_yield(void) {
+    SwitchToThread();
 }
 
-////////////////////////////////
-// Persistent arena allocator
-////////////////////////////////
-#define ARENA_SEGMENT_SIZE (4 * 1024 * 1024)
-
-// It's a linked list :)
-typedef struct Segment {
-    struct Segment* next;
-    size_t used;
-    unsigned char data[];
-} Segment;
-
-typedef struct Arena {
-    Segment *base, *top;
-} Arena;
-
-static Arena tb__global_arena;
-static CRITICAL_SECTION tb__global_arena_lock;
-
-void tb__arena_init(Arena* a) {
-    Segment* s = (Segment*) tb_platform_valloc(ARENA_SEGMENT_SIZE);
-    if (!s) abort();
-
-    a->base = a->top = s;
-}
-
-void* tb__arena_alloc(Arena* a, size_t size) {
-    // align to max_align
-    size_t align_mask = _Alignof(intmax_t) - 1;
-    size = (size + align_mask) & ~align_mask;
-
-    // If this ever happens... literally how...
-    assert(size < ARENA_SEGMENT_SIZE);
-
-    void* ptr;
-    if (a->top->used + size < ARENA_SEGMENT_SIZE - sizeof(Segment)) {
-        ptr = &a->top->data[a->top->used];
-        a->top->used += size;
-    } else {
-        // Add new page
-        Segment* s = (Segment*) tb_platform_valloc(ARENA_SEGMENT_SIZE);
-        if (!s) {
-            fprintf(stderr, "Out of memory!\n");
-            abort();
-        }
-
-        s->next = NULL;
-        s->used = size;
-        ptr = s->data;
-
-        // Insert to top of nodes
-        a->top->next = s;
-        a->top = s;
-    }
+// the handle is the whole semaphore, we just don't want windows.h in the header
+TB_Semaphore* tb_platform_sema_create(int initial) {
+    return (TB_Semaphore*) CreateSemaphoreA(NULL, initial, LONG_MAX, NULL);
+}
 
-    // unlock
-    return ptr;
+void tb_platform_sema_destroy(TB_Semaphore* s) {
+    CloseHandle((HANDLE) s);
 }
 
-void tb__arena_free(Arena* a) {
-    Segment* c = a->base;
-    while (c) {
-        Segment* next = c->next;
-        tb_platform_vfree(c, ARENA_SEGMENT_SIZE);
-        c = next;
-    }
+void tb_platform_sema_post(TB_Semaphore* s, int count) {
+    ReleaseSemaphore((HANDLE) s, count, NULL);
+}
 
-    a->base = a->top = NULL;
+void tb_platform_sema_wait(TB_Semaphore* s) {
+    WaitForSingleObject((HANDLE) s, INFINITE);
 }
 
-void tb_platform_arena_init(void) {
-    tb__arena_init(&tb__global_arena);
-    InitializeCriticalSection(&tb__global_arena_lock);
+int tb_platform_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
 }
 
-void* tb_platform_arena_alloc(size_t size) {
-    EnterCriticalSection(&tb__global_arena_lock);
-    void* r = tb__arena_alloc(&tb__global_arena, size);
-    LeaveCriticalSection(&tb__global_arena_lock);
-    return r;
+static DWORD thread_exit_fls = FLS_OUT_OF_INDEXES;
+static INIT_ONCE thread_exit_once = INIT_ONCE_STATIC_INIT;
+
+static void NTAPI thread_exit_callback(void* arg) {
+    // FLS callbacks also fire on FlsFree and for every fiber, only the
+    // ones we've marked actually have anything to clean up.
+    if (arg != NULL) tb_free_thread_resources();
+}
+
+static BOOL CALLBACK thread_exit_init(PINIT_ONCE once, void* param, void** ctx) {
+    thread_exit_fls = FlsAlloc(thread_exit_callback);
+    return TRUE;
 }
 
-void tb_platform_arena_free(void) {
-    tb__arena_free(&tb__global_arena);
+void tb_platform_free_at_thread_exit(void) {
+    InitOnceExecuteOnce(&thread_exit_once, thread_exit_init, NULL, NULL);
+    if (thread_exit_fls != FLS_OUT_OF_INDEXES) {
+        FlsSetValue(thread_exit_fls, (void*) 1);
+    }
 }
 #endif
@@ -4,9 +4,13 @@
 
 enum { BATCH_SIZE = 8192 };
 
-static thread_local uint8_t* tb_thread_storage;
+static thread_local TB_TemporaryStorage tb_thread_storage;
 static thread_local int tid;
-static tb_atomic_int total_tid;
+
+// thread slots are handed out to the threads touching TB and given back in
+// tb_free_thread_resources (or automatically once the thread dies), that way
+// the build servers spawning short-lived workers don't run out of them.
+static tb_atomic_int thread_slots[TB_MAX_THREADS];
 
 ICodeGen* tb__find_code_generator(TB_Module* m) {
     switch (m->target_arch) {
@@ -26,23 +30,112 @@ int tb__get_local_tid(void) {
     // the value it spits out is zero-based, but
     // the TIDs consider zero as a NULL space.
     if (tid == 0) {
-        int new_id = tb_atomic_int_add(&total_tid, 1);
-        tid = new_id + 1;
+        // grab the lowest free slot, keeping the ids dense means the
+        // exporters have less empty slots to walk over
+        FOREACH_N(i, 0, TB_MAX_THREADS) {
+            if (tb_atomic_int_load(&thread_slots[i]) == 0 && tb_atomic_int_cmpxchg(&thread_slots[i], 0, 1)) {
+                tid = i + 1;
+                break;
+            }
+        }
+
+        if (tid == 0) {
+            tb_panic("tb__get_local_tid: more than %d threads are using TB at once!\n", TB_MAX_THREADS);
+        }
+
+        tb_platform_free_at_thread_exit();
     }
 
     return tid - 1;
 }
+
+int tb__get_module_tid(TB_Module* m) {
+    int id = tb__get_local_tid();
+
+    // the module only keeps track of the highest slot that's ever touched it,
+    // the per-thread data stays around after the thread is gone and whoever
+    // picks up the slot next just keeps appending to it.
+    for (;;) {
+        int old = tb_atomic_int_load(&m->max_threads);
+        if (old > id || tb_atomic_int_cmpxchg(&m->max_threads, old, id + 1)) break;
+    }
+
+    return id;
+}
+
+static void release_local_tid(void) {
+    if (tid != 0) {
+        tb_atomic_int_store(&thread_slots[tid - 1], 0);
+        tid = 0;
+    }
+}
 
+static TB_CodeRegion* new_code_region(size_t min_size) {
+    // big functions just get a chunk of their own
+    size_t reserved = CODE_REGION_CHUNK_SIZE;
+    while (reserved < sizeof(TB_CodeRegion) + min_size) reserved *= 2;
+
+    TB_CodeRegion* region = tb_platform_vreserve(reserved);
+    if (region == NULL) tb_panic("could not reserve code region!");
+
+    size_t committed = align_up(sizeof(TB_CodeRegion) + min_size, CODE_REGION_COMMIT_SIZE);
+    if (!tb_platform_vcommit(region, committed)) tb_panic("could not commit code region!");
+
+    region->prev = NULL;
+    region->reserved = reserved;
+    region->committed = committed - sizeof(TB_CodeRegion);
+    region->size = 0;
+    return region;
+}
+
+// makes sure there's extra bytes committed past the end of the region, returns
+// false if the chunk can't fit it.
+static bool code_region_commit(TB_CodeRegion* region, size_t extra) {
+    size_t needed = region->size + extra;
+    if (needed <= region->committed) return true;
+
+    size_t limit = region->reserved - sizeof(TB_CodeRegion);
+    if (needed > limit) return false;
+
+    // grow by at least double so we're not constantly poking the OS
+    size_t committed = align_up(sizeof(TB_CodeRegion) + needed, CODE_REGION_COMMIT_SIZE) - sizeof(TB_CodeRegion);
+    if (committed < region->committed * 2) committed = region->committed * 2;
+    if (committed > limit) committed = limit;
+
+    if (!tb_platform_vcommit(region, sizeof(TB_CodeRegion) + committed)) {
+        tb_panic("could not commit code region!");
+    }
+
+    region->committed = committed;
+    return true;
+}
+
 static TB_CodeRegion* get_or_allocate_code_region(TB_Module* m, int tid) {
     if (m->code_regions[tid] == NULL) {
-        m->code_regions[tid] = tb_platform_valloc(CODE_REGION_BUFFER_SIZE / total_tid);
-        if (m->code_regions[tid] == NULL) tb_panic("could not allocate code region!");
-
-        m->code_regions[tid]->capacity = CODE_REGION_BUFFER_SIZE / total_tid;
+        m->code_regions[tid] = new_code_region(0);
     }
 
     return m->code_regions[tid];
 }
+
+uint8_t* tb__code_region_grow(TB_Module* m, uint8_t* base, size_t used, size_t extra, size_t* out_capacity) {
+    int tid = tb__get_local_tid();
+    TB_CodeRegion* region = m->code_regions[tid];
+    assert(base == &region->data[region->size] && "function isn't at the end of the code region?");
+
+    if (!code_region_commit(region, used + extra)) {
+        // doesn't fit into this chunk, start a new one and move the
+        // function's code over. the old chunk keeps what it already had.
+        TB_CodeRegion* new_region = new_code_region(used + extra);
+        new_region->prev = region;
+        memcpy(new_region->data, base, used);
+
+        m->code_regions[tid] = region = new_region;
+    }
+
+    *out_capacity = region->committed - region->size;
+    return &region->data[region->size];
+}
 
 TB_API TB_DataType tb_vector_type(TB_DataTypeEnum type, int width) {
     assert(tb_is_power_of_two(width));
@@ -88,7 +181,6 @@ TB_API TB_Module* tb_module_create(TB_Arch arch, TB_System sys, const TB_Feature
     }
     memset(m, 0, sizeof(TB_Module));
 
-    m->max_threads = TB_MAX_THREADS;
     m->is_jit = is_jit;
 
     m->target_abi = (sys == TB_SYSTEM_WINDOWS) ? TB_ABI_WIN64 : TB_ABI_SYSTEMV;
@@ -100,26 +192,13 @@ TB_API TB_Module* tb_module_create(TB_Arch arch, TB_System sys, const TB_Feature
         m->features = *features;
     }
 
-    m->prototypes_arena = tb_platform_valloc(PROTOTYPES_ARENA_SIZE * sizeof(uint64_t));
-    if (m->prototypes_arena == NULL) {
-        fprintf(stderr, "tb_module_create: Out of memory!\n");
-        return NULL;
-    }
+    tb__intern_init(m);
 
     m->files.count = 1;
     m->files.capacity = 64;
     m->files.data = tb_platform_heap_alloc(64 * sizeof(TB_File));
     m->files.data[0] = (TB_File) { 0 };
 
-    FOREACH_N(i, 0, TB_MAX_THREADS) {
-        m->thread_info[i].const_patches  = dyn_array_create(TB_ConstPoolPatch, 4096);
-        m->thread_info[i].symbol_patches = dyn_array_create(TB_SymbolPatch, 4096);
-    }
-
-    // we start a little off the start just because
-    m->rdata_region_size = 16;
-
-    tb_platform_arena_init();
     return m;
 }
 
@@ -128,11 +207,10 @@ TB_API bool tb_module_compile_function(TB_Module* m, TB_Function* f, TB_ISelMode
     ICodeGen* restrict code_gen = tb__find_code_generator(m);
 
     // Machine code gen
-    int id = tb__get_local_tid();
-    assert(id < TB_MAX_THREADS);
+    int id = tb__get_module_tid(m);
 
     TB_CodeRegion* region = get_or_allocate_code_region(m, id);
-    TB_FunctionOutput* func_out = tb_platform_arena_alloc(sizeof(TB_FunctionOutput));
+    TB_FunctionOutput* func_out = tb__arena_alloc(m, sizeof(TB_FunctionOutput));
 
     if (isel_mode == TB_ISEL_COMPLEX && code_gen->complex_path == NULL) {
         // TODO(NeGate): we need better logging...
@@ -141,7 +219,7 @@ TB_API bool tb_module_compile_function(TB_Module* m, TB_Function* f, TB_ISelMode
     }
 
     uint8_t* local_buffer = &region->data[region->size];
-    size_t local_capacity = region->capacity - region->size;
+    size_t local_capacity = region->committed - region->size;
     if (isel_mode == TB_ISEL_COMPLEX) {
         *func_out = code_gen->complex_path(f, &m->features, local_buffer, local_capacity, id);
     } else {
@@ -151,9 +229,14 @@ TB_API bool tb_module_compile_function(TB_Module* m, TB_Function* f, TB_ISelMode
     // prologue & epilogue insertion
     {
         uint8_t buffer[PROEPI_BUFFER];
-        uint8_t* base = &region->data[region->size];
         size_t body_size = func_out->code_size;
-        assert(func_out->code == base);
+
+        // make sure there's space for the prologue & epilogue, also the code
+        // gen might've moved the function into a new chunk.
+        size_t capacity;
+        uint8_t* base = tb__code_region_grow(m, func_out->code, body_size, PROEPI_BUFFER, &capacity);
+        region = m->code_regions[id];
+        func_out->code = base;
 
         uint64_t meta = func_out->prologue_epilogue_metadata;
         size_t prologue_len = code_gen->emit_prologue(buffer, meta, func_out->stack_usage);
@@ -175,10 +258,70 @@ TB_API bool tb_module_compile_function(TB_Module* m, TB_Function* f, TB_ISelMode
     region->size += func_out->code_size;
 
     f->output = func_out;
+
+    if (m->streaming) {
+        tb_function_free(f);
+    }
     return true;
 }
+
+TB_API void tb_module_set_streaming(TB_Module* m, bool streaming) {
+    m->streaming = streaming;
+}
+
+typedef struct {
+    TB_Module* m;
+    TB_Function** funcs;
+    TB_ISelMode isel_mode;
+
+    tb_atomic_int failed;
+} CompileAllJob;
+
+static int compare_function_sizes(const void* a, const void* b) {
+    const TB_Function* fa = *(const TB_Function**) a;
+    const TB_Function* fb = *(const TB_Function**) b;
+
+    // biggest first
+    return (fa->node_count < fb->node_count) - (fa->node_count > fb->node_count);
+}
+
+static void compile_all_task(void* user_data, size_t i, int worker) {
+    CompileAllJob* job = user_data;
+
+    if (!tb_module_compile_function(job->m, job->funcs[i], job->isel_mode)) {
+        tb_atomic_int_store(&job->failed, 1);
+    }
+}
+
+TB_API bool tb_module_compile_all(TB_Module* m, TB_ISelMode isel_mode, int thread_count) {
+    tb__merge_symbols(m);
+
+    DynArray(TB_Function*) funcs = dyn_array_create(TB_Function*, m->symbol_count[TB_SYMBOL_FUNCTION] + 1);
+    TB_FOR_FUNCTIONS(f, m) {
+        if (f->super.tag == TB_SYMBOL_FUNCTION && f->output == NULL) {
+            dyn_array_put(funcs, f);
+        }
+    }
+
+    // handing out the big functions first means the stragglers at the
+    // end are all tiny so the workers finish around the same time.
+    size_t count = dyn_array_length(funcs);
+    qsort(funcs, count, sizeof(TB_Function*), compare_function_sizes);
+
+    // no dependencies so the job queue just hands them out in order
+    TB_Job* jobs = tb_platform_heap_alloc(count * sizeof(TB_Job));
+    memset(jobs, 0, count * sizeof(TB_Job));
+
+    CompileAllJob job = { m, funcs, isel_mode };
+    tb__run_jobs(count, jobs, thread_count, compile_all_task, &job);
+
+    tb_platform_heap_free(jobs);
+    dyn_array_destroy(funcs);
+    return !job.failed;
+}
 
 TB_API size_t tb_module_get_function_count(TB_Module* m) {
+    tb__merge_symbols(m);
     return m->symbol_count[TB_SYMBOL_FUNCTION];
 }
 
@@ -187,12 +330,7 @@ TB_API void tb_module_kill_symbol(TB_Module* m, TB_Symbol* sym) {
         case TB_SYMBOL_TOMBSTONE: break;
         case TB_SYMBOL_SYMLINK: break;
         case TB_SYMBOL_FUNCTION: {
-            TB_Function* f = (TB_Function*) sym;
-
-            tb_platform_heap_free(f->bbs);
-            tb_platform_heap_free(f->nodes);
-            tb_platform_heap_free(f->attrib_pool);
-            tb_platform_heap_free(f->vla.data);
+            tb_function_free((TB_Function*) sym);
             break;
         }
         case TB_SYMBOL_EXTERNAL: break;
@@ -204,8 +342,7 @@ TB_API void tb_module_kill_symbol(TB_Module* m, TB_Symbol* sym) {
 }
 
 TB_API void tb_module_destroy(TB_Module* m) {
-    tb_platform_arena_free();
-    tb_platform_string_free();
+    tb__merge_symbols(m);
 
     {
         TB_Symbol* s = m->first_symbol_of_tag[TB_SYMBOL_FUNCTION];
@@ -217,6 +354,17 @@ TB_API void tb_module_destroy(TB_Module* m) {
                 TB_Symbol* next = s->next;
                 tb_assume(tag == s->tag);
 
+                TB_Function* f = (TB_Function*) s;
+                if (f->owns_arena) {
+                    tb_ir_arena_destroy(f->arena);
+                }
+                tb_function_free_uses(f);
+                tb_function_invalidate_analysis(f, TB_ANALYSIS_ALL);
+
+                if (f->output != NULL) {
+                    dyn_array_destroy(f->output->stack_slots);
+                }
+
                 // TODO(NeGate): probably wanna have a custom heap for the symbol table
                 tb_platform_heap_free(s);
                 s = next;
@@ -225,10 +373,14 @@ TB_API void tb_module_destroy(TB_Module* m) {
     }
 
     FOREACH_N(i, 0, m->max_threads) {
-        if (m->code_regions[i] != NULL) {
-            tb_platform_vfree(m->code_regions[i], m->code_regions[i]->capacity);
-            m->code_regions[i] = NULL;
+        TB_CodeRegion* region = m->code_regions[i];
+        while (region != NULL) {
+            TB_CodeRegion* prev = region->prev;
+            tb_platform_vfree(region, region->reserved);
+            region = prev;
         }
+
+        m->code_regions[i] = NULL;
     }
 
     if (m->jit_region) {
@@ -245,16 +397,20 @@ TB_API void tb_module_destroy(TB_Module* m) {
         dyn_array_destroy(m->thread_info[i].const_patches);
     }
 
-    tb_platform_vfree(m->prototypes_arena, PROTOTYPES_ARENA_SIZE * sizeof(uint64_t));
+    tb_helper_free_symbol_arrays(m);
+    tb__arena_free(m);
 
     tb_platform_heap_free(m->files.data);
     tb_platform_heap_free(m);
 }
 
 TB_API TB_FileID tb_file_create(TB_Module* m, const char* path) {
+    // paths are interned so we can just compare the pointers
+    char* str = tb__intern(m, path);
+
     // skip the NULL file entry
     FOREACH_N(i, 1, m->files.count) {
-        if (strcmp(m->files.data[i].path, path) == 0) return i;
+        if (m->files.data[i].path == str) return i;
     }
 
     if (m->files.count + 1 >= m->files.capacity) {
@@ -262,8 +418,6 @@ TB_API TB_FileID tb_file_create(TB_Module* m, const char* path) {
         m->files.data = tb_platform_heap_realloc(m->files.data, m->files.capacity * sizeof(TB_File));
     }
 
-    char* str = tb_platform_string_alloc(path);
-
     size_t r = m->files.count++;
     m->files.data[r] = (TB_File) { .path = str };
     return r;
@@ -271,25 +425,22 @@ TB_API TB_FileID tb_file_create(TB_Module* m, const char* path) {
 
 void tb_function_reserve_nodes(TB_Function* f, size_t extra) {
     if (f->node_count + extra >= f->node_capacity) {
+        size_t old_capacity = f->node_capacity;
         f->node_capacity = (f->node_count + extra) * 2;
 
-        f->nodes = tb_platform_heap_realloc(f->nodes, sizeof(TB_Node) * f->node_capacity);
-        if (f->nodes == NULL) tb_panic("Out of memory");
+        f->nodes = tb__ir_realloc(f, f->nodes, sizeof(TB_Node) * old_capacity, sizeof(TB_Node) * f->node_capacity);
     }
 }
 
-TB_API TB_FunctionPrototype* tb_prototype_create(TB_Module* m, TB_CallingConv conv, TB_DataType return_dt, TB_DebugType* return_type, int num_params, bool has_varargs) {
-    assert(num_params == (uint32_t)num_params);
+static TB_FunctionPrototype* prototype_alloc(TB_Module* m, TB_CallingConv conv, TB_DataType return_dt, TB_DebugType* return_type, int num_params, bool has_varargs, size_t header_size) {
+    assert(num_params == (short)num_params);
 
-    size_t space_needed = (sizeof(TB_FunctionPrototype) + (sizeof(uint64_t) - 1)) / sizeof(uint64_t);
-    space_needed += ((num_params * sizeof(TB_PrototypeParam)) + (sizeof(uint64_t) - 1)) / sizeof(uint64_t);
+    // the header (if any) is placed right before the prototype
+    size_t size = header_size + sizeof(TB_FunctionPrototype) + (num_params * sizeof(TB_PrototypeParam));
+    uint8_t* mem = tb__arena_alloc(m, size);
 
-    size_t len = tb_atomic_size_add(&m->prototypes_arena_size, space_needed);
-    if (len + space_needed >= PROTOTYPES_ARENA_SIZE) {
-        tb_panic("Prototype arena: out of memory!\n");
-    }
-
-    TB_FunctionPrototype* p = (TB_FunctionPrototype*)&m->prototypes_arena[len];
+    TB_FunctionPrototype* p = (TB_FunctionPrototype*) &mem[header_size];
+    p->module = m;
     p->call_conv = conv;
     p->param_capacity = num_params;
     p->param_count = 0;
@@ -299,6 +450,85 @@ TB_API TB_FunctionPrototype* tb_prototype_create(TB_Module* m, TB_CallingConv co
     return p;
 }
 
+TB_API TB_FunctionPrototype* tb_prototype_create(TB_Module* m, TB_CallingConv conv, TB_DataType return_dt, TB_DebugType* return_type, int num_params, bool has_varargs) {
+    return prototype_alloc(m, conv, return_dt, return_type, num_params, has_varargs, 0);
+}
+
+// shared prototypes go into a hash trie off the module, it works just like the
+// string interner's (next two bits of the hash pick the child, inserts CAS into
+// an empty slot) so there's no table to size up front.
+struct TB_PrototypeEntry {
+    TB_PrototypeEntry* child[4];
+    TB_FunctionPrototype* proto;
+    uint32_t hash;
+};
+
+static uint32_t prototype_hash(TB_CallingConv conv, TB_DataType return_dt, int num_params, const TB_DataType* params, bool has_varargs) {
+    // FNV-1a over the 16bit pieces
+    uint32_t h = 0x811C9DC5;
+    h = (h ^ conv) * 0x01000193;
+    h = (h ^ return_dt.raw) * 0x01000193;
+    h = (h ^ has_varargs) * 0x01000193;
+    h = (h ^ num_params) * 0x01000193;
+    FOREACH_N(i, 0, num_params) {
+        h = (h ^ params[i].raw) * 0x01000193;
+    }
+    return h;
+}
+
+static bool prototype_match(TB_PrototypeEntry* e, uint32_t hash, TB_CallingConv conv, TB_DataType return_dt, int num_params, const TB_DataType* params, bool has_varargs) {
+    TB_FunctionPrototype* p = e->proto;
+    if (e->hash != hash || p->call_conv != conv || p->return_dt.raw != return_dt.raw ||
+        p->has_varargs != has_varargs || p->param_count != num_params) {
+        return false;
+    }
+
+    FOREACH_N(i, 0, num_params) {
+        if (p->params[i].dt.raw != params[i].raw) return false;
+    }
+
+    return true;
+}
+
+TB_API TB_FunctionPrototype* tb_prototype_get(TB_Module* m, TB_CallingConv conv, TB_DataType return_dt, int num_params, const TB_DataType* params, bool has_varargs) {
+    uint32_t hash = prototype_hash(conv, return_dt, num_params, params, has_varargs);
+    TB_PrototypeEntry* new_e = NULL;
+
+    TB_PrototypeEntry** slot = &m->prototype_root;
+    for (uint32_t h = hash;; h <<= 2) {
+        TB_PrototypeEntry* e = tb_atomic_ptr_load((void**) slot);
+        if (e == NULL) {
+            if (new_e == NULL) {
+                // make the prototype with the entry glued in front of it
+                size_t header_size = align_up(sizeof(TB_PrototypeEntry), _Alignof(max_align_t));
+                TB_FunctionPrototype* p = prototype_alloc(m, conv, return_dt, NULL, num_params, has_varargs, header_size);
+                FOREACH_N(i, 0, num_params) {
+                    p->params[i] = (TB_PrototypeParam){ params[i] };
+                }
+                p->param_count = num_params;
+
+                new_e = (TB_PrototypeEntry*) ((uint8_t*) p - header_size);
+                memset(new_e->child, 0, sizeof(new_e->child));
+                new_e->proto = p;
+                new_e->hash = hash;
+            }
+
+            if (tb_atomic_ptr_cmpxchg((void**) slot, NULL, new_e)) {
+                return new_e->proto;
+            }
+
+            // if someone beat us to it with the same signature ours is just
+            // wasted space in the arena.
+            e = tb_atomic_ptr_load((void**) slot);
+        }
+
+        if (prototype_match(e, hash, conv, return_dt, num_params, params, has_varargs)) {
+            return e->proto;
+        }
+        slot = &e->child[h >> 30];
+    }
+}
+
 TB_API void tb_prototype_add_param(TB_FunctionPrototype* p, TB_DataType dt) {
     assert(p->param_count + 1 <= p->param_capacity);
     p->params[p->param_count++] = (TB_PrototypeParam){ dt };
@@ -306,24 +536,22 @@ TB_API void tb_prototype_add_param(TB_FunctionPrototype* p, TB_DataType dt) {
 
 TB_API void tb_prototype_add_param_named(TB_FunctionPrototype* p, TB_DataType dt, const char* name, TB_DebugType* debug_type) {
     assert(p->param_count + 1 <= p->param_capacity);
-    p->params[p->param_count++] = (TB_PrototypeParam){ dt, tb_platform_string_alloc(name), debug_type };
+    p->params[p->param_count++] = (TB_PrototypeParam){ dt, tb__intern(p->module, name), debug_type };
 }
 
-TB_API TB_Function* tb_function_create(TB_Module* m, const char* name, TB_Linkage linkage) {
+static TB_Function* function_create(TB_Module* m, const char* name, TB_Linkage linkage, TB_IRArena* arena, bool owns_arena) {
     TB_Function* f = (TB_Function*) tb_symbol_alloc(m, TB_SYMBOL_FUNCTION, name, sizeof(TB_Function));
     f->linkage = linkage;
+    f->arena = arena;
+    f->owns_arena = owns_arena;
 
     f->bb_capacity = 4;
     f->bb_count = 1;
-    f->bbs = tb_platform_heap_alloc(f->bb_capacity * sizeof(TB_BasicBlock));
+    f->bbs = tb__ir_alloc(f, f->bb_capacity * sizeof(TB_BasicBlock));
 
     f->node_capacity = 64;
     f->node_count = 2;
-    f->nodes = tb_platform_heap_alloc(f->node_capacity * sizeof(TB_Node));
-
-    f->attrib_pool_capacity = 64;
-    f->attrib_pool_count = 1; // 0 is reserved
-    f->attrib_pool = tb_platform_heap_alloc(64 * sizeof(TB_Attrib));
+    f->nodes = tb__ir_alloc(f, f->node_capacity * sizeof(TB_Node));
 
     // Null slot
     f->nodes[0] = (TB_Node) { .next = 0 };
@@ -331,11 +559,44 @@ TB_API TB_Function* tb_function_create(TB_Module* m, const char* name, TB_Linkag
     // this is just a dummy slot so that things like parameters can anchor to
     f->nodes[1] = (TB_Node) { .next = 0 };
     f->bbs[0] = (TB_BasicBlock){ 1, 1 };
+
+    // the builder fills in the def-use index as it goes
+    tb_function_build_uses(f);
     return f;
 }
+
+TB_API TB_Function* tb_function_create(TB_Module* m, const char* name, TB_Linkage linkage) {
+    return function_create(m, name, linkage, tb_ir_arena_create(0), true);
+}
+
+TB_API void tb_function_free(TB_Function* f) {
+    if (f->owns_arena) {
+        tb_ir_arena_destroy(f->arena);
+    }
+    tb_function_free_uses(f);
+    tb_function_invalidate_analysis(f, TB_ANALYSIS_ALL);
+
+    // everything that the exporters need (output, line info, names, prototype)
+    // lives in the module so this is all we need to forget about.
+    f->arena = NULL;
+    f->owns_arena = false;
+
+    f->bb_count = f->bb_capacity = 0;
+    f->bbs = NULL;
+    f->node_count = f->node_capacity = 0;
+    f->nodes = NULL;
+    f->params = NULL;
+    f->vla.count = f->vla.capacity = 0;
+    f->vla.data = NULL;
+}
+
+TB_API TB_Function* tb_function_create_in_arena(TB_Module* m, const char* name, TB_Linkage linkage, TB_IRArena* arena) {
+    assert(arena != NULL);
+    return function_create(m, name, linkage, arena, false);
+}
 
 TB_API void tb_symbol_set_name(TB_Symbol* s, const char* name) {
-    s->name = tb_platform_string_alloc(name);
+    s->name = tb__intern(s->module, name);
 }
 
 TB_API const char* tb_symbol_get_name(TB_Symbol* s) {
@@ -348,10 +609,7 @@ TB_API void tb_function_set_prototype(TB_Function* f, const TB_FunctionPrototype
 
     const ICodeGen* restrict code_gen = tb__find_code_generator(f->super.module);
 
-    f->params = tb_platform_heap_realloc(f->params, sizeof(TB_Reg) * new_param_count);
-    if (new_param_count > 0 && f->params == NULL) {
-        tb_panic("tb_function_set_prototype: Out of memory!");
-    }
+    f->params = tb__ir_realloc(f, f->params, sizeof(TB_Reg) * old_param_count, sizeof(TB_Reg) * new_param_count);
 
     // walk to the end of the param list (it starts directly after the entry label)
     TB_Reg prev = 1, r = 1;
@@ -438,13 +696,13 @@ TB_API void tb_initializer_add_symbol_reloc(TB_Module* m, TB_Initializer* init,
 }
 
 TB_API TB_Global* tb_global_create(TB_Module* m, const char* name, TB_StorageClass storage, TB_DebugType* dbg_type, TB_Linkage linkage) {
-    int tid = tb__get_local_tid();
+    int tid = tb__get_module_tid(m);
 
     TB_Global* g = pool_put(m->thread_info[tid].globals);
     *g = (TB_Global){
         .super = {
             .tag = TB_SYMBOL_GLOBAL,
-            .name = tb_platform_string_alloc(name),
+            .name = tb__intern(m, name),
             .module = m,
         },
         .dbg_type = dbg_type,
@@ -457,18 +715,8 @@ TB_API TB_Global* tb_global_create(TB_Module* m, const char* name, TB_StorageCla
 }
 
 TB_API void tb_global_set_initializer(TB_Module* m, TB_Global* global, TB_Initializer* init) {
-    tb_atomic_size_t* region_size = global->storage == TB_STORAGE_TLS ? &m->tls_region_size : &m->data_region_size;
-    size_t pos = tb_atomic_size_add(region_size, init->size + init->align);
-
-    // TODO(NeGate): Assert on non power of two alignment
-    size_t align_mask = init->align - 1;
-    pos = (pos + align_mask) & ~align_mask;
-
+    // the position is handed out at export time (see tb_helper_layout_data)
     assert(init);
-    assert(pos < UINT32_MAX && "Cannot fit global into space");
-    assert((pos + init->size) < UINT32_MAX && "Cannot fit global into space");
-
-    global->pos = pos;
     global->init = init;
 }
 
@@ -490,13 +738,13 @@ TB_API void* tb_function_get_jit_pos(TB_Function* f) {
 
 TB_API TB_External* tb_extern_create(TB_Module* m, const char* name, TB_ExternalType type) {
     assert(name != NULL);
-    int tid = tb__get_local_tid();
+    int tid = tb__get_module_tid(m);
 
     TB_External* e = pool_put(m->thread_info[tid].externals);
     *e = (TB_External){
         .super = {
             .tag = TB_SYMBOL_EXTERNAL,
-            .name = tb_platform_string_alloc(name),
+            .name = tb__intern(m, name),
             .module = m,
         },
         .type = type,
@@ -506,6 +754,7 @@ TB_API TB_External* tb_extern_create(TB_Module* m, const char* name, TB_External
 }
 
 TB_API TB_Function* tb_first_function(TB_Module* m) {
+    tb__merge_symbols(m);
     return (TB_Function*) m->first_symbol_of_tag[TB_SYMBOL_FUNCTION];
 }
 
@@ -514,6 +763,7 @@ TB_API TB_Function* tb_next_function(TB_Function* f) {
 }
 
 TB_API TB_External* tb_first_external(TB_Module* m) {
+    tb__merge_symbols(m);
     return (TB_External*) m->first_symbol_of_tag[TB_SYMBOL_EXTERNAL];
 }
 
@@ -525,80 +775,130 @@ TB_API TB_External* tb_next_external(TB_External* e) {
 // TLS - Thread local storage
 //
 // Certain backend elements require memory but we would prefer to avoid
-// making any heap allocations when possible to there's a preallocated
-// block per thread that can run TB.
+// making any heap allocations when possible to there's a chain of scratch
+// segments per thread that can run TB. It starts at TB_TEMPORARY_STORAGE_SIZE
+// and grows as big functions come through, the segments are kept around so
+// the next function doesn't have to allocate them again.
 //
 void tb_free_thread_resources(void) {
-    if (tb_thread_storage != NULL) {
-        tb_platform_vfree(tb_thread_storage, TB_TEMPORARY_STORAGE_SIZE);
-        tb_thread_storage = NULL;
+    TB_TempSegment* s = tb_thread_storage.top;
+    if (s != NULL) {
+        // walk to the end, then free backwards
+        while (s->next != NULL) s = s->next;
+        while (s != NULL) {
+            TB_TempSegment* prev = s->prev;
+            tb_platform_vfree(s, s->capacity + sizeof(TB_TempSegment));
+            s = prev;
+        }
+
+        tb_thread_storage.top = NULL;
     }
+
+    release_local_tid();
 }
 
-TB_TemporaryStorage* tb_tls_allocate() {
-    if (tb_thread_storage == NULL) {
-        tb_thread_storage = tb_platform_valloc(TB_TEMPORARY_STORAGE_SIZE);
-        if (tb_thread_storage == NULL) {
-            tb_panic("out of memory");
-        }
+static TB_TempSegment* tls_new_segment(TB_TempSegment* prev, size_t capacity) {
+    TB_TempSegment* s = tb_platform_valloc(capacity + sizeof(TB_TempSegment));
+    if (s == NULL) {
+        tb_panic("out of memory");
     }
 
-    TB_TemporaryStorage* store = (TB_TemporaryStorage*)tb_thread_storage;
-    store->used = 0;
-    return store;
+    s->prev = prev;
+    s->next = NULL;
+    s->capacity = capacity;
+    s->used = 0;
+    return s;
 }
-
+
 TB_TemporaryStorage* tb_tls_steal() {
-    if (tb_thread_storage == NULL) {
-        tb_thread_storage = tb_platform_valloc(TB_TEMPORARY_STORAGE_SIZE);
-        if (tb_thread_storage == NULL) {
-            tb_panic("out of memory");
-        }
+    if (tb_thread_storage.top == NULL) {
+        tb_thread_storage.top = tls_new_segment(NULL, TB_TEMPORARY_STORAGE_SIZE - sizeof(TB_TempSegment));
+        tb_platform_free_at_thread_exit();
     }
 
-    return (TB_TemporaryStorage*)tb_thread_storage;
+    return &tb_thread_storage;
 }
-
-bool tb_tls_can_fit(TB_TemporaryStorage* store, size_t size) {
-    return (sizeof(TB_TemporaryStorage) + store->used + size < TB_TEMPORARY_STORAGE_SIZE);
+
+TB_TemporaryStorage* tb_tls_allocate() {
+    TB_TemporaryStorage* store = tb_tls_steal();
+
+    // rewind to the first segment, keep the rest for later
+    TB_TempSegment* s = store->top;
+    while (s->prev != NULL) s = s->prev;
+
+    s->used = 0;
+    store->top = s;
+    return store;
 }
 
-void* tb_tls_try_push(TB_TemporaryStorage* store, size_t size) {
-    if (sizeof(TB_TemporaryStorage) + store->used + size >= TB_TEMPORARY_STORAGE_SIZE) {
-        return NULL;
+// the current segment can't fit size, move to the next one (making it if needed)
+static TB_TempSegment* tls_grow(TB_TemporaryStorage* store, size_t size) {
+    TB_TempSegment* top = store->top;
+    TB_TempSegment* next = top->next;
+
+    if (next == NULL || next->capacity < size) {
+        // anything past here is too small to be useful
+        while (next != NULL) {
+            TB_TempSegment* after = next->next;
+            tb_platform_vfree(next, next->capacity + sizeof(TB_TempSegment));
+            next = after;
+        }
+
+        size_t capacity = top->capacity * 2;
+        if (capacity < size) capacity = size;
+
+        next = tls_new_segment(top, capacity);
+        top->next = next;
     }
 
-    void* ptr = &store->data[store->used];
-    store->used += size;
-    return ptr;
+    next->used = 0;
+    store->top = next;
+    return next;
 }
 
 void* tb_tls_push(TB_TemporaryStorage* store, size_t size) {
-    assert(sizeof(TB_TemporaryStorage) + store->used + size < TB_TEMPORARY_STORAGE_SIZE);
+    TB_TempSegment* s = store->top;
+    if (s->capacity - s->used < size) {
+        s = tls_grow(store, size);
+    }
 
-    void* ptr = &store->data[store->used];
-    store->used += size;
+    void* ptr = &s->data[s->used];
+    s->used += size;
     return ptr;
 }
 
+void* tb_tls_mark(TB_TemporaryStorage* store) {
+    TB_TempSegment* s = store->top;
+    return &s->data[s->used];
+}
+
 void* tb_tls_pop(TB_TemporaryStorage* store, size_t size) {
-    assert(sizeof(TB_TemporaryStorage) + store->used > size);
+    TB_TempSegment* s = store->top;
+    assert(s->used >= size && "can't pop across segments");
 
-    store->used -= size;
-    return &store->data[store->used];
+    s->used -= size;
+    return &s->data[s->used];
 }
 
 void* tb_tls_peek(TB_TemporaryStorage* store, size_t distance) {
-    assert(sizeof(TB_TemporaryStorage) + store->used > distance);
+    TB_TempSegment* s = store->top;
+    assert(s->used >= distance && "can't peek across segments");
 
-    return &store->data[store->used - distance];
+    return &s->data[s->used - distance];
 }
 
 void tb_tls_restore(TB_TemporaryStorage* store, void* ptr) {
-    size_t i = ((uint8_t*)ptr) - store->data;
-    assert(i <= store->used);
+    // usually it's in the top segment, if not we're popping some off
+    for (TB_TempSegment* s = store->top; s != NULL; s = s->prev) {
+        uint8_t* p = ptr;
+        if (p >= s->data && p <= &s->data[s->used]) {
+            s->used = p - s->data;
+            store->top = s;
+            return;
+        }
+    }
 
-    store->used = i;
+    assert(0 && "tb_tls_restore: pointer isn't from this temporary storage");
 }
 
 void tb_emit_symbol_patch(TB_Module* m, TB_Function* source, const TB_Symbol* target, size_t pos, bool is_function, size_t local_thread_id) {
@@ -612,17 +912,13 @@ uint32_t tb_emit_const_patch(TB_Module* m, TB_Function* source, size_t pos, cons
     assert(pos == (uint32_t)pos);
     assert(len == (uint32_t)len);
 
-    size_t align = len > 8 ? 16 : 0;
-    size_t alloc_pos = tb_atomic_size_add(&m->rdata_region_size, len + align);
-
-    size_t rdata_pos = len > 8 ? align_up(alloc_pos, 16) : alloc_pos;
+    // the constant doesn't get a real spot until export time (see tb_helper_layout_data),
+    // the code just refers to 0 until then and gets fixed up.
     TB_ConstPoolPatch p = {
-        .source = source, .pos = pos, .rdata_pos = rdata_pos, .data = ptr, .length = len
+        .source = source, .pos = pos, .rdata_pos = 0, .data = ptr, .length = len
     };
     dyn_array_put(m->thread_info[local_thread_id].const_patches, p);
-
-    assert(rdata_pos == (uint32_t)rdata_pos);
-    return rdata_pos;
+    return 0;
 }
 
 //
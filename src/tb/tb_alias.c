@@ -0,0 +1,204 @@
+// Alias analysis, nothing fancy just what the IR gives us for free:
+//
+// * every address is peeled into a base + offset by walking through member
+//   accesses (and array accesses with constant indices).
+// * distinct TB_LOCALs, param slots and symbols are distinct objects.
+// * a stack object whose address never leaves the function (isn't stored,
+//   passed to calls, compared, etc) can only be touched through itself, so
+//   unknown pointers and calls can't hit it.
+//
+// anything else is assumed to alias.
+#include "tb_internal.h"
+
+static bool get_int_const(TB_Function* f, TB_Reg r, int64_t* out) {
+    TB_Node* n = &f->nodes[r];
+    if (n->type != TB_INTEGER_CONST || n->integer.num_words != 1) {
+        return false;
+    }
+
+    *out = tb__sxt(n->integer.single_word, n->dt.data, 64);
+    return true;
+}
+
+static bool is_stack_object(TB_Function* f, TB_Reg r) {
+    TB_NodeTypeEnum t = f->nodes[r].type;
+    return t == TB_LOCAL || t == TB_PARAM_ADDR;
+}
+
+static bool is_identified_object(TB_Function* f, TB_Reg r) {
+    return is_stack_object(f, r) || f->nodes[r].type == TB_GET_SYMBOL_ADDRESS;
+}
+
+TB_MemLoc tb_alias_decompose(TB_Function* f, TB_Reg addr) {
+    TB_MemLoc loc = { .base = addr, .known_offset = true };
+
+    for (;;) {
+        TB_Node* n = &f->nodes[loc.base];
+
+        if (n->type == TB_MEMBER_ACCESS) {
+            loc.offset += n->member_access.offset;
+            loc.base = n->member_access.base;
+        } else if (n->type == TB_ARRAY_ACCESS) {
+            int64_t index;
+            if (get_int_const(f, n->array_access.index, &index)) {
+                loc.offset += index * n->array_access.stride;
+            } else {
+                loc.known_offset = false;
+            }
+            loc.base = n->array_access.base;
+        } else if (n->type == TB_PASS) {
+            loc.base = n->pass.value;
+        } else {
+            break;
+        }
+    }
+
+    return loc;
+}
+
+// two different GET_SYMBOL_ADDRESS nodes might name the same symbol
+static bool same_base(TB_Function* f, TB_Reg a, TB_Reg b) {
+    if (a == b) return true;
+
+    TB_Node* an = &f->nodes[a];
+    TB_Node* bn = &f->nodes[b];
+    return an->type == TB_GET_SYMBOL_ADDRESS && bn->type == TB_GET_SYMBOL_ADDRESS &&
+        an->sym.value == bn->sym.value;
+}
+
+static void mark_escape(TB_Function* f, TB_AliasInfo* ai, TB_Reg r) {
+    if (r == TB_NULL_REG) return;
+
+    TB_Reg base = tb_alias_decompose(f, r).base;
+    if (is_stack_object(f, base)) ai->escaped[base] = true;
+}
+
+TB_AliasInfo tb_get_alias_info(TB_Function* f, TB_TemporaryStorage* tls) {
+    TB_AliasInfo ai = {
+        .pointer_size = tb__find_code_generator(f->super.module)->pointer_size,
+        .escaped = tb_tls_push(tls, f->node_count * sizeof(bool)),
+    };
+    memset(ai.escaped, 0, f->node_count * sizeof(bool));
+
+    // any use of a stack address which isn't just accessing memory
+    // through it (or computing another address off of it) leaks it.
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(r, f, bb) {
+            TB_Node* n = &f->nodes[r];
+
+            switch (n->type) {
+                case TB_LOAD:
+                case TB_MEMBER_ACCESS:
+                case TB_ARRAY_ACCESS:
+                case TB_PASS:
+                case TB_MEMCLR:
+                case TB_MEMSET:
+                case TB_MEMCPY:
+                case TB_INITIALIZE:
+                case TB_ATOMIC_TEST_AND_SET:
+                case TB_ATOMIC_CLEAR:
+                case TB_ATOMIC_LOAD:
+                break;
+
+                case TB_STORE:
+                mark_escape(f, &ai, n->store.value);
+                break;
+
+                case TB_ATOMIC_XCHG:
+                case TB_ATOMIC_ADD:
+                case TB_ATOMIC_SUB:
+                case TB_ATOMIC_AND:
+                case TB_ATOMIC_XOR:
+                case TB_ATOMIC_OR:
+                case TB_ATOMIC_CMPXCHG:
+                case TB_ATOMIC_CMPXCHG2:
+                mark_escape(f, &ai, n->atomic.src);
+                break;
+
+                default: {
+                    TB_FOR_INPUT_IN_NODE(it, f, n) {
+                        mark_escape(f, &ai, it.r);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    return ai;
+}
+
+int tb_alias_access_size(const TB_AliasInfo* ai, TB_DataType dt) {
+    int bits;
+    switch (dt.type) {
+        case TB_INT: bits = dt.data; break;
+        case TB_PTR: bits = ai->pointer_size; break;
+        case TB_FLOAT: bits = dt.data == TB_FLT_64 ? 64 : 32; break;
+        default: return 0;
+    }
+
+    return ((bits + 7) / 8) << dt.width;
+}
+
+int tb_alias_mem_op_size(TB_Function* f, TB_Reg size_reg) {
+    TB_Node* n = &f->nodes[size_reg];
+    if (n->type == TB_INTEGER_CONST && n->integer.num_words == 1 && n->integer.single_word <= INT32_MAX) {
+        return n->integer.single_word;
+    }
+
+    return 0;
+}
+
+bool tb_alias_is_local_only(TB_Function* f, const TB_AliasInfo* ai, TB_Reg addr) {
+    TB_Reg base = tb_alias_decompose(f, addr).base;
+    return is_stack_object(f, base) && !ai->escaped[base];
+}
+
+bool tb_alias_must_alias(TB_Function* f, TB_Reg a, TB_Reg b) {
+    if (a == b) return true;
+
+    TB_MemLoc al = tb_alias_decompose(f, a);
+    TB_MemLoc bl = tb_alias_decompose(f, b);
+    return same_base(f, al.base, bl.base) && al.known_offset && bl.known_offset && al.offset == bl.offset;
+}
+
+bool tb_alias_must_cover(TB_Function* f, TB_Reg a, int a_size, TB_Reg b, int b_size) {
+    if (a_size <= 0 || b_size <= 0) return false;
+
+    TB_MemLoc al = tb_alias_decompose(f, a);
+    TB_MemLoc bl = tb_alias_decompose(f, b);
+    if (!same_base(f, al.base, bl.base) || !al.known_offset || !bl.known_offset) {
+        return false;
+    }
+
+    return al.offset <= bl.offset && bl.offset + b_size <= al.offset + a_size;
+}
+
+bool tb_alias_may_alias(TB_Function* f, const TB_AliasInfo* ai, TB_Reg a, int a_size, TB_Reg b, int b_size) {
+    if (a == b) return true;
+
+    TB_MemLoc al = tb_alias_decompose(f, a);
+    TB_MemLoc bl = tb_alias_decompose(f, b);
+
+    if (same_base(f, al.base, bl.base)) {
+        // unknown sizes or offsets mean we can't tell where in the object
+        // they land.
+        if (!al.known_offset || !bl.known_offset || a_size <= 0 || b_size <= 0) {
+            return true;
+        }
+
+        return al.offset < bl.offset + b_size && bl.offset < al.offset + a_size;
+    }
+
+    // two different objects never overlap
+    if (is_identified_object(f, al.base) && is_identified_object(f, bl.base)) {
+        return false;
+    }
+
+    // an unknown pointer can't be pointing into a stack object which never
+    // had its address taken.
+    if (is_stack_object(f, al.base) && !ai->escaped[al.base]) return false;
+    if (is_stack_object(f, bl.base) && !ai->escaped[bl.base]) return false;
+
+    return true;
+}
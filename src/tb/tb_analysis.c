@@ -1,12 +1,6 @@
 // This file contains generic analysis functions for operating on the TBIR
 #include "tb_internal.h"
 
-typedef struct {
-    TB_Function* f;
-    int* doms;
-    TB_PostorderWalk order;
-} DomContext;
-
 // ignores the start node when doing the traversal
 static void postorder(TB_Function* f, TB_PostorderWalk* ctx, TB_Label bb) {
     if (ctx->visited[bb]) {
@@ -61,35 +55,142 @@ TB_API void tb_function_get_postorder_explicit(TB_Function* f, TB_PostorderWalk*
     postorder(f, walk, 0);
 }
 
-static int find_traversal_index(DomContext* ctx, TB_Label l) {
-    FOREACH_N(i, 0, ctx->order.count) {
-        if (ctx->order.traversal[i] == l) return i;
+// successors in the order the postorder walk visits them, it's random access so
+// the iterative walks can just keep an index per block on their stack.
+static int successor_count(TB_Function* f, TB_Label bb) {
+    TB_Node* end = &f->nodes[f->bbs[bb].end];
+    switch (end->type) {
+        case TB_GOTO: return 1;
+        case TB_IF: return 2;
+        case TB_SWITCH: return 1 + (end->switch_.entries_end - end->switch_.entries_start) / 2;
+        default: return 0;
     }
-
-    tb_todo();
 }
 
-static int get_idom_in_postorder_index(DomContext* ctx, int x) {
-    return find_traversal_index(ctx, ctx->doms[ctx->order.traversal[x]]);
+static TB_Label successor_at(TB_Function* f, TB_Label bb, int i) {
+    TB_Node* end = &f->nodes[f->bbs[bb].end];
+    switch (end->type) {
+        case TB_GOTO: return end->goto_.label;
+        case TB_IF: return i == 0 ? end->if_.if_false : end->if_.if_true;
+        case TB_SWITCH: {
+            if (i == 0) return end->switch_.default_label;
+
+            size_t entry_count = (end->switch_.entries_end - end->switch_.entries_start) / 2;
+            TB_SwitchEntry* entries = (TB_SwitchEntry*) &f->vla.data[end->switch_.entries_start];
+            return entries[entry_count - i].value;
+        }
+        default: tb_unreachable();
+    }
 }
 
-// this takes in postorder indices
-static TB_Label intersect(DomContext* ctx, int a, int b) {
-    while (a != b) {
-        // while (finger1 < finger2)
-        //   finger1 = doms[finger1]
-        while (a < b) {
-            a = get_idom_in_postorder_index(ctx, a);
+typedef struct {
+    TB_Label bb;
+    int succ;
+} DFSFrame;
+
+// iterative DFS from the entry, fills in the preorder numbering (dfnum is -1 for
+// unreachable blocks) along with the DFS tree parents. postorder is optional and
+// comes out the same as tb_function_get_postorder.
+static int dfs_walk(TB_Function* f, TB_TemporaryStorage* tls, int* dfnum, TB_Label* vertex, int* parent, TB_Label* postorder) {
+    FOREACH_N(i, 0, f->bb_count) dfnum[i] = -1;
+
+    DFSFrame* stack = tb_tls_push(tls, f->bb_count * sizeof(DFSFrame));
+    int top = 0, count = 0, post_count = 0;
+
+    stack[top++] = (DFSFrame){ 0, 0 };
+    dfnum[0] = count, vertex[count] = 0, parent[count] = -1, count++;
+
+    while (top > 0) {
+        DFSFrame* fr = &stack[top - 1];
+
+        if (fr->succ < successor_count(f, fr->bb)) {
+            TB_Label s = successor_at(f, fr->bb, fr->succ++);
+
+            if (dfnum[s] < 0) {
+                parent[count] = dfnum[fr->bb];
+                dfnum[s] = count, vertex[count] = s, count++;
+                stack[top++] = (DFSFrame){ s, 0 };
+            }
+        } else {
+            if (postorder) postorder[post_count++] = fr->bb;
+            top -= 1;
         }
+    }
+
+    tb_tls_restore(tls, stack);
+    return count;
+}
+
+int tb__get_postorder(TB_Function* f, TB_TemporaryStorage* tls, TB_Label* postorder) {
+    int* dfnum = tb_tls_push(tls, f->bb_count * sizeof(int));
+    int* parent = tb_tls_push(tls, f->bb_count * sizeof(int));
+    TB_Label* vertex = tb_tls_push(tls, f->bb_count * sizeof(TB_Label));
+
+    int count = dfs_walk(f, tls, dfnum, vertex, parent, postorder);
+    tb_tls_restore(tls, dfnum);
+    return count;
+}
+
+// path compression for semi-NCA, ancestor[v] is -1 if v hasn't been linked yet.
+// it's iterative since the chains can get as long as the function, path is
+// just scratch space big enough for any of them.
+static int dom_eval(int* ancestor, int* best, const int* semi, int* path, int v) {
+    if (ancestor[v] < 0) return v;
+
+    // collect the path up to the root of the linked forest
+    int len = 0;
+    for (int u = v; ancestor[ancestor[u]] >= 0; u = ancestor[u]) {
+        path[len++] = u;
+    }
+
+    // compress from the top down so every node sees its ancestor's final best
+    FOREACH_REVERSE_N(i, 0, len) {
+        int u = path[i], a = ancestor[u];
+        if (semi[best[a]] < semi[best[u]]) best[u] = best[a];
+        ancestor[u] = ancestor[a];
+    }
+
+    return best[v];
+}
+
+// builds the child lists of the dominator tree (counting sort on the idoms) and
+// numbers it with a DFS, preorder is optional and gets the blocks in the order
+// they were entered.
+static void number_dom_tree(TB_Function* f, TB_TemporaryStorage* tls, const TB_Label* idom, int* kids_start, TB_Label* kids, int* pre, int* post, TB_Label* preorder) {
+    size_t bb_count = f->bb_count;
+
+    memset(kids_start, 0, (bb_count + 1) * sizeof(int));
+    FOREACH_N(i, 1, bb_count) kids_start[idom[i] + 1] += 1;
+    FOREACH_N(i, 0, bb_count) kids_start[i + 1] += kids_start[i];
+
+    // post is free right now so we'll use it as the fill cursor
+    FOREACH_N(i, 0, bb_count) post[i] = kids_start[i];
+    FOREACH_N(i, 1, bb_count) kids[post[idom[i]]++] = i;
+
+    // the frames track which child is next
+    DFSFrame* stack = tb_tls_push(tls, bb_count * sizeof(DFSFrame));
+    int top = 0, clock = 0, entered = 0;
+
+    stack[top++] = (DFSFrame){ 0, kids_start[0] };
+    pre[0] = clock++;
+    if (preorder) preorder[entered++] = 0;
+
+    while (top > 0) {
+        DFSFrame* fr = &stack[top - 1];
 
-        // while (finger2 < finger1)
-        //   finger2 = doms[finger2]
-        while (b < a) {
-            b = get_idom_in_postorder_index(ctx, b);
+        if (fr->succ < kids_start[fr->bb + 1]) {
+            TB_Label kid = kids[fr->succ++];
+
+            pre[kid] = clock++;
+            if (preorder) preorder[entered++] = kid;
+            stack[top++] = (DFSFrame){ kid, kids_start[kid] };
+        } else {
+            post[fr->bb] = clock++;
+            top -= 1;
         }
     }
 
-    return a;
+    tb_tls_restore(tls, stack);
 }
 
 TB_Predeccesors tb_get_temp_predeccesors(TB_Function* f, TB_TemporaryStorage* tls) {
@@ -102,8 +203,7 @@ TB_Predeccesors tb_get_temp_predeccesors(TB_Function* f, TB_TemporaryStorage* tl
     p.preds[0] = NULL;
 
     FOREACH_N(j, 1, f->bb_count) {
-        p.preds[j] = tb_tls_push(tls, 0);
-        tb_calculate_immediate_predeccessors(f, tls, j, &p.count[j]);
+        p.preds[j] = tb_calculate_immediate_predeccessors(f, tls, j, &p.count[j]);
     }
 
     return p;
@@ -192,75 +292,70 @@ TB_API void tb_free_dominance_frontiers(TB_Function* f, TB_DominanceFrontiers* f
     tb_platform_heap_free(frontiers->count);
 }
 
-// https://www.cs.rice.edu/~keith/EMBED/dom.pdf
+// Semi-NCA: semidominators are computed like in Lengauer-Tarjan (with path
+// compression, no balancing) then the immediate dominator is the nearest common
+// ancestor of the DFS parent and the semidominator which we find by walking up.
+// It's practically linear and it doesn't need the postorder lookups the iterative
+// scheme did.
+//
+// https://www.cs.princeton.edu/research/techreps/TR-737-05
 TB_API size_t tb_get_dominators(TB_Function* f, TB_Predeccesors preds, TB_Label* doms) {
     if (doms == NULL) {
         return f->bb_count;
     }
 
-    // entrypoint dominates itself
-    DomContext ctx = { .f = f, .doms = doms };
-    doms[0] = 0;
-
-    // undef all dominator entries
-    FOREACH_N(i, 1, f->bb_count) doms[i] = -1;
+    size_t bb_count = f->bb_count;
+    TB_TemporaryStorage* tls = tb_tls_steal();
+    void* mark = tb_tls_mark(tls);
+
+    int* dfnum = tb_tls_push(tls, bb_count * sizeof(int));
+    TB_Label* vertex = tb_tls_push(tls, bb_count * sizeof(TB_Label));
+    int* parent = tb_tls_push(tls, bb_count * sizeof(int));
+    int count = dfs_walk(f, tls, dfnum, vertex, parent, NULL);
+
+    // these are all indexed by preorder number
+    int* semi = tb_tls_push(tls, count * sizeof(int));
+    int* idom = tb_tls_push(tls, count * sizeof(int));
+    int* ancestor = tb_tls_push(tls, count * sizeof(int));
+    int* best = tb_tls_push(tls, count * sizeof(int));
+    int* path = tb_tls_push(tls, count * sizeof(int));
+    FOREACH_N(i, 0, count) {
+        semi[i] = i, best[i] = i, ancestor[i] = -1;
+    }
 
-    // identify post order traversal order
-    {
-        TB_TemporaryStorage* tls = tb_tls_steal();
+    FOREACH_REVERSE_N(w, 1, count) {
+        TB_Label bb = vertex[w];
 
-        ctx.order.count = 0;
-        ctx.order.traversal = tb_tls_push(tls, f->bb_count * sizeof(TB_Reg));
+        FOREACH_N(j, 0, preds.count[bb]) {
+            int v = dfnum[preds.preds[bb][j]];
 
-        // we only need the visited array for this scope, it's just to avoid
-        // recursing forever on post order traversal stuff
-        ctx.order.visited = tb_tls_push(tls, f->bb_count * sizeof(bool));
-        memset(ctx.order.visited, 0, f->bb_count * sizeof(bool));
+            // unreachable predecessors don't count
+            if (v < 0) continue;
 
-        tb_function_get_postorder_explicit(f, &ctx.order);
+            int u = dom_eval(ancestor, best, semi, path, v);
+            if (semi[u] < semi[w]) semi[w] = semi[u];
+        }
 
-        // NOTE: free ctx.order.visited but keep ctx.traversal
-        tb_tls_restore(tls, ctx.order.visited);
-        ctx.order.visited = NULL;
+        ancestor[w] = parent[w];
     }
 
-    bool changed = true;
-    while (changed) {
-        changed = false;
-
-        // for all nodes, b, in reverse postorder (except start node)
-        FOREACH_REVERSE_N(i, 0, ctx.order.count - 1) {
-            TB_Label b = ctx.order.traversal[i];
-            TB_Label new_idom = preds.preds[b][0];
-
-            // for all other predecessors, p, of b
-            FOREACH_N(j, 1, preds.count[b]) {
-                TB_Label p = preds.preds[b][j];
-
-                // i.e., if doms[p] already calculated
-                if (doms[p] != -1) {
-                    new_idom = ctx.order.traversal[intersect(
-                            &ctx,
-                            find_traversal_index(&ctx, p),
-                            find_traversal_index(&ctx, new_idom)
-                        )];
-                }
-            }
-
-            if (doms[b] != new_idom) {
-                doms[b] = new_idom;
-                changed = true;
-            }
-        }
+    // the idom is the nearest ancestor of the parent which is at or above the sdom
+    idom[0] = 0;
+    FOREACH_N(w, 1, count) {
+        int d = parent[w];
+        while (d > semi[w]) d = idom[d];
+        idom[w] = d;
     }
 
-    // if it's still undefined it's unreachable but for now we'll make
-    // it map to the entrypoint to avoid array bounds issues and such
-    FOREACH_N(i, 1, f->bb_count){
-        if (doms[i] == -1) doms[i] = 0;
+    // entrypoint dominates itself, unreachable blocks map to it too so
+    // nobody goes out of bounds walking the chains.
+    FOREACH_N(i, 0, bb_count) doms[i] = 0;
+    FOREACH_N(w, 1, count) {
+        doms[vertex[w]] = vertex[idom[w]];
     }
 
-    return f->bb_count;
+    tb_tls_restore(tls, mark);
+    return bb_count;
 }
 
 TB_API bool tb_is_dominated_by(TB_Label* doms, TB_Label expected_dom, TB_Label bb) {
@@ -271,54 +366,349 @@ TB_API bool tb_is_dominated_by(TB_Label* doms, TB_Label expected_dom, TB_Label b
     return (expected_dom == bb);
 }
 
+// Natural loops: a back edge is p -> h where h dominates p, loops are keyed on
+// their header so every back edge into it makes up one loop and the body is all
+// the blocks which can reach a back edge without going through the header. We go
+// over the headers in dominator tree preorder so enclosing loops always come
+// first and the parent is just the innermost loop the header has been put in.
 TB_API TB_LoopInfo tb_get_loop_info(TB_Function* f, TB_Predeccesors preds, TB_Label* doms) {
-    // Find loops
+    size_t bb_count = f->bb_count;
+    TB_TemporaryStorage* tls = tb_tls_steal();
+    void* mark = tb_tls_mark(tls);
+
+    int* kids_start = tb_tls_push(tls, (bb_count + 1) * sizeof(int));
+    TB_Label* kids = tb_tls_push(tls, bb_count * sizeof(TB_Label));
+    int* pre = tb_tls_push(tls, bb_count * sizeof(int));
+    int* post = tb_tls_push(tls, bb_count * sizeof(int));
+    TB_Label* order = tb_tls_push(tls, bb_count * sizeof(TB_Label));
+    number_dom_tree(f, tls, doms, kids_start, kids, pre, post, order);
+
+    #define DOMINATES(a, b) (pre[a] <= pre[b] && post[b] <= post[a])
+
+    // in_loop and exit_mark are stamped with the loop index so we never
+    // have to clear them between loops.
+    int* innermost = tb_tls_push(tls, bb_count * sizeof(int));
+    int* in_loop = tb_tls_push(tls, bb_count * sizeof(int));
+    int* exit_mark = tb_tls_push(tls, bb_count * sizeof(int));
+    FOREACH_N(i, 0, bb_count) {
+        innermost[i] = in_loop[i] = exit_mark[i] = -1;
+    }
+
+    TB_Label* body = tb_tls_push(tls, bb_count * sizeof(TB_Label));
+    TB_Label* exits = tb_tls_push(tls, bb_count * sizeof(TB_Label));
+    TB_Label* stack = tb_tls_push(tls, bb_count * sizeof(TB_Label));
+
     DynArray(TB_Loop) loops = dyn_array_create(TB_Loop, 64);
-    FOREACH_N(bb, 0, f->bb_count) {
-        TB_Label backedge = 0;
-        FOREACH_N(j, 0, preds.count[bb]) {
-            if (tb_is_dominated_by(doms, bb, preds.preds[bb][j])) {
-                backedge = preds.preds[bb][j];
-                break;
+    FOREACH_N(i, 0, bb_count) {
+        TB_Label h = order[i];
+        ptrdiff_t index = dyn_array_length(loops);
+
+        // an IF with both edges going to the header shows up twice but
+        // they're right next to each other.
+        TB_Label* backedges = tb_tls_push(tls, preds.count[h] * sizeof(TB_Label));
+        size_t backedge_count = 0;
+        FOREACH_N(j, 0, preds.count[h]) {
+            TB_Label p = preds.preds[h][j];
+
+            if (DOMINATES(h, p) && (backedge_count == 0 || backedges[backedge_count - 1] != p)) {
+                backedges[backedge_count++] = p;
             }
         }
 
-        if (backedge) {
-            printf("L%zu is a loop (backedge: L%d)\n    ", bb, backedge);
+        if (backedge_count == 0) {
+            tb_tls_restore(tls, backedges);
+            continue;
+        }
+
+        // walk backwards from the back edges, the header is marked up front
+        // so we never go past it.
+        size_t body_count = 0, top = 0;
+        in_loop[h] = index;
+        body[body_count++] = h;
+
+        FOREACH_N(j, 0, backedge_count) {
+            TB_Label p = backedges[j];
+            if (in_loop[p] != index) {
+                in_loop[p] = index;
+                body[body_count++] = p;
+                stack[top++] = p;
+            }
+        }
 
-            TB_Loop l = { .parent_loop = -1, .header = bb, .backedge = backedge };
-            l.body = tb_platform_heap_alloc(f->bb_count * sizeof(TB_Label));
+        while (top > 0) {
+            TB_Label b = stack[--top];
 
-            FOREACH_N(j, 0, f->bb_count) {
-                if (tb_is_dominated_by(doms, bb, j)) {
-                    printf("L%zu ", j);
+            FOREACH_N(j, 0, preds.count[b]) {
+                TB_Label p = preds.preds[b][j];
 
-                    l.body[l.body_count++] = j;
+                // anything the header doesn't dominate is either unreachable or
+                // another way into the loop (irreducible), neither is part of it.
+                if (in_loop[p] != index && DOMINATES(h, p)) {
+                    in_loop[p] = index;
+                    body[body_count++] = p;
+                    stack[top++] = p;
                 }
             }
+        }
 
-            l.body = tb_platform_heap_realloc(l.body, l.body_count * sizeof(TB_Label));
+        size_t exit_count = 0;
+        FOREACH_N(j, 0, body_count) {
+            TB_Label b = body[j];
 
-            // check if we have a parent...
-            FOREACH_REVERSE_N(o, 0, dyn_array_length(loops)) {
-                FOREACH_N(j, 0, loops[o].body_count) {
-                    if (bb == loops[o].body[j]) {
-                        l.parent_loop = o;
-                        goto fatherfull_behavior;
-                    }
+            int succ_count = successor_count(f, b);
+            FOREACH_N(k, 0, succ_count) {
+                TB_Label s = successor_at(f, b, k);
+
+                if (in_loop[s] != index && exit_mark[s] != index) {
+                    exit_mark[s] = index;
+                    exits[exit_count++] = s;
                 }
             }
+        }
+
+        // the preheader is the only edge into the loop and it can't go
+        // anywhere else.
+        TB_Label preheader = -1;
+        int entry_count = 0;
+        FOREACH_N(j, 0, preds.count[h]) {
+            TB_Label p = preds.preds[h][j];
+
+            if (in_loop[p] != index) {
+                preheader = p;
+                entry_count += 1;
+            }
+        }
 
-            fatherfull_behavior:
-            dyn_array_put(loops, l);
+        if (entry_count != 1 || successor_count(f, preheader) != 1) {
+            preheader = -1;
+        }
 
-            printf("\n\n");
+        TB_Loop l = {
+            .parent_loop = innermost[h],
+            .header = h,
+            .backedge = backedges[0],
+            .preheader = preheader,
+            .body_count = body_count,
+            .backedge_count = backedge_count,
+            .exit_count = exit_count,
+        };
+
+        FOREACH_N(j, 0, body_count) {
+            innermost[body[j]] = index;
         }
+
+        // one allocation for the lists, it's owned by body
+        l.body = tb_platform_heap_alloc((body_count + backedge_count + exit_count) * sizeof(TB_Label));
+        l.backedges = l.body + body_count;
+        l.exits = l.backedges + backedge_count;
+
+        memcpy(l.body, body, body_count * sizeof(TB_Label));
+        memcpy(l.backedges, backedges, backedge_count * sizeof(TB_Label));
+        memcpy(l.exits, exits, exit_count * sizeof(TB_Label));
+        dyn_array_put(loops, l);
+
+        tb_tls_restore(tls, backedges);
     }
 
+    #undef DOMINATES
+    tb_tls_restore(tls, mark);
     return (TB_LoopInfo){ .count = dyn_array_length(loops), .loops = &loops[0] };
 }
 
 TB_API void tb_free_loop_info(TB_LoopInfo l) {
+    // the backedges and exits share the body's allocation
+    FOREACH_N(i, 0, l.count) {
+        tb_platform_heap_free(l.loops[i].body);
+    }
+
     dyn_array_destroy(l.loops);
 }
+
+////////////////////////////////
+// Cached analysis
+////////////////////////////////
+// walks the successors of bb in the same order tb_calculate_immediate_predeccessors
+// would find them, either counting the edges or filling in the pred lists.
+static void pred_edges(TB_Function* f, TB_Predeccesors* p, TB_Label bb, bool fill) {
+    // Empty BB
+    if (f->bbs[bb].end == 0) return;
+
+    // the entry label never gets predecessors
+    #define EDGE(l) do {                                   \
+        TB_Label l_ = (l);                                 \
+        if (l_ != 0) {                                     \
+            if (fill) p->preds[l_][p->count[l_]] = bb;     \
+            p->count[l_] += 1;                             \
+        }                                                  \
+    } while (0)
+
+    TB_Node* end = &f->nodes[f->bbs[bb].end];
+    switch (end->type) {
+        case TB_IF:
+        EDGE(end->if_.if_true);
+        EDGE(end->if_.if_false);
+        break;
+
+        case TB_GOTO:
+        EDGE(end->goto_.label);
+        break;
+
+        case TB_SWITCH: {
+            size_t entry_count = (end->switch_.entries_end - end->switch_.entries_start) / 2;
+            TB_SwitchEntry* entries = (TB_SwitchEntry*) &f->vla.data[end->switch_.entries_start];
+
+            FOREACH_N(i, 0, entry_count) {
+                EDGE(entries[i].value);
+            }
+
+            EDGE(end->switch_.default_label);
+            break;
+        }
+        // these blocks have no successors
+        case TB_UNREACHABLE: case TB_RET: case TB_TRAP: break;
+        default: tb_todo();
+    }
+
+    #undef EDGE
+}
+
+// same result as tb_get_predeccesors but it's linear (one walk over the
+// terminators to count and one to fill) and it's all one allocation for the
+// lists, preds[0] is the start of it since the entry has no predecessors.
+static TB_Predeccesors compute_preds(TB_Function* f) {
+    size_t bb_count = f->bb_count;
+
+    TB_Predeccesors p;
+    p.preds = tb_platform_heap_alloc(bb_count * (sizeof(TB_Label*) + sizeof(int)));
+    p.count = (int*) &p.preds[bb_count];
+    memset(p.count, 0, bb_count * sizeof(int));
+
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        pred_edges(f, &p, bb, false);
+    }
+
+    size_t total = 0;
+    FOREACH_N(i, 0, bb_count) {
+        total += p.count[i];
+    }
+
+    TB_Label* pool = tb_platform_heap_alloc((total ? total : 1) * sizeof(TB_Label));
+    FOREACH_N(i, 0, bb_count) {
+        p.preds[i] = pool;
+        pool += p.count[i];
+        p.count[i] = 0;
+    }
+
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        pred_edges(f, &p, bb, true);
+    }
+
+    return p;
+}
+
+static void check_analysis(TB_Function* f) {
+    // new blocks means none of it can be right
+    if (f->analysis.valid && f->analysis.bb_count != f->bb_count) {
+        tb_function_invalidate_analysis(f, TB_ANALYSIS_ALL);
+    }
+
+    f->analysis.bb_count = f->bb_count;
+}
+
+TB_API TB_Predeccesors tb_function_get_predeccesors(TB_Function* f) {
+    check_analysis(f);
+
+    if ((f->analysis.valid & TB_ANALYSIS_PREDS) == 0) {
+        f->analysis.preds = compute_preds(f);
+        f->analysis.valid |= TB_ANALYSIS_PREDS;
+    }
+
+    return f->analysis.preds;
+}
+
+static void build_dom_tree(TB_Function* f, TB_DomTree* t, TB_Predeccesors preds) {
+    size_t bb_count = f->bb_count;
+
+    // one allocation for all of it, everything is int sized
+    int* mem = tb_platform_heap_alloc((7 * bb_count + 1) * sizeof(int));
+    t->idom            = mem;
+    t->kids_start      = mem + bb_count;
+    t->kids            = mem + 2*bb_count + 1;
+    t->pre             = mem + 3*bb_count + 1;
+    t->post            = mem + 4*bb_count + 1;
+    t->postorder       = mem + 5*bb_count + 1;
+    t->postorder_index = mem + 6*bb_count + 1;
+
+    tb_get_dominators(f, preds, t->idom);
+
+    TB_TemporaryStorage* tls = tb_tls_steal();
+    void* mark = tb_tls_mark(tls);
+    number_dom_tree(f, tls, t->idom, t->kids_start, t->kids, t->pre, t->post, NULL);
+
+    // CFG postorder (the DFS wants a few more arrays we don't keep)
+    int* dfnum = tb_tls_push(tls, bb_count * sizeof(int));
+    TB_Label* vertex = tb_tls_push(tls, bb_count * sizeof(TB_Label));
+    int* parent = tb_tls_push(tls, bb_count * sizeof(int));
+    t->postorder_count = dfs_walk(f, tls, dfnum, vertex, parent, t->postorder);
+
+    FOREACH_N(i, 0, bb_count) t->postorder_index[i] = -1;
+    FOREACH_N(i, 0, t->postorder_count) t->postorder_index[t->postorder[i]] = i;
+
+    tb_tls_restore(tls, mark);
+}
+
+TB_API const TB_DomTree* tb_function_get_dom_tree(TB_Function* f) {
+    TB_Predeccesors preds = tb_function_get_predeccesors(f);
+
+    if ((f->analysis.valid & TB_ANALYSIS_DOMS) == 0) {
+        build_dom_tree(f, &f->analysis.doms, preds);
+        f->analysis.valid |= TB_ANALYSIS_DOMS;
+    }
+
+    return &f->analysis.doms;
+}
+
+TB_API TB_Label* tb_function_get_dominators(TB_Function* f) {
+    return tb_function_get_dom_tree(f)->idom;
+}
+
+TB_API bool tb_function_dominates(TB_Function* f, TB_Label expected_dom, TB_Label bb) {
+    const TB_DomTree* t = tb_function_get_dom_tree(f);
+    return t->pre[expected_dom] <= t->pre[bb] && t->post[bb] <= t->post[expected_dom];
+}
+
+TB_API const TB_LoopInfo* tb_function_get_loop_info(TB_Function* f) {
+    TB_Label* doms = tb_function_get_dominators(f);
+
+    if ((f->analysis.valid & TB_ANALYSIS_LOOPS) == 0) {
+        f->analysis.loops = tb_get_loop_info(f, f->analysis.preds, doms);
+        f->analysis.valid |= TB_ANALYSIS_LOOPS;
+    }
+
+    return &f->analysis.loops;
+}
+
+TB_API void tb_function_invalidate_analysis(TB_Function* f, TB_AnalysisFlags flags) {
+    // anything derived from a dropped analysis goes with it
+    if (flags & TB_ANALYSIS_PREDS) flags |= TB_ANALYSIS_DOMS;
+    if (flags & TB_ANALYSIS_DOMS) flags |= TB_ANALYSIS_LOOPS;
+    flags &= f->analysis.valid;
+
+    if (flags & TB_ANALYSIS_LOOPS) {
+        tb_free_loop_info(f->analysis.loops);
+        f->analysis.loops = (TB_LoopInfo){ 0 };
+    }
+
+    if (flags & TB_ANALYSIS_DOMS) {
+        tb_platform_heap_free(f->analysis.doms.idom);
+        f->analysis.doms = (TB_DomTree){ 0 };
+    }
+
+    if (flags & TB_ANALYSIS_PREDS) {
+        tb_platform_heap_free(f->analysis.preds.preds[0]);
+        tb_platform_heap_free(f->analysis.preds.preds);
+        f->analysis.preds = (TB_Predeccesors){ 0 };
+    }
+
+    f->analysis.valid &= ~flags;
+}
@@ -0,0 +1,344 @@
+// Persistent arena allocator
+//
+// Each module owns its own arena so they can be created, compiled and destroyed
+// independently. Every thread slot of the module has its own segment which it
+// bumps out of, no locks and nothing shared on the hot path. Segments are carved
+// out of reserves using an atomic add on the reserve's cursor and once a reserve
+// fills up someone swaps in a new one twice the size. Segments grow the same way
+// per thread, a module that only ever makes a couple of functions won't get past
+// the first few. Freeing is just unmapping the reserves.
+#include "tb_internal.h"
+
+// segments are committed separately so they need to be page aligned, 64KiB
+// covers the allocation granularity on every platform we care about.
+#define ARENA_CARVE_ALIGN (64 * 1024)
+
+// the header lives on the heap so the reserve itself is all segments
+struct TB_ArenaReserve {
+    TB_ArenaReserve* next;
+    uint8_t* base;
+    size_t capacity;
+
+    // where the next segment is carved from
+    tb_atomic_size_t used;
+};
+
+static TB_ArenaReserve* new_reserve(TB_ArenaReserve* prev, size_t min_size) {
+    size_t capacity = ARENA_INITIAL_RESERVE_SIZE;
+    if (prev != NULL) {
+        capacity = prev->capacity * 2;
+        if (capacity > ARENA_RESERVE_SIZE) capacity = ARENA_RESERVE_SIZE;
+    }
+    while (capacity < min_size) capacity *= 2;
+
+    TB_ArenaReserve* r = tb_platform_heap_alloc(sizeof(TB_ArenaReserve));
+    r->base = tb_platform_vreserve(capacity);
+    if (r->base == NULL) {
+        tb_panic("tb__arena_alloc: Out of memory!");
+    }
+
+    r->next = prev;
+    r->capacity = capacity;
+    r->used = 0;
+    return r;
+}
+
+static void free_reserve(TB_ArenaReserve* r) {
+    tb_platform_vfree(r->base, r->capacity);
+    tb_platform_heap_free(r);
+}
+
+static void* arena_carve(TB_Module* m, size_t size) {
+    size = align_up(size, ARENA_CARVE_ALIGN);
+
+    for (;;) {
+        TB_ArenaReserve* r = tb_atomic_ptr_load((void**) &m->arena_reserves);
+        if (r != NULL) {
+            size_t pos = tb_atomic_size_add(&r->used, size);
+            if (pos + size <= r->capacity) {
+                uint8_t* ptr = r->base + pos;
+                if (!tb_platform_vcommit(ptr, size)) {
+                    tb_panic("tb__arena_alloc: Out of memory!");
+                }
+
+                return ptr;
+            }
+        }
+
+        // it's full (or missing), if someone else beats us to putting a new
+        // reserve in we'll just toss ours and carve from theirs.
+        TB_ArenaReserve* new_r = new_reserve(r, size);
+        if (!tb_atomic_ptr_cmpxchg((void**) &m->arena_reserves, r, new_r)) {
+            free_reserve(new_r);
+        }
+    }
+}
+
+static void* arena_bump(TB_Module* m, size_t size, size_t align) {
+    int tid = tb__get_module_tid(m);
+    struct TB_ThreadInfo* info = &m->thread_info[tid];
+    uint8_t** top = &info->arena_top;
+    uint8_t** end = &info->arena_end;
+
+    uint8_t* ptr = (uint8_t*) align_up((uintptr_t) *top, align);
+    if (*top == NULL || ptr > *end || (size_t) (*end - ptr) < size) {
+        // big allocations get their own piece, no point in throwing
+        // away the rest of the current segment for them.
+        if (size > ARENA_SEGMENT_SIZE / 4) {
+            return arena_carve(m, size);
+        }
+
+        size_t segment_size = info->arena_segment_size;
+        if (segment_size == 0) segment_size = ARENA_CARVE_ALIGN;
+        while (segment_size < size) segment_size *= 2;
+        info->arena_segment_size = segment_size < ARENA_SEGMENT_SIZE ? segment_size * 2 : ARENA_SEGMENT_SIZE;
+
+        ptr = arena_carve(m, segment_size);
+        *end = ptr + segment_size;
+    }
+
+    *top = ptr + size;
+    return ptr;
+}
+
+void* tb__arena_alloc(TB_Module* m, size_t size) {
+    return arena_bump(m, size, _Alignof(max_align_t));
+}
+
+////////////////////////////////
+// String interning
+////////////////////////////////
+// Names live in a 4-way hash trie, each entry picks one of its children with the
+// next two bits of the hash. There's no table to size up front or resize later,
+// an empty module is just a NULL root and every insert is a single CAS into an
+// empty child slot so it's all lock-free. Entries live in the persistent arena
+// so pointers are stable and every copy of a name in a module is the same pointer.
+struct TB_InternEntry {
+    TB_InternEntry* child[4];
+    uint32_t hash;
+    uint32_t length;
+    char data[];
+};
+
+static uint32_t intern_hash(size_t len, const char* str) {
+    // FNV-1a
+    uint32_t h = 0x811C9DC5;
+    FOREACH_N(i, 0, len) {
+        h = (h ^ (uint8_t) str[i]) * 0x01000193;
+    }
+    return h;
+}
+
+static bool intern_match(TB_InternEntry* e, uint32_t hash, size_t len, const char* str) {
+    return e->hash == hash && e->length == len && memcmp(e->data, str, len) == 0;
+}
+
+void tb__intern_init(TB_Module* m) {
+    m->intern_root = NULL;
+}
+
+char* tb__intern(TB_Module* m, const char* str) {
+    size_t len = strlen(str);
+    assert(len == (uint32_t) len);
+
+    uint32_t hash = intern_hash(len, str);
+    TB_InternEntry* new_e = NULL;
+
+    // once we run out of hash bits it just keeps going down child[0], that's
+    // only gonna happen for full collisions so it's fine.
+    TB_InternEntry** slot = &m->intern_root;
+    for (uint32_t h = hash;; h <<= 2) {
+        TB_InternEntry* e = tb_atomic_ptr_load((void**) slot);
+        if (e == NULL) {
+            if (new_e == NULL) {
+                new_e = arena_bump(m, sizeof(TB_InternEntry) + len + 1, _Alignof(TB_InternEntry));
+                memset(new_e->child, 0, sizeof(new_e->child));
+                new_e->hash = hash;
+                new_e->length = len;
+                memcpy(new_e->data, str, len);
+                new_e->data[len] = '\0';
+            }
+
+            if (tb_atomic_ptr_cmpxchg((void**) slot, NULL, new_e)) {
+                return new_e->data;
+            }
+
+            // someone else filled the slot first, if it's our string then
+            // our entry is just wasted space in the arena.
+            e = tb_atomic_ptr_load((void**) slot);
+        }
+
+        if (intern_match(e, hash, len, str)) return e->data;
+        slot = &e->child[h >> 30];
+    }
+}
+
+char* tb__intern_find(TB_Module* m, const char* str) {
+    size_t len = strlen(str);
+    uint32_t hash = intern_hash(len, str);
+
+    TB_InternEntry* e = tb_atomic_ptr_load((void**) &m->intern_root);
+    for (uint32_t h = hash; e != NULL; h <<= 2) {
+        if (intern_match(e, hash, len, str)) return e->data;
+        e = tb_atomic_ptr_load((void**) &e->child[h >> 30]);
+    }
+
+    return NULL;
+}
+
+void tb__arena_free(TB_Module* m) {
+    TB_ArenaReserve* r = tb_atomic_ptr_exchange((void**) &m->arena_reserves, NULL);
+    while (r != NULL) {
+        TB_ArenaReserve* next = r->next;
+        free_reserve(r);
+        r = next;
+    }
+
+    FOREACH_N(i, 0, m->max_threads) {
+        m->thread_info[i].arena_top = m->thread_info[i].arena_end = NULL;
+        m->thread_info[i].arena_segment_size = 0;
+    }
+}
+
+////////////////////////////////
+// IR arenas
+////////////////////////////////
+// All of a function's IR storage comes out of one of these, either a private
+// one made with the function or one shared by a batch of functions. Private
+// arenas are only ever touched by whoever owns the function but the parallel
+// optimizer and compiler can hand functions from the same shared arena to
+// different workers so allocations out of a shared one take its lock.
+typedef struct TB_IRChunk {
+    struct TB_IRChunk* prev;
+    size_t size, used;
+
+    alignas(16) uint8_t data[];
+} TB_IRChunk;
+
+struct TB_IRArena {
+    size_t chunk_size;
+    TB_IRChunk* top;
+
+    // the newest allocation can be grown in place
+    void* last;
+
+    // only used for shared arenas, see tb__ir_alloc
+    tb_atomic_int lock;
+};
+
+static TB_IRChunk* ir_chunk_create(TB_IRChunk* prev, size_t size) {
+    TB_IRChunk* c = tb_platform_heap_alloc(sizeof(TB_IRChunk) + size);
+    if (c == NULL) tb_panic("tb_ir_arena: Out of memory!");
+
+    c->prev = prev;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+TB_API TB_IRArena* tb_ir_arena_create(size_t chunk_size) {
+    if (chunk_size == 0) chunk_size = IR_ARENA_CHUNK_SIZE;
+
+    TB_IRArena* arena = tb_platform_heap_alloc(sizeof(TB_IRArena));
+    arena->chunk_size = chunk_size;
+    arena->top = ir_chunk_create(NULL, chunk_size);
+    arena->last = NULL;
+    arena->lock = 0;
+    return arena;
+}
+
+TB_API void tb_ir_arena_reset(TB_IRArena* arena) {
+    // keep the first chunk around, it's probably gonna get used again
+    TB_IRChunk* c = arena->top;
+    while (c->prev != NULL) {
+        TB_IRChunk* prev = c->prev;
+        tb_platform_heap_free(c);
+        c = prev;
+    }
+
+    c->used = 0;
+    arena->top = c;
+    arena->last = NULL;
+}
+
+TB_API void tb_ir_arena_destroy(TB_IRArena* arena) {
+    TB_IRChunk* c = arena->top;
+    while (c != NULL) {
+        TB_IRChunk* prev = c->prev;
+        tb_platform_heap_free(c);
+        c = prev;
+    }
+
+    tb_platform_heap_free(arena);
+}
+
+static void* ir_arena_alloc(TB_IRArena* arena, size_t size) {
+    size = align_up(size, 16);
+
+    TB_IRChunk* c = arena->top;
+    if (c->size - c->used < size) {
+        // grow the chunks as we go so big functions don't end up
+        // with a massive chain of them.
+        size_t chunk_size = c->size * 2;
+        if (chunk_size < arena->chunk_size) chunk_size = arena->chunk_size;
+        if (chunk_size > IR_ARENA_MAX_CHUNK_SIZE) chunk_size = IR_ARENA_MAX_CHUNK_SIZE;
+        if (chunk_size < size) chunk_size = size;
+
+        arena->top = c = ir_chunk_create(c, chunk_size);
+    }
+
+    void* ptr = &c->data[c->used];
+    c->used += size;
+
+    arena->last = ptr;
+    return ptr;
+}
+
+void* tb__ir_alloc(TB_Function* f, size_t size) {
+    TB_IRArena* arena = f->arena;
+    if (f->owns_arena) return ir_arena_alloc(arena, size);
+
+    tb__spin_lock(&arena->lock);
+    void* ptr = ir_arena_alloc(arena, size);
+    tb__spin_unlock(&arena->lock);
+    return ptr;
+}
+
+void* tb__ir_realloc(TB_Function* f, void* ptr, size_t old_size, size_t new_size) {
+    if (ptr == NULL) return tb__ir_alloc(f, new_size);
+
+    TB_IRArena* arena = f->arena;
+    if (!f->owns_arena) tb__spin_lock(&arena->lock);
+
+    // if it's the last thing we allocated we can just bump the end
+    TB_IRChunk* c = arena->top;
+    void* new_ptr;
+    if (ptr == arena->last && (uint8_t*) ptr - c->data + new_size <= c->size) {
+        c->used = ((uint8_t*) ptr - c->data) + align_up(new_size, 16);
+        new_ptr = ptr;
+    } else {
+        // the old space is dead until the arena is reset, the copy can happen
+        // outside of the lock since nobody else can see either block.
+        new_ptr = ir_arena_alloc(arena, new_size);
+    }
+
+    if (!f->owns_arena) tb__spin_unlock(&arena->lock);
+
+    if (new_ptr != ptr) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return new_ptr;
+}
+
+////////////////////////////////
+// Spin locks
+////////////////////////////////
+void tb__spin_lock(tb_atomic_int* lock) {
+    while (!tb_atomic_int_cmpxchg(lock, 0, 1)) {
+        tb_platform_thread_yield();
+    }
+}
+
+void tb__spin_unlock(tb_atomic_int* lock) {
+    tb_atomic_int_store(lock, 0);
+}
@@ -19,6 +19,10 @@ int tb_atomic_int_store(int* dst, int src) {
     return InterlockedExchange((long*)dst, src);
 }
 
+bool tb_atomic_int_cmpxchg(int* dst, int old_value, int new_value) {
+    return InterlockedCompareExchange((long*)dst, new_value, old_value) == old_value;
+}
+
 size_t tb_atomic_size_load(size_t* dst) {
     return InterlockedOr64((LONG64*)dst, 0);
 }
@@ -31,12 +35,20 @@ size_t tb_atomic_size_store(size_t* dst, size_t src) {
     return InterlockedExchange64((LONG64*)dst, src);
 }
 
+bool tb_atomic_size_cmpxchg(size_t* dst, size_t old_value, size_t new_value) {
+    return InterlockedCompareExchange64((LONG64*)dst, new_value, old_value) == old_value;
+}
+
+void* tb_atomic_ptr_load(void** address) {
+    return _InterlockedCompareExchangePointer(address, NULL, NULL);
+}
+
 void* tb_atomic_ptr_exchange(void** address, void* new_value) {
     return _InterlockedExchangePointer(address, new_value);
 }
 
 bool tb_atomic_ptr_cmpxchg(void** address, void* old_value, void* new_value) {
-    return _InterlockedCompareExchangePointer(address, new_value, old_value) == new_value;
+    return _InterlockedCompareExchangePointer(address, new_value, old_value) == old_value;
 }
 #elif __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
 #include <stdatomic.h>
@@ -55,6 +67,10 @@ int tb_atomic_int_store(int* dst, int src) {
     return atomic_exchange((atomic_int*) dst, src);
 }
 
+bool tb_atomic_int_cmpxchg(int* dst, int old_value, int new_value) {
+    return atomic_compare_exchange_strong((atomic_int*) dst, &old_value, new_value);
+}
+
 size_t tb_atomic_size_load(size_t* dst) {
     return atomic_load((atomic_size_t*) dst);
 }
@@ -67,6 +83,14 @@ size_t tb_atomic_size_store(size_t* dst, size_t src) {
     return atomic_exchange((atomic_size_t*) dst, src);
 }
 
+bool tb_atomic_size_cmpxchg(size_t* dst, size_t old_value, size_t new_value) {
+    return atomic_compare_exchange_strong((atomic_size_t*) dst, &old_value, new_value);
+}
+
+void* tb_atomic_ptr_load(void** address) {
+    return atomic_load((_Atomic(void*)*) address);
+}
+
 void* tb_atomic_ptr_exchange(void** address, void* new_value) {
     return atomic_exchange((_Atomic(void*)*) address, new_value);
 }
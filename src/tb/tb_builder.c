@@ -120,14 +120,8 @@ TB_API bool tb_node_is_constant_zero(TB_Function* f, TB_Reg r) {
 }
 
 static TB_Attrib* tb_make_attrib(TB_Function* f) {
-    if (f->attrib_pool_count + 1 >= f->attrib_pool_capacity) {
-        f->attrib_pool_capacity = (f->attrib_pool_count + 1) * 2;
-
-        f->attrib_pool = tb_platform_heap_realloc(f->attrib_pool, sizeof(TB_Attrib) * f->attrib_pool_capacity);
-        if (!f->attrib_pool) tb_panic("Out of memory");
-    }
-
-    return &f->attrib_pool[f->attrib_pool_count++];
+    // they're linked together by pointer so they can't move
+    return tb__ir_alloc(f, sizeof(TB_Attrib));
 }
 
 static void append_attrib(TB_Function* f, TB_Reg r, TB_Attrib* a) {
@@ -147,7 +141,7 @@ TB_API void tb_function_attrib_variable(TB_Function* f, TB_Reg r, const char* na
     assert(type != NULL);
 
     TB_Attrib* a = tb_make_attrib(f);
-    *a = (TB_Attrib) { .type = TB_ATTRIB_VARIABLE, .var = { tb_platform_string_alloc(name), type } };
+    *a = (TB_Attrib) { .type = TB_ATTRIB_VARIABLE, .var = { tb__intern(f->super.module, name), type } };
     append_attrib(f, r, a);
 }
 
@@ -155,6 +149,9 @@ static TB_Reg tb_make_reg(TB_Function* f, int type, TB_DataType dt) {
     // Cannot add registers to terminated basic blocks, except labels
     // which start new basic blocks
     tb_assume(f);
+
+    // whatever we made last is filled in by now so it can go into the def-use index
+    if (f->uses != NULL) tb__uses_sync(f);
     tb_function_reserve_nodes(f, 1);
 
     TB_Reg r = f->node_count++;
@@ -475,7 +472,7 @@ TB_API TB_Reg tb_inst_float64(TB_Function* f, double imm) {
 }
 
 TB_API TB_Reg tb_inst_string(TB_Function* f, size_t len, const char* str) {
-    char* newstr = tb_platform_arena_alloc(len);
+    char* newstr = tb__arena_alloc(f->super.module, len);
     memcpy(newstr, str, len);
 
     TB_Reg r = tb_make_reg(f, TB_STRING_CONST, TB_TYPE_PTR);
@@ -485,7 +482,7 @@ TB_API TB_Reg tb_inst_string(TB_Function* f, size_t len, const char* str) {
 
 TB_API TB_Reg tb_inst_cstring(TB_Function* f, const char* str) {
     size_t len = strlen(str);
-    char* newstr = tb_platform_arena_alloc(len + 1);
+    char* newstr = tb__arena_alloc(f->super.module, len + 1);
     memcpy(newstr, str, len);
     newstr[len] = '\0';
 
@@ -520,10 +517,11 @@ TB_API TB_Reg tb_inst_get_symbol_address(TB_Function* f, const TB_Symbol* target
 TB_Reg* tb_vla_reserve(TB_Function* f, size_t count) {
     // Reserve space for the arguments
     if (f->vla.count + count >= f->vla.capacity) {
+        size_t old_capacity = f->vla.capacity;
         f->vla.capacity = tb_next_pow2(f->vla.count + count);
         if (f->vla.capacity < 16) f->vla.capacity = 16;
 
-        f->vla.data = tb_platform_heap_realloc(f->vla.data, f->vla.capacity * sizeof(TB_Reg));
+        f->vla.data = tb__ir_realloc(f, f->vla.data, old_capacity * sizeof(TB_Reg), f->vla.capacity * sizeof(TB_Reg));
     }
 
     return &f->vla.data[f->vla.count];
@@ -1011,10 +1009,10 @@ TB_API TB_Reg tb_inst_phi2(TB_Function* f, TB_Label a_label, TB_Reg a, TB_Label
 
 TB_API TB_Label tb_basic_block_create(TB_Function* f) {
     if (f->bb_count + 1 >= f->bb_capacity) {
+        size_t old_capacity = f->bb_capacity;
         f->bb_capacity = (f->bb_count + 1) * 2;
 
-        f->bbs = tb_platform_heap_realloc(f->bbs, sizeof(TB_BasicBlock) * f->bb_capacity);
-        if (f->bbs == NULL) tb_panic("tb_basic_block_create: Out of memory");
+        f->bbs = tb__ir_realloc(f, f->bbs, sizeof(TB_BasicBlock) * old_capacity, sizeof(TB_BasicBlock) * f->bb_capacity);
     }
 
     TB_Label bb = f->bb_count++;
@@ -0,0 +1,161 @@
+// Call graph + SCCs
+//
+// only direct calls between the functions we're given count as edges, calls
+// through pointers or out to externals don't show up. The SCCs are what the
+// bottom-up walks (call graph passes and the inliner) are scheduled around,
+// recursion can only happen inside of one.
+#include "tb_internal.h"
+#include "hash_map.h"
+
+typedef NL_Map(TB_Function*, size_t) FunctionIndex;
+
+static void build_edges(TB_CallGraph* cg) {
+    size_t n = cg->func_count;
+
+    FunctionIndex index = NULL;
+    FOREACH_N(i, 0, n) {
+        nl_map_put(index, cg->funcs[i], i);
+    }
+    cg->index = index;
+
+    // seen[j] == i means we've already got the i -> j edge
+    size_t* seen = tb_platform_heap_alloc(n * sizeof(size_t));
+    FOREACH_N(i, 0, n) seen[i] = SIZE_MAX;
+
+    cg->callees = tb_platform_heap_alloc(n * sizeof(DynArray(size_t)));
+    cg->callers = tb_platform_heap_alloc(n * sizeof(DynArray(size_t)));
+    memset(cg->callees, 0, n * sizeof(DynArray(size_t)));
+    memset(cg->callers, 0, n * sizeof(DynArray(size_t)));
+
+    FOREACH_N(i, 0, n) {
+        TB_Function* f = cg->funcs[i];
+
+        TB_FOR_BASIC_BLOCK(bb, f) {
+            TB_FOR_NODE(r, f, bb) {
+                TB_Node* restrict call = &f->nodes[r];
+                if (call->type != TB_CALL || call->call.target->tag != TB_SYMBOL_FUNCTION) continue;
+
+                size_t j = tb_call_graph_find(cg, (TB_Function*) call->call.target);
+                if (j == SIZE_MAX || seen[j] == i) continue;
+
+                seen[j] = i;
+                dyn_array_put(cg->callees[i], j);
+                dyn_array_put(cg->callers[j], i);
+            }
+        }
+    }
+
+    tb_platform_heap_free(seen);
+}
+
+typedef struct {
+    size_t f, edge;
+} TarjanFrame;
+
+// Tarjan's SCC but with an explicit stack since call chains can be deep, it
+// produces the SCCs callees first which is the bottom-up order we want.
+static void find_sccs(TB_CallGraph* cg) {
+    size_t n = cg->func_count;
+
+    size_t* index = tb_platform_heap_alloc(n * sizeof(size_t));
+    size_t* low = tb_platform_heap_alloc(n * sizeof(size_t));
+    bool* on_stack = tb_platform_heap_alloc(n * sizeof(bool));
+    size_t* stack = tb_platform_heap_alloc(n * sizeof(size_t));
+    TarjanFrame* frames = tb_platform_heap_alloc(n * sizeof(TarjanFrame));
+
+    FOREACH_N(i, 0, n) index[i] = SIZE_MAX, on_stack[i] = false;
+
+    cg->scc_of = tb_platform_heap_alloc(n * sizeof(size_t));
+    cg->scc_start = tb_platform_heap_alloc((n + 1) * sizeof(size_t));
+    cg->scc_funcs = tb_platform_heap_alloc(n * sizeof(size_t));
+
+    size_t counter = 0, sp = 0, scc_count = 0, out = 0;
+    FOREACH_N(root, 0, n) {
+        if (index[root] != SIZE_MAX) continue;
+
+        size_t depth = 0;
+        frames[depth++] = (TarjanFrame){ root, 0 };
+        index[root] = low[root] = counter++;
+        stack[sp++] = root, on_stack[root] = true;
+
+        while (depth) {
+            TarjanFrame* top = &frames[depth - 1];
+            size_t v = top->f;
+
+            if (top->edge < dyn_array_length(cg->callees[v])) {
+                size_t u = cg->callees[v][top->edge++];
+
+                if (index[u] == SIZE_MAX) {
+                    index[u] = low[u] = counter++;
+                    stack[sp++] = u, on_stack[u] = true;
+                    frames[depth++] = (TarjanFrame){ u, 0 };
+                } else if (on_stack[u] && index[u] < low[v]) {
+                    low[v] = index[u];
+                }
+                continue;
+            }
+
+            // we're done with v, if it's the root of an SCC pop it off
+            if (low[v] == index[v]) {
+                cg->scc_start[scc_count] = out;
+
+                size_t u;
+                do {
+                    u = stack[--sp];
+                    on_stack[u] = false;
+
+                    cg->scc_of[u] = scc_count;
+                    cg->scc_funcs[out++] = u;
+                } while (u != v);
+
+                scc_count += 1;
+            }
+
+            depth -= 1;
+            if (depth) {
+                size_t parent = frames[depth - 1].f;
+                if (low[v] < low[parent]) low[parent] = low[v];
+            }
+        }
+    }
+
+    cg->scc_start[scc_count] = out;
+    cg->scc_count = scc_count;
+
+    tb_platform_heap_free(frames);
+    tb_platform_heap_free(stack);
+    tb_platform_heap_free(on_stack);
+    tb_platform_heap_free(low);
+    tb_platform_heap_free(index);
+}
+
+TB_CallGraph tb_build_call_graph(size_t func_count, TB_Function** funcs) {
+    TB_CallGraph cg = { .func_count = func_count, .funcs = funcs };
+    build_edges(&cg);
+    find_sccs(&cg);
+    return cg;
+}
+
+void tb_free_call_graph(TB_CallGraph* cg) {
+    FOREACH_N(i, 0, cg->func_count) {
+        dyn_array_destroy(cg->callees[i]);
+        dyn_array_destroy(cg->callers[i]);
+    }
+
+    FunctionIndex index = cg->index;
+    nl_map_free(index);
+
+    tb_platform_heap_free(cg->callees);
+    tb_platform_heap_free(cg->callers);
+    tb_platform_heap_free(cg->scc_of);
+    tb_platform_heap_free(cg->scc_start);
+    tb_platform_heap_free(cg->scc_funcs);
+    *cg = (TB_CallGraph){ 0 };
+}
+
+size_t tb_call_graph_find(const TB_CallGraph* cg, TB_Function* f) {
+    FunctionIndex index = cg->index;
+
+    ptrdiff_t search = nl_map_get(index, f);
+    return search >= 0 ? index[search].v : SIZE_MAX;
+}
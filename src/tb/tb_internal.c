@@ -1,240 +1,437 @@
 #include "tb_internal.h"
 
 // IR ANALYSIS
-void tb_function_calculate_use_count(const TB_Function* f, int use_count[]) {
-    for (size_t i = 0; i < f->node_count; i++) {
-        use_count[i] = 0;
+////////////////////////////////
+// Def-use index
+////////////////////////////////
+// entries are handed out of heap blocks (which double in size up to
+// USE_BLOCK_SIZE) and recycled through a free list, they don't come from the
+// IR arena because that would keep breaking the node array's in-place growth.
+#define USE_BLOCK_SIZE 1024
+
+struct TB_UseBlock {
+    TB_UseBlock* next;
+    size_t count;
+    TB_Use entries[];
+};
+
+static void add_use(TB_Function* f, TB_Reg def, TB_Reg user) {
+    TB_Use* u = f->free_uses;
+    if (u == NULL) {
+        size_t count = f->use_blocks ? f->use_blocks->count * 2 : 32;
+        if (count > USE_BLOCK_SIZE) count = USE_BLOCK_SIZE;
+
+        TB_UseBlock* block = tb_platform_heap_alloc(sizeof(TB_UseBlock) + count * sizeof(TB_Use));
+        block->next = f->use_blocks;
+        block->count = count;
+        f->use_blocks = block;
+
+        FOREACH_N(i, 1, count) {
+            block->entries[i].next = i + 1 < count ? &block->entries[i + 1] : NULL;
+        }
+        f->free_uses = &block->entries[1];
+        u = &block->entries[0];
+    } else {
+        f->free_uses = u->next;
     }
 
-    TB_FOR_BASIC_BLOCK(bb, f) {
-        TB_FOR_NODE(r, f, bb) {
-            TB_Node* n = &f->nodes[r];
+    u->user = user;
+    u->next = f->uses[def].first;
+    f->uses[def].first = u;
+    f->uses[def].count += 1;
+}
 
-            TB_FOR_INPUT_IN_NODE(it, f, n) {
-                use_count[it.r] += 1;
-            }
+// unlike tb__uses_kill this actually takes the entry out, user is still
+// around so it wouldn't get filtered out later.
+static void remove_use(TB_Function* f, TB_Reg def, TB_Reg user) {
+    TB_UseList* list = &f->uses[def];
+    for (TB_Use** prev = &list->first; *prev != NULL; prev = &(*prev)->next) {
+        TB_Use* u = *prev;
+        if (u->user == user) {
+            *prev = u->next;
+            u->next = f->free_uses;
+            f->free_uses = u;
+            list->count -= 1;
+            return;
         }
     }
+
+    tb_panic("remove_use: r%d isn't registered as a user of r%d\n", user, def);
 }
 
-int tb_function_find_uses_of_node(const TB_Function* f, TB_Reg def, TB_Reg uses[]) {
-    size_t count = 0;
+void tb__uses_sync(TB_Function* f) {
+    if (f->uses_capacity < f->node_count) {
+        size_t new_cap = f->node_capacity;
+        f->uses = tb_platform_heap_realloc(f->uses, new_cap * sizeof(TB_UseList));
+        memset(&f->uses[f->uses_capacity], 0, (new_cap - f->uses_capacity) * sizeof(TB_UseList));
+        f->uses_capacity = new_cap;
+    }
 
-    TB_FOR_BASIC_BLOCK(bb, f) {
-        TB_FOR_NODE(r, f, bb) {
-            TB_Node* n = &f->nodes[r];
+    for (TB_Reg r = f->uses_synced; r < f->node_count; r++) {
+        TB_Node* n = &f->nodes[r];
 
-            TB_FOR_INPUT_IN_NODE(it, f, n) {
-                if (it.r == def) uses[count++] = r;
-            }
+        TB_FOR_INPUT_IN_NODE(it, f, n) {
+            add_use(f, it.r, r);
         }
     }
 
-    return count;
+    f->uses_synced = f->node_count;
 }
 
-void tb_function_find_replace_reg(TB_Function* f, TB_Reg find, TB_Reg replace) {
-    #define X(reg) if (reg == find) reg = replace;
-
-    TB_FOR_BASIC_BLOCK(bb, f) {
-        TB_FOR_NODE(r, f, bb) {
-            TB_Node* n = &f->nodes[r];
+void tb_function_build_uses(TB_Function* f) {
+    if (f->uses == NULL) {
+        f->uses_capacity = f->node_capacity;
+        f->uses = tb_platform_heap_alloc(f->uses_capacity * sizeof(TB_UseList));
+        memset(f->uses, 0, f->uses_capacity * sizeof(TB_UseList));
+    }
 
-            switch (n->type) {
-                case TB_NULL:
-                case TB_INTEGER_CONST:
-                case TB_FLOAT32_CONST:
-                case TB_FLOAT64_CONST:
-                case TB_STRING_CONST:
-                case TB_LOCAL:
-                case TB_PARAM:
-                case TB_GOTO:
-                case TB_LINE_INFO:
-                case TB_GET_SYMBOL_ADDRESS:
-                case TB_X86INTRIN_RDTSC:
-                case TB_X86INTRIN_STMXCSR:
-                case TB_UNREACHABLE:
-                case TB_DEBUGBREAK:
-                case TB_TRAP:
-                case TB_POISON:
-                break;
+    tb__uses_sync(f);
+}
 
-                case TB_INITIALIZE:
-                X(n->init.addr);
-                break;
+void tb_function_free_uses(TB_Function* f) {
+    TB_UseBlock* block = f->use_blocks;
+    while (block != NULL) {
+        TB_UseBlock* next = block->next;
+        tb_platform_heap_free(block);
+        block = next;
+    }
 
-                case TB_KEEPALIVE:
-                case TB_VA_START:
-                case TB_NOT:
-                case TB_NEG:
-                case TB_X86INTRIN_SQRT:
-                case TB_X86INTRIN_RSQRT:
-                case TB_INT2PTR:
-                case TB_PTR2INT:
-                case TB_UINT2FLOAT:
-                case TB_FLOAT2UINT:
-                case TB_INT2FLOAT:
-                case TB_FLOAT2INT:
-                case TB_TRUNCATE:
-                case TB_X86INTRIN_LDMXCSR:
-                case TB_BITCAST:
-                case TB_CLZ:
-                X(n->unary.src);
-                break;
+    tb_platform_heap_free(f->uses);
+    f->uses = NULL;
+    f->uses_synced = f->uses_capacity = 0;
+    f->free_uses = NULL;
+    f->use_blocks = NULL;
+}
 
-                case TB_ATOMIC_LOAD:
-                case TB_ATOMIC_XCHG:
-                case TB_ATOMIC_ADD:
-                case TB_ATOMIC_SUB:
-                case TB_ATOMIC_AND:
-                case TB_ATOMIC_XOR:
-                case TB_ATOMIC_OR:
-                case TB_ATOMIC_CMPXCHG:
-                X(n->atomic.addr);
-                X(n->atomic.src);
-                break;
+void tb__uses_kill(TB_Function* f, TB_Reg r) {
+    // if it's not registered yet then there's nothing to undo, the entries
+    // themselves are reclaimed lazily once someone walks the list.
+    if (r >= f->uses_synced) return;
 
-                case TB_ATOMIC_CMPXCHG2:
-                X(n->atomic.src);
-                break;
+    TB_Node* n = &f->nodes[r];
+    TB_FOR_INPUT_IN_NODE(it, f, n) {
+        f->uses[it.r].count -= 1;
+    }
+}
 
-                case TB_MEMCPY:
-                case TB_MEMSET:
-                X(n->mem_op.dst);
-                X(n->mem_op.src);
-                X(n->mem_op.size);
-                break;
+void tb__uses_update(TB_Function* f, TB_Reg r, const TB_Node* old) {
+    if (r >= f->uses_synced) return;
 
-                case TB_MEMBER_ACCESS:
-                X(n->member_access.base);
-                break;
+    // r might refer to new nodes now so those need slots (and their own
+    // operands registered) first.
+    tb__uses_sync(f);
 
-                case TB_ARRAY_ACCESS:
-                X(n->array_access.base);
-                X(n->array_access.index);
-                break;
+    // the input iterator goes by register so the old version gets swapped
+    // in for a moment
+    TB_Node* n = &f->nodes[r];
+    TB_Node curr = *n;
+    *n = *old;
+    TB_FOR_INPUT_IN_NODE(it, f, n) {
+        remove_use(f, it.r, r);
+    }
 
-                case TB_PARAM_ADDR:
-                X(n->param_addr.param);
-                break;
+    *n = curr;
+    TB_FOR_INPUT_IN_NODE(it, f, n) {
+        add_use(f, it.r, r);
+    }
+}
 
-                case TB_PASS:
-                X(n->pass.value);
-                break;
+int tb_function_use_count(TB_Function* f, TB_Reg r) {
+    if (f->uses != NULL) {
+        tb__uses_sync(f);
+        return f->uses[r].count;
+    }
 
-                case TB_PHI1:
-                X(n->phi1.inputs[0].val);
-                break;
+    int count = 0;
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(user, f, bb) {
+            TB_Node* n = &f->nodes[user];
 
-                case TB_PHI2:
-                FOREACH_N(it, 0, 2) {
-                    X(n->phi2.inputs[it].val);
-                }
-                break;
+            TB_FOR_INPUT_IN_NODE(it, f, n) {
+                count += (it.r == r);
+            }
+        }
+    }
 
-                case TB_PHIN:
-                FOREACH_N(it, 0, n->phi.count) {
-                    X(n->phi.inputs[it].val);
-                }
-                break;
+    return count;
+}
 
-                case TB_LOAD:
-                X(n->load.address);
-                break;
+void tb_function_calculate_use_count(TB_Function* f, int use_count[]) {
+    tb_function_build_uses(f);
+    FOREACH_N(i, 0, f->node_count) {
+        use_count[i] = f->uses[i].count;
+    }
+}
 
-                case TB_STORE:
-                X(n->store.address);
-                X(n->store.value);
-                break;
+int tb_function_find_uses_of_node(TB_Function* f, TB_Reg def, TB_Reg uses[]) {
+    size_t count = 0;
 
-                case TB_ZERO_EXT:
-                case TB_SIGN_EXT:
-                case TB_FLOAT_EXT:
-                X(n->unary.src);
-                break;
+    if (f->uses != NULL) {
+        tb__uses_sync(f);
 
-                case TB_AND:
-                case TB_OR:
-                case TB_XOR:
-                case TB_ADD:
-                case TB_SUB:
-                case TB_MUL:
-                case TB_UDIV:
-                case TB_SDIV:
-                case TB_UMOD:
-                case TB_SMOD:
-                case TB_SAR:
-                case TB_SHL:
-                case TB_SHR:
-                X(n->i_arith.a);
-                X(n->i_arith.b);
-                break;
+        for (TB_Use* u = f->uses[def].first; u != NULL; u = u->next) {
+            if (f->nodes[u->user].type != TB_NULL) uses[count++] = u->user;
+        }
 
-                case TB_FADD:
-                case TB_FSUB:
-                case TB_FMUL:
-                case TB_FDIV:
-                X(n->f_arith.a);
-                X(n->f_arith.b);
-                break;
+        return count;
+    }
 
-                case TB_CMP_EQ:
-                case TB_CMP_NE:
-                case TB_CMP_SLT:
-                case TB_CMP_SLE:
-                case TB_CMP_ULT:
-                case TB_CMP_ULE:
-                case TB_CMP_FLT:
-                case TB_CMP_FLE:
-                X(n->cmp.a);
-                X(n->cmp.b);
-                break;
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(r, f, bb) {
+            TB_Node* n = &f->nodes[r];
 
-                case TB_SCALL: {
-                    X(n->scall.target);
+            TB_FOR_INPUT_IN_NODE(it, f, n) {
+                if (it.r == def) uses[count++] = r;
+            }
+        }
+    }
 
-                    FOREACH_N(it, n->scall.param_start, n->scall.param_end) {
-                        X(f->vla.data[it]);
-                    }
-                    break;
-                }
+    return count;
+}
 
-                case TB_VCALL: {
-                    X(n->vcall.target);
+// if map isn't NULL every operand goes through it, otherwise it's just find -> replace
+static void rewrite_inputs(TB_Function* f, TB_Node* n, TB_Reg find, TB_Reg replace, const TB_Reg* map) {
+    #define X(reg) do { if (map != NULL) reg = map[reg]; else if (reg == find) reg = replace; } while (0)
+
+    switch (n->type) {
+        case TB_NULL:
+        case TB_INTEGER_CONST:
+        case TB_FLOAT32_CONST:
+        case TB_FLOAT64_CONST:
+        case TB_STRING_CONST:
+        case TB_LOCAL:
+        case TB_PARAM:
+        case TB_GOTO:
+        case TB_LINE_INFO:
+        case TB_GET_SYMBOL_ADDRESS:
+        case TB_X86INTRIN_RDTSC:
+        case TB_X86INTRIN_STMXCSR:
+        case TB_UNREACHABLE:
+        case TB_DEBUGBREAK:
+        case TB_TRAP:
+        case TB_POISON:
+        break;
+
+        case TB_INITIALIZE:
+        X(n->init.addr);
+        break;
+
+        case TB_KEEPALIVE:
+        case TB_VA_START:
+        case TB_NOT:
+        case TB_NEG:
+        case TB_X86INTRIN_SQRT:
+        case TB_X86INTRIN_RSQRT:
+        case TB_INT2PTR:
+        case TB_PTR2INT:
+        case TB_UINT2FLOAT:
+        case TB_FLOAT2UINT:
+        case TB_INT2FLOAT:
+        case TB_FLOAT2INT:
+        case TB_TRUNCATE:
+        case TB_X86INTRIN_LDMXCSR:
+        case TB_BITCAST:
+        case TB_CLZ:
+        X(n->unary.src);
+        break;
+
+        case TB_ATOMIC_LOAD:
+        case TB_ATOMIC_XCHG:
+        case TB_ATOMIC_ADD:
+        case TB_ATOMIC_SUB:
+        case TB_ATOMIC_AND:
+        case TB_ATOMIC_XOR:
+        case TB_ATOMIC_OR:
+        case TB_ATOMIC_CMPXCHG:
+        X(n->atomic.addr);
+        X(n->atomic.src);
+        break;
+
+        case TB_ATOMIC_CMPXCHG2:
+        X(n->atomic.src);
+        break;
+
+        case TB_MEMCPY:
+        case TB_MEMSET:
+        X(n->mem_op.dst);
+        X(n->mem_op.src);
+        X(n->mem_op.size);
+        break;
+
+        case TB_MEMBER_ACCESS:
+        X(n->member_access.base);
+        break;
+
+        case TB_ARRAY_ACCESS:
+        X(n->array_access.base);
+        X(n->array_access.index);
+        break;
+
+        case TB_PARAM_ADDR:
+        X(n->param_addr.param);
+        break;
+
+        case TB_PASS:
+        X(n->pass.value);
+        break;
+
+        case TB_PHI1:
+        X(n->phi1.inputs[0].val);
+        break;
+
+        case TB_PHI2:
+        FOREACH_N(it, 0, 2) {
+            X(n->phi2.inputs[it].val);
+        }
+        break;
 
-                    FOREACH_N(it, n->vcall.param_start, n->vcall.param_end) {
-                        X(f->vla.data[it]);
-                    }
-                    break;
-                }
+        case TB_PHIN:
+        FOREACH_N(it, 0, n->phi.count) {
+            X(n->phi.inputs[it].val);
+        }
+        break;
+
+        case TB_LOAD:
+        X(n->load.address);
+        break;
+
+        case TB_STORE:
+        X(n->store.address);
+        X(n->store.value);
+        break;
+
+        case TB_ZERO_EXT:
+        case TB_SIGN_EXT:
+        case TB_FLOAT_EXT:
+        X(n->unary.src);
+        break;
+
+        case TB_AND:
+        case TB_OR:
+        case TB_XOR:
+        case TB_ADD:
+        case TB_SUB:
+        case TB_MUL:
+        case TB_UDIV:
+        case TB_SDIV:
+        case TB_UMOD:
+        case TB_SMOD:
+        case TB_SAR:
+        case TB_SHL:
+        case TB_SHR:
+        X(n->i_arith.a);
+        X(n->i_arith.b);
+        break;
+
+        case TB_FADD:
+        case TB_FSUB:
+        case TB_FMUL:
+        case TB_FDIV:
+        X(n->f_arith.a);
+        X(n->f_arith.b);
+        break;
+
+        case TB_CMP_EQ:
+        case TB_CMP_NE:
+        case TB_CMP_SLT:
+        case TB_CMP_SLE:
+        case TB_CMP_ULT:
+        case TB_CMP_ULE:
+        case TB_CMP_FLT:
+        case TB_CMP_FLE:
+        X(n->cmp.a);
+        X(n->cmp.b);
+        break;
+
+        case TB_SCALL: {
+            X(n->scall.target);
+
+            FOREACH_N(it, n->scall.param_start, n->scall.param_end) {
+                X(f->vla.data[it]);
+            }
+            break;
+        }
 
-                case TB_CALL:
-                case TB_ICALL: {
-                    FOREACH_N(it, n->call.param_start, n->call.param_end) {
-                        X(f->vla.data[it]);
-                    }
-                    break;
-                }
+        case TB_VCALL: {
+            X(n->vcall.target);
 
-                case TB_SWITCH: X(n->switch_.key); break;
-                case TB_IF: X(n->if_.cond); break;
-                case TB_RET: X(n->ret.value); break;
+            FOREACH_N(it, n->vcall.param_start, n->vcall.param_end) {
+                X(f->vla.data[it]);
+            }
+            break;
+        }
 
-                default: tb_todo();
+        case TB_CALL:
+        case TB_ICALL: {
+            FOREACH_N(it, n->call.param_start, n->call.param_end) {
+                X(f->vla.data[it]);
             }
+            break;
         }
 
-        // if it matches find, then remove find from the basic block
-        if (f->bbs[bb].start == find) {
-            f->bbs[bb].start = f->nodes[f->bbs[bb].start].next;
+        case TB_SWITCH: X(n->switch_.key); break;
+        case TB_IF: X(n->if_.cond); break;
+        case TB_RET: X(n->ret.value); break;
+
+        default: tb_todo();
+    }
+
+    #undef X
+}
+
+void tb_function_find_replace_reg(TB_Function* f, TB_Label bb, TB_Reg find, TB_Reg replace) {
+    if (f->uses != NULL) {
+        tb__uses_sync(f);
+
+        // move the entries over to replace as we go, dead users are dropped
+        // here (their counts were already taken care of by tb__uses_kill).
+        TB_UseList* list = &f->uses[find];
+        TB_UseList* dst = &f->uses[replace];
+
+        TB_Use* u = list->first;
+        while (u != NULL) {
+            TB_Use* next = u->next;
+            TB_Node* n = &f->nodes[u->user];
+
+            if (n->type != TB_NULL) {
+                rewrite_inputs(f, n, find, replace, NULL);
+
+                u->next = dst->first;
+                dst->first = u;
+            } else {
+                u->next = f->free_uses;
+                f->free_uses = u;
+            }
+
+            u = next;
         }
 
-        if (f->bbs[bb].end == find) {
-            f->bbs[bb].end = tb_node_get_previous(f, f->bbs[bb].end);
+        dst->count += list->count;
+        list->first = NULL;
+        list->count = 0;
+    } else {
+        TB_FOR_BASIC_BLOCK(bb, f) {
+            TB_FOR_NODE(r, f, bb) {
+                rewrite_inputs(f, &f->nodes[r], find, replace, NULL);
+            }
         }
     }
 
-    #undef X
+    // if it matches find, then remove find from the basic block. find can only
+    // be a boundary of the block it lives in so there's no need to look at the rest.
+    if (f->bbs[bb].start == find) {
+        f->bbs[bb].start = f->nodes[find].next;
+    }
+
+    if (f->bbs[bb].end == find) {
+        TB_Reg prev = 0;
+        TB_FOR_NODE(r, f, bb) {
+            if (r == find) break;
+            prev = r;
+        }
+
+        f->bbs[bb].end = prev;
+    }
 }
 
 TB_Label tb_find_label_from_reg(TB_Function* f, TB_Reg target) {
@@ -314,14 +511,284 @@ TB_Reg tb_function_insert_after(TB_Function* f, TB_Label bb, TB_Reg at) {
     return r;
 }
 
-// NOTE(NeGate): Any previous TB_Reg you have saved locally,
-// update them or at least shift over all the indices based on `at`
-//
-// TODO(NeGate): Move this out of this file once it's relevant
-// TODO(NeGate): Implement multiple return statements, VLA insertion, and proper labels
-TB_Reg tb_insert_copy_ops(TB_Function* f, const TB_Reg* params, TB_Reg at, const TB_Function* src_func, TB_Reg src_base, int count) {
-    tb_panic("TODO: implement tb_insert_copy_ops");
-    return 0;
+// opens up count empty blocks right after `after`, everything past it moves
+// down and all the branches and phis pointing at them get fixed up. this keeps
+// the labels in an order the fast isel is happy with (definitions before uses).
+static void insert_blocks_after(TB_Function* f, TB_Label after, size_t count) {
+    size_t old_count = f->bb_count;
+    FOREACH_N(i, 0, count) tb_basic_block_create(f);
+
+    memmove(&f->bbs[after + 1 + count], &f->bbs[after + 1], (old_count - after - 1) * sizeof(TB_BasicBlock));
+    FOREACH_N(i, after + 1, after + 1 + count) {
+        f->bbs[i] = (TB_BasicBlock){ 0 };
+    }
+
+    #define X(l) do { if ((l) > after) (l) += count; } while (0)
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(r, f, bb) {
+            TB_Node* n = &f->nodes[r];
+            switch (n->type) {
+                case TB_IF: X(n->if_.if_true); X(n->if_.if_false); break;
+                case TB_GOTO: X(n->goto_.label); break;
+                case TB_PHI1: X(n->phi1.inputs[0].label); break;
+                case TB_PHI2: X(n->phi2.inputs[0].label); X(n->phi2.inputs[1].label); break;
+                case TB_PHIN: FOREACH_N(j, 0, n->phi.count) X(n->phi.inputs[j].label); break;
+
+                case TB_SWITCH: {
+                    X(n->switch_.default_label);
+
+                    TB_SwitchEntry* entries = (TB_SwitchEntry*) &f->vla.data[n->switch_.entries_start];
+                    FOREACH_N(j, 0, (n->switch_.entries_end - n->switch_.entries_start) / 2) {
+                        X(entries[j].value);
+                    }
+                    break;
+                }
+
+                default: break;
+            }
+        }
+    }
+
+    X(f->current_label);
+    #undef X
+}
+
+TB_Label tb_insert_copy_ops(TB_Function* f, TB_Label bb, TB_Reg call, const TB_Function* src_func) {
+    assert(f != src_func && f->uses == NULL);
+    assert(f->nodes[call].type == TB_CALL || f->nodes[call].type == TB_ICALL);
+
+    TB_TemporaryStorage* tls = tb_tls_allocate();
+    void* mark = tb_tls_mark(tls);
+
+    // the VLA can move once we start copying calls over
+    TB_Node* call_node = &f->nodes[call];
+    size_t param_count = call_node->call.param_end - call_node->call.param_start;
+    TB_Reg* params = tb_tls_push(tls, param_count * sizeof(TB_Reg));
+    memcpy(params, &f->vla.data[call_node->call.param_start], param_count * sizeof(TB_Reg));
+
+    TB_DataType dt = call_node->dt;
+
+    // split bb right before the call, the call stays at the top of the new
+    // block since it's about to become the return value.
+    TB_Reg prev = 0;
+    TB_FOR_NODE(r, f, bb) {
+        if (r == call) break;
+        prev = r;
+    }
+
+    // the callee's blocks go right after bb and then cont
+    insert_blocks_after(f, bb, src_func->bb_count + 1);
+
+    TB_Label* labels = tb_tls_push(tls, src_func->bb_count * sizeof(TB_Label));
+    FOREACH_N(i, 0, src_func->bb_count) {
+        labels[i] = bb + 1 + i;
+    }
+
+    TB_Label cont = bb + 1 + src_func->bb_count;
+    f->bbs[cont] = (TB_BasicBlock){ call, f->bbs[bb].end };
+
+    // the terminator moved so phis which came from bb come from cont now
+    TB_FOR_BASIC_BLOCK(i, f) {
+        TB_FOR_NODE(r, f, i) {
+            if (!tb_node_is_phi_node(f, r)) continue;
+
+            int width = tb_node_get_phi_width(f, r);
+            TB_PhiInput* inputs = tb_node_get_phi_inputs(f, r);
+            FOREACH_N(j, 0, width) {
+                if (inputs[j].label == bb) inputs[j].label = cont;
+            }
+        }
+    }
+
+    // params are just the arguments, everything else gets a fresh node.
+    // PARAM_ADDR turns into a local + a store of the argument so it takes two.
+    TB_Reg* map = tb_tls_push(tls, src_func->node_count * sizeof(TB_Reg));
+    memset(map, 0, src_func->node_count * sizeof(TB_Reg));
+
+    size_t count = 1, ret_count = 0;
+    FOREACH_N(i, 0, src_func->bb_count) {
+        TB_FOR_NODE(r, src_func, i) {
+            TB_NodeTypeEnum t = src_func->nodes[r].type;
+
+            if (t == TB_PARAM) {
+                map[r] = params[src_func->nodes[r].param.id];
+            } else if (t != TB_NULL) {
+                count += (t == TB_PARAM_ADDR ? 2 : 1);
+                ret_count += (t == TB_RET);
+            }
+        }
+    }
+
+    tb_function_reserve_nodes(f, count);
+
+    TB_Reg entry_goto = f->node_count++;
+    f->nodes[entry_goto] = (TB_Node){ .type = TB_GOTO, .dt = TB_TYPE_VOID, .goto_ = { labels[0] } };
+    if (prev == 0) {
+        f->bbs[bb].start = entry_goto;
+    } else {
+        f->nodes[prev].next = entry_goto;
+    }
+    f->bbs[bb].end = entry_goto;
+
+    FOREACH_N(i, 0, src_func->bb_count) {
+        TB_FOR_NODE(r, src_func, i) {
+            TB_NodeTypeEnum t = src_func->nodes[r].type;
+            if (t == TB_PARAM || t == TB_NULL) continue;
+
+            map[r] = f->node_count;
+            f->node_count += (t == TB_PARAM_ADDR ? 2 : 1);
+        }
+    }
+
+    TB_PhiInput* rets = tb_tls_push(tls, ret_count * sizeof(TB_PhiInput));
+    size_t ret_i = 0;
+
+    FOREACH_N(i, 0, src_func->bb_count) {
+        TB_Label dst_bb = labels[i];
+
+        TB_Reg last = 0;
+        TB_FOR_NODE(r, src_func, i) {
+            const TB_Node* n = &src_func->nodes[r];
+            if (n->type == TB_PARAM || n->type == TB_NULL) continue;
+
+            TB_Reg new_r = map[r];
+            TB_Node* dst = &f->nodes[new_r];
+            *dst = *n;
+            dst->next = 0;
+            dst->first_attrib = NULL;
+
+            switch (n->type) {
+                case TB_CALL:
+                case TB_ICALL:
+                case TB_SCALL:
+                case TB_VCALL: {
+                    // all the calls share the param range layout
+                    int start = f->vla.count, len = n->call.param_end - n->call.param_start;
+
+                    TB_Reg* vla = tb_vla_reserve(f, len);
+                    memcpy(vla, &src_func->vla.data[n->call.param_start], len * sizeof(TB_Reg));
+                    f->vla.count += len;
+
+                    dst->call.param_start = start;
+                    dst->call.param_end = start + len;
+                    break;
+                }
+
+                case TB_SWITCH: {
+                    int start = f->vla.count, len = n->switch_.entries_end - n->switch_.entries_start;
+
+                    TB_Reg* vla = tb_vla_reserve(f, len);
+                    memcpy(vla, &src_func->vla.data[n->switch_.entries_start], len * sizeof(TB_Reg));
+                    f->vla.count += len;
+
+                    TB_SwitchEntry* entries = (TB_SwitchEntry*) vla;
+                    FOREACH_N(j, 0, len / 2) {
+                        entries[j].value = labels[entries[j].value];
+                    }
+
+                    dst->switch_.default_label = labels[n->switch_.default_label];
+                    dst->switch_.entries_start = start;
+                    dst->switch_.entries_end = start + len;
+                    break;
+                }
+
+                case TB_IF:
+                dst->if_.if_true = labels[n->if_.if_true];
+                dst->if_.if_false = labels[n->if_.if_false];
+                break;
+
+                case TB_GOTO:
+                dst->goto_.label = labels[n->goto_.label];
+                break;
+
+                case TB_PHI1:
+                dst->phi1.inputs[0].label = labels[n->phi1.inputs[0].label];
+                break;
+
+                case TB_PHI2:
+                dst->phi2.inputs[0].label = labels[n->phi2.inputs[0].label];
+                dst->phi2.inputs[1].label = labels[n->phi2.inputs[1].label];
+                break;
+
+                case TB_PHIN: {
+                    TB_PhiInput* inputs = tb__ir_alloc(f, n->phi.count * sizeof(TB_PhiInput));
+                    FOREACH_N(j, 0, n->phi.count) {
+                        inputs[j] = (TB_PhiInput){ labels[n->phi.inputs[j].label], n->phi.inputs[j].val };
+                    }
+
+                    dst->phi.inputs = inputs;
+                    break;
+                }
+
+                case TB_INTEGER_CONST:
+                if (n->integer.num_words > 1) {
+                    uint64_t* words = tb__ir_alloc(f, n->integer.num_words * sizeof(uint64_t));
+                    memcpy(words, n->integer.words, n->integer.num_words * sizeof(uint64_t));
+                    dst->integer.words = words;
+                }
+                break;
+
+                case TB_PARAM_ADDR: {
+                    // the callee's copy of the param is just a local now
+                    const TB_Node* param = &src_func->nodes[n->param_addr.param];
+                    TB_CharUnits size = n->param_addr.size, align = n->param_addr.alignment;
+
+                    *dst = (TB_Node){ .type = TB_LOCAL, .dt = TB_TYPE_PTR, .next = new_r + 1, .local = { size, align } };
+                    f->nodes[new_r + 1] = (TB_Node){
+                        .type = TB_STORE,
+                        .dt = param->dt,
+                        .store = { .address = new_r, .value = params[param->param.id], .alignment = align },
+                    };
+                    break;
+                }
+
+                case TB_RET:
+                rets[ret_i++] = (TB_PhiInput){ dst_bb, n->ret.value };
+                *dst = (TB_Node){ .type = TB_GOTO, .dt = TB_TYPE_VOID, .goto_ = { cont } };
+                break;
+
+                case TB_VA_START:
+                tb_panic("tb_insert_copy_ops: can't copy a variadic function");
+                break;
+
+                default: break;
+            }
+
+            rewrite_inputs(f, dst, TB_NULL_REG, TB_NULL_REG, map);
+
+            if (last == 0) {
+                f->bbs[dst_bb].start = new_r;
+            } else {
+                f->nodes[last].next = new_r;
+            }
+            last = (n->type == TB_PARAM_ADDR ? new_r + 1 : new_r);
+        }
+
+        f->bbs[dst_bb].end = last;
+    }
+
+    // the call turns into the return value
+    TB_Reg ret_value = ret_count == 1 ? map[rets[0].val] : TB_NULL_REG;
+    if (TB_IS_VOID_TYPE(dt)) {
+        f->nodes[call].type = TB_NULL;
+    } else if (ret_count == 1 && ret_value != TB_NULL_REG) {
+        tb_function_find_replace_reg(f, cont, call, ret_value);
+        f->nodes[call].type = TB_NULL;
+    } else if (ret_count > 1) {
+        TB_PhiInput* inputs = tb__ir_alloc(f, ret_count * sizeof(TB_PhiInput));
+        FOREACH_N(i, 0, ret_count) {
+            inputs[i] = (TB_PhiInput){ rets[i].label, map[rets[i].val] };
+        }
+
+        f->nodes[call].type = TB_PHIN;
+        f->nodes[call].phi = (struct TB_NodePhi){ .count = ret_count, .inputs = inputs };
+    } else {
+        // never returns, anything after the call is dead anyways
+        f->nodes[call].type = TB_POISON;
+    }
+
+    tb_tls_restore(tls, mark);
+    return cont;
 }
 
 TB_Label* tb_calculate_immediate_predeccessors(TB_Function* f, TB_TemporaryStorage* tls, TB_Label l, int* dst_count) {
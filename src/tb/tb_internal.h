@@ -46,7 +46,7 @@
 #define TB_MAX_THREADS 64
 #endif
 
-// Per-thread
+// Per-thread, it's the first scratch segment's size (it'll grow past it)
 #ifndef TB_TEMPORARY_STORAGE_SIZE
 #define TB_TEMPORARY_STORAGE_SIZE (1 << 20)
 #endif
@@ -65,16 +65,58 @@ typedef size_t tb_atomic_size_t;
 int tb_atomic_int_load(int* dst);
 int tb_atomic_int_add(int* dst, int src);
 int tb_atomic_int_store(int* dst, int src);
+bool tb_atomic_int_cmpxchg(int* dst, int old_value, int new_value);
 
 size_t tb_atomic_size_load(size_t* dst);
 size_t tb_atomic_size_add(size_t* dst, size_t src);
 size_t tb_atomic_size_store(size_t* dst, size_t src);
+bool tb_atomic_size_cmpxchg(size_t* dst, size_t old_value, size_t new_value);
 
+void* tb_atomic_ptr_load(void** address);
 void* tb_atomic_ptr_exchange(void** address, void* new_value);
 bool tb_atomic_ptr_cmpxchg(void** address, void* old_value, void* new_value);
 
-#define PROTOTYPES_ARENA_SIZE   (32u << 20u)
-#define CODE_REGION_BUFFER_SIZE (256 * 1024 * 1024)
+// tiny spin locks for short critical sections, 0 is unlocked
+void tb__spin_lock(tb_atomic_int* lock);
+void tb__spin_unlock(tb_atomic_int* lock);
+
+// code regions reserve address space in big chunks but only commit
+// it in smaller steps as the code gen asks for it.
+#ifndef CODE_REGION_CHUNK_SIZE
+#define CODE_REGION_CHUNK_SIZE  (64 * 1024 * 1024)
+#endif
+
+#ifndef CODE_REGION_COMMIT_SIZE
+#define CODE_REGION_COMMIT_SIZE (256 * 1024)
+#endif
+
+// the persistent arena carves per-thread segments out of shared reserves, both
+// start small and double each time we need a new one (up to the max) so tiny
+// modules don't pay for address space they'll never touch.
+#ifndef ARENA_INITIAL_RESERVE_SIZE
+#define ARENA_INITIAL_RESERVE_SIZE (1024 * 1024)
+#endif
+
+#ifndef ARENA_RESERVE_SIZE
+#define ARENA_RESERVE_SIZE      (256 * 1024 * 1024)
+#endif
+
+#ifndef ARENA_SEGMENT_SIZE
+#define ARENA_SEGMENT_SIZE      (1024 * 1024)
+#endif
+
+// IR arenas start at this size (unless the user picks) and double from there
+#ifndef IR_ARENA_CHUNK_SIZE
+#define IR_ARENA_CHUNK_SIZE     (16 * 1024)
+#endif
+
+#ifndef IR_ARENA_MAX_CHUNK_SIZE
+#define IR_ARENA_MAX_CHUNK_SIZE (16 * 1024 * 1024)
+#endif
+
+typedef struct TB_ArenaReserve TB_ArenaReserve;
+typedef struct TB_InternEntry TB_InternEntry;
+typedef struct TB_PrototypeEntry TB_PrototypeEntry;
 
 typedef struct TB_Emitter {
     size_t capacity, count;
@@ -149,12 +191,13 @@ typedef struct TB_PrototypeParam {
     TB_DebugType* debug_type;
 } TB_PrototypeParam;
 
-// function prototypes are stored
-// in streams as inplace arrays:
+// function prototypes live in the module's persistent arena with
+// the params stored inline:
 //
-// PROTOTYPE0, arg0, arg1, PROTOTYPE1, arg0, arg1
+// PROTOTYPE, arg0, arg1
 struct TB_FunctionPrototype {
     // header
+    TB_Module* module;
     TB_CallingConv call_conv;
 
     short param_capacity;
@@ -303,6 +346,21 @@ typedef struct TB_FunctionOutput {
     DynArray(TB_StackSlot) stack_slots;
 } TB_FunctionOutput;
 
+// def-use index entries, one per operand slot so a node which reads the same
+// value twice shows up twice.
+typedef struct TB_Use TB_Use;
+struct TB_Use {
+    TB_Use* next;
+    TB_Reg user;
+};
+
+typedef struct {
+    TB_Use* first;
+    int count;
+} TB_UseList;
+
+typedef struct TB_UseBlock TB_UseBlock;
+
 struct TB_Function {
     TB_Symbol super;
 
@@ -334,10 +392,31 @@ struct TB_Function {
         TB_Reg* data;
     } vla;
 
-    // Attribute pool
-    size_t attrib_pool_capacity;
-    size_t attrib_pool_count;
-    TB_Attrib* attrib_pool;
+    // all the IR storage (nodes, blocks, VLA, attributes...) comes from here,
+    // if we own it then it's freed with the function, if not it's shared and
+    // allocations from it are locked.
+    TB_IRArena* arena;
+    bool owns_arena;
+
+    // def-use index (NULL when it's been dropped), see tb_function_build_uses.
+    // nodes below uses_synced have had their operands registered, anything
+    // newer (fresh nodes from the builder or insert_before/after) gets picked
+    // up by the next query or the next node the builder makes.
+    TB_UseList* uses;
+    TB_Reg uses_synced, uses_capacity;
+    TB_Use* free_uses;
+    TB_UseBlock* use_blocks;
+
+    // Cached CFG analyses, computed on demand (see tb_function_get_predeccesors)
+    // and heap allocated since they outlive any one pass.
+    struct {
+        TB_AnalysisFlags valid;
+        size_t bb_count;
+
+        TB_Predeccesors preds;
+        TB_DomTree doms;
+        TB_LoopInfo loops;
+    } analysis;
 
     // Part of the debug info
     size_t line_count;
@@ -358,15 +437,45 @@ typedef struct {
     uint32_t pos; // relative to the start of the function
 } TB_LabelSymbol;
 
-typedef struct {
-    size_t capacity, size;
-    uint8_t data[CODE_REGION_BUFFER_SIZE - sizeof(size_t)];
+// each thread has a chain of these, the newest one is where the next function
+// goes. A function's code is always contiguous, if it outgrows the chunk it's
+// moved into a fresh one.
+typedef struct TB_CodeRegion {
+    struct TB_CodeRegion* prev;
+
+    // reserved is the size of the whole mapping (header included),
+    // only the first committed bytes of data are usable.
+    size_t reserved, committed, size;
+    uint8_t data[];
 } TB_CodeRegion;
 
+typedef struct {
+    TB_Symbol *first, *last;
+    size_t count;
+} TB_SymbolShard;
+
+// flat views of the module's symbols for the exporters, within each array the
+// private ones come first then the public ones (both in creation order).
+typedef struct {
+    size_t function_count, private_function_count;
+    TB_Function** functions;
+
+    size_t global_count, private_global_count;
+    TB_Global** globals;
+
+    size_t external_count;
+    TB_External** externals;
+} TB_SymbolArrays;
+
 struct TB_Module {
-    int max_threads;
+    // highest thread slot which has touched this module (+1), anything
+    // past it in thread_info and code_regions is empty.
+    tb_atomic_int max_threads;
     bool is_jit;
 
+    // free the IR once it's compiled
+    bool streaming;
+
     TB_ABI target_abi;
     TB_Arch target_arch;
     TB_System target_system;
@@ -376,24 +485,51 @@ struct TB_Module {
     // of a _tls_index
     TB_Symbol* tls_index_extern;
 
-    // Convert this into a dynamic memory arena... maybe
-    tb_atomic_size_t prototypes_arena_size;
-    uint64_t* prototypes_arena;
+    // persistent arena, everything in here lives until the module is destroyed
+    TB_ArenaReserve* arena_reserves;
+
+    // string interning table (root of a hash trie, see tb_arena.c)
+    TB_InternEntry* intern_root;
+
+    // prototypes made with tb_prototype_get are deduplicated through this, it's
+    // the same kind of trie as the interner
+    TB_PrototypeEntry* prototype_root;
 
     tb_atomic_size_t compiled_function_count;
 
-    // symbol table
-    tb_atomic_size_t symbol_count[TB_SYMBOL_MAX];
+    // symbol table, new symbols go into the creating thread's shard and
+    // only show up in these lists once tb__merge_symbols is called, they're
+    // kept sorted by TB_Symbol.order.
+    tb_atomic_int symbol_merge_lock;
+    tb_atomic_size_t symbol_seq;
+    size_t symbol_count[TB_SYMBOL_MAX];
     TB_Symbol* first_symbol_of_tag[TB_SYMBOL_MAX];
     TB_Symbol* last_symbol_of_tag[TB_SYMBOL_MAX];
 
-    alignas(64) struct {
-        Pool(TB_DebugType) debug_types;
+    // rebuilt by tb_helper_gather_symbols on every export
+    TB_SymbolArrays symbol_arrays;
+
+    // each one gets its own cache line, they're only touched by their own thread
+    struct TB_ThreadInfo {
+        alignas(64) Pool(TB_DebugType) debug_types;
         Pool(TB_Global) globals;
         Pool(TB_External) externals;
 
         DynArray(TB_ConstPoolPatch) const_patches;
         DynArray(TB_SymbolPatch) symbol_patches;
+
+        // persistent arena segment we're bumping out of, the next one we
+        // carve is segment_size big (it grows up to ARENA_SEGMENT_SIZE).
+        uint8_t *arena_top, *arena_end;
+        size_t arena_segment_size;
+
+        // symbols made on this thread which haven't been merged yet, the lock
+        // is held while appending and while a merge steals them.
+        tb_atomic_int symbol_lock;
+        TB_SymbolShard symbols[TB_SYMBOL_MAX];
+
+        // see tb_module_set_symbol_order, 0 means it's not set
+        uint32_t order_key, order_seq;
     } thread_info[TB_MAX_THREADS];
 
     struct {
@@ -411,16 +547,16 @@ struct TB_Module {
     void* jit_region;
     size_t jit_region_size;
 
-    // we need to keep track of these for layout reasons
-    tb_atomic_size_t data_region_size;
-    tb_atomic_size_t rdata_region_size;
-    tb_atomic_size_t tls_region_size;
+    // we need to keep track of these for layout reasons, they're only
+    // valid after tb_helper_layout_data.
+    size_t data_region_size;
+    size_t rdata_region_size;
+    size_t tls_region_size;
 
-    // The code is stored into giant buffers
-    // there's on per code gen thread so that
-    // each can work at the same time without
-    // making any allocations within the code
-    // gen.
+    // The code is stored into chains of big chunks
+    // there's one per code gen thread so that
+    // each can work at the same time, they
+    // grow on demand.
     TB_CodeRegion* code_regions[TB_MAX_THREADS];
 };
 
@@ -429,9 +565,19 @@ typedef struct {
     TB_ObjectSection* data;
 } TB_SectionGroup;
 
+// temporary storage is a chain of segments, each push is contiguous but two
+// pushes aren't necessarily next to each other (if one didn't fit in the
+// segment). segments past the top are kept around for reuse.
+typedef struct TB_TempSegment {
+    struct TB_TempSegment* prev;
+    struct TB_TempSegment* next;
+    size_t capacity, used;
+
+    alignas(16) uint8_t data[];
+} TB_TempSegment;
+
 typedef struct {
-    uint32_t used;
-    uint8_t data[];
+    TB_TempSegment* top;
 } TB_TemporaryStorage;
 
 // the maximum size the prologue and epilogue can be for any machine code impl
@@ -563,11 +709,13 @@ inline static size_t tb_post_inc(size_t* a, size_t b) {
 TB_TemporaryStorage* tb_tls_steal(void);
 TB_TemporaryStorage* tb_tls_allocate(void);
 void* tb_tls_push(TB_TemporaryStorage* store, size_t size);
-void* tb_tls_try_push(TB_TemporaryStorage* store, size_t size);
-void tb_tls_restore(TB_TemporaryStorage* store, void* ptr);
 void* tb_tls_pop(TB_TemporaryStorage* store, size_t size);
 void* tb_tls_peek(TB_TemporaryStorage* store, size_t distance);
-bool tb_tls_can_fit(TB_TemporaryStorage* store, size_t size);
+
+// marks are just positions, restoring to one frees everything pushed after
+// it (even if it spilled into other segments).
+void* tb_tls_mark(TB_TemporaryStorage* store);
+void tb_tls_restore(TB_TemporaryStorage* store, void* ptr);
 
 ICodeGen* tb__find_code_generator(TB_Module* m);
 
@@ -608,22 +756,53 @@ uint32_t tb_get4b(TB_Emitter* o, uint32_t pos);
 ////////////////////////////////
 TB_Label tb_find_label_from_reg(TB_Function* f, TB_Reg target);
 TB_Reg tb_find_first_use(const TB_Function* f, TB_Reg find, size_t start, size_t end);
-void tb_function_find_replace_reg(TB_Function* f, TB_Reg find, TB_Reg replace);
-size_t tb_count_uses(const TB_Function* f, TB_Reg find, size_t start, size_t end);
+// bb is the block find lives in, if find is one of its ends it gets unlinked
+void tb_function_find_replace_reg(TB_Function* f, TB_Label bb, TB_Reg find, TB_Reg replace);
 void tb_function_reserve_nodes(TB_Function* f, size_t extra);
-TB_Reg tb_insert_copy_ops(TB_Function* f, const TB_Reg* params, TB_Reg at, const TB_Function* src_func, TB_Reg src_base, int count);
+
+// Copies all of src_func into f in place of call (which lives in bb), bb is split
+// right before the call and the call turns into the return value. The arguments
+// have to line up with src_func's params and it can't be variadic. Returns the
+// block with whatever came after the call.
+TB_Label tb_insert_copy_ops(TB_Function* f, TB_Label bb, TB_Reg call, const TB_Function* src_func);
+
 TB_Reg tb_function_insert_before(TB_Function* f, TB_Reg at);
 TB_Reg tb_function_insert_after(TB_Function* f, TB_Label bb, TB_Reg at);
 
+// Def-use index: it's made along with the function and the builder registers
+// each node as it goes, while it's around tb_function_find_replace_reg only
+// touches the users of the value and tb_function_use_count is O(1). It stays
+// correct as long as nodes are killed with tb_murder_* and operands are
+// rewritten through find_replace (or tb__uses_update), anything else poking at
+// the operands has to tb_function_free_uses first. The optimizer does that for
+// passes with edits_operands set, tb_function_build_uses brings it back (and
+// is cheap when it's already there).
+void tb_function_build_uses(TB_Function* f);
+void tb_function_free_uses(TB_Function* f);
+int tb_function_use_count(TB_Function* f, TB_Reg r);
+
+// registers any nodes made since the last time, only valid once their operands
+// are filled in.
+void tb__uses_sync(TB_Function* f);
+
+// unregisters the operands of r, it's about to die
+void tb__uses_kill(TB_Function* f, TB_Reg r);
+
+// r's operands were rewritten in place, old is a copy from before that
+void tb__uses_update(TB_Function* f, TB_Reg r, const TB_Node* old);
+
 inline static void tb_murder_node(TB_Function* f, TB_Node* n) {
+    if (f->uses != NULL) tb__uses_kill(f, n - f->nodes);
     n->type = TB_NULL;
 }
 
 inline static void tb_murder_reg(TB_Function* f, TB_Reg r) {
+    if (f->uses != NULL) tb__uses_kill(f, r);
     f->nodes[r].type = TB_NULL;
 }
 
 inline static void tb_kill_op(TB_Function* f, TB_Reg at) {
+    if (f->uses != NULL) tb__uses_kill(f, at);
     f->nodes[at].type = TB_NULL;
 }
 
@@ -694,29 +873,271 @@ size_t tb_helper_write_text_section(size_t write_pos, TB_Module* m, uint8_t* out
 size_t tb_helper_write_data_section(size_t write_pos, TB_Module* m, uint8_t* output, uint32_t pos);
 size_t tb_helper_write_rodata_section(size_t write_pos, TB_Module* m, uint8_t* output, uint32_t pos);
 size_t tb_helper_get_text_section_layout(TB_Module* m, size_t symbol_id_start);
+const TB_SymbolArrays* tb_helper_gather_symbols(TB_Module* m);
+
+// places globals & constants based on the merged symbol order (call it after
+// tb__merge_symbols), codegen doesn't know where anything goes until this point
+// so the output doesn't change based on which thread got there first.
+void tb_helper_layout_data(TB_Module* m);
+void tb_helper_free_symbol_arrays(TB_Module* m);
+
+////////////////////////////////
+// PARALLEL DISPATCH
+////////////////////////////////
+// worker is [0, thread_count), the calling thread always acts as worker 0
+typedef void TB_ParallelTask(void* user_data, size_t i, int worker);
+
+// runs task over [0, count) with work stealing, thread_count <= 0 means
+// use every core. returns once every item has been run.
+void tb__parallel_for(size_t count, int thread_count, TB_ParallelTask* task, void* user_data);
+
+typedef struct TB_Job {
+    // number of unfinished dependencies
+    tb_atomic_int pending;
+    // jobs waiting on this one
+    DynArray(size_t) succ;
+} TB_Job;
+
+// job can't start until dep is done
+void tb__job_depends(TB_Job* jobs, size_t job, size_t dep);
+
+// runs task for every job once its dependencies are done, the graph must be
+// acyclic (it's checked up front and panics otherwise). the successor lists are
+// freed once it's done.
+void tb__run_jobs(size_t count, TB_Job* jobs, int thread_count, TB_ParallelTask* task, void* user_data);
 
 ////////////////////////////////
 // ANALYSIS
 ////////////////////////////////
 int tb__get_local_tid(void);
+
+// same as tb__get_local_tid but it also marks the slot as used by the module,
+// call this before touching m->thread_info or m->code_regions.
+int tb__get_module_tid(TB_Module* m);
+
+// module's persistent arena, used by all the backend worker threads to store
+// data until the module is destroyed. it's freed all at once in tb__arena_free.
+void* tb__arena_alloc(TB_Module* m, size_t size);
+void tb__arena_free(TB_Module* m);
+
+// all the names in a module are interned, equal strings within the same module
+// are the same pointer. tb__intern_find doesn't insert, it's NULL if the string
+// was never interned.
+void tb__intern_init(TB_Module* m);
+char* tb__intern(TB_Module* m, const char* str);
+char* tb__intern_find(TB_Module* m, const char* str);
+
+// function's IR arena, old allocations from tb__ir_realloc aren't freed until
+// the arena is reset (or the function is freed). safe to call for functions
+// sharing an arena from different threads.
+void* tb__ir_alloc(TB_Function* f, size_t size);
+void* tb__ir_realloc(TB_Function* f, void* ptr, size_t old_size, size_t new_size);
 TB_Symbol* tb_symbol_alloc(TB_Module* m, enum TB_SymbolTag tag, const char* name, size_t size);
 void tb_symbol_append(TB_Module* m, TB_Symbol* s);
 
+// splices every thread's symbol shard onto the module's lists (sorted by
+// TB_Symbol.order), anything iterating the symbols needs to call this first.
+// symbols made while it's running just wait for the next merge, the lists stay
+// sorted so it doesn't matter when (or how often) merges happen.
+void tb__merge_symbols(TB_Module* m);
+
 // TODO(NeGate): refactor this stuff such that it starts with two underscores, it makes
 // it more clear that these are TB private
-void tb_function_calculate_use_count(const TB_Function* f, int use_count[]);
-int tb_function_find_uses_of_node(const TB_Function* f, TB_Reg def, TB_Reg uses[]);
+void tb_function_calculate_use_count(TB_Function* f, int use_count[]);
+int tb_function_find_uses_of_node(TB_Function* f, TB_Reg def, TB_Reg uses[]);
 
 // if tls is NULL then the return value is heap allocated
 TB_Label* tb_calculate_immediate_predeccessors(TB_Function* f, TB_TemporaryStorage* tls, TB_Label l, int* dst_count);
 TB_Predeccesors tb_get_temp_predeccesors(TB_Function* f, TB_TemporaryStorage* tls);
 void tb_free_temp_predeccesors(TB_TemporaryStorage* tls, TB_Predeccesors preds);
 
+// fills postorder (bb_count slots) with the reachable blocks, same order as
+// tb_function_get_postorder but iterative and it doesn't touch the analysis
+// cache. returns how many it wrote.
+int tb__get_postorder(TB_Function* f, TB_TemporaryStorage* tls, TB_Label* postorder);
+
+////////////////////////////////
+// Liveness (tb_liveness.c)
+////////////////////////////////
+// positions on the timeline, inclusive on both ends. values which are never
+// used just have start == end at their def.
+typedef struct {
+    int start, end;
+} TB_LiveInterval;
+
+typedef struct {
+    size_t bb_count, node_count;
+
+    // only values which are used outside of their block (or feed a phi) get a
+    // bit, bit[r] is -1 for the rest and values[] maps back.
+    size_t value_count, words;
+    int* bit;
+    TB_Reg* values;
+
+    // [bb * words] rows
+    uint64_t* live_in;
+    uint64_t* live_out;
+
+    // the timeline is every node in block order (same walk as TB_FOR_NODE),
+    // order[r] is -1 for nodes which aren't in a block.
+    size_t timeline_length;
+    int* order;
+    TB_Reg* timeline;
+    int* bb_first;
+    int* bb_last;
+
+    // [node_count]
+    TB_LiveInterval* intervals;
+} TB_Liveness;
+
+TB_Liveness tb_get_liveness(TB_Function* f);
+void tb_free_liveness(TB_Liveness* l);
+
+bool tb_liveness_is_live_in(const TB_Liveness* l, TB_Label bb, TB_Reg r);
+bool tb_liveness_is_live_out(const TB_Liveness* l, TB_Label bb, TB_Reg r);
+
+////////////////////////////////
+// Alias analysis (tb_alias.c)
+////////////////////////////////
+// an address split into the object it points into and how far in,
+// known_offset is false when some array index along the way wasn't constant.
+typedef struct {
+    TB_Reg base;
+    int64_t offset;
+    bool known_offset;
+} TB_MemLoc;
+
+typedef struct {
+    int pointer_size;
+
+    // [node_count] stack objects whose address leaks out of plain accesses
+    bool* escaped;
+} TB_AliasInfo;
+
+TB_MemLoc tb_alias_decompose(TB_Function* f, TB_Reg addr);
+
+// escaped lives in the tls, it's only good until the function changes
+// the way its addresses are used.
+TB_AliasInfo tb_get_alias_info(TB_Function* f, TB_TemporaryStorage* tls);
+
+// in bytes, 0 means unknown
+int tb_alias_access_size(const TB_AliasInfo* ai, TB_DataType dt);
+
+// size of a memcpy/memset given its size operand, 0 if it's not constant
+int tb_alias_mem_op_size(TB_Function* f, TB_Reg size_reg);
+
+// both addresses point to the same byte
+bool tb_alias_must_alias(TB_Function* f, TB_Reg a, TB_Reg b);
+
+// the bytes [a, a+a_size) definitely include all of [b, b+b_size)
+bool tb_alias_must_cover(TB_Function* f, TB_Reg a, int a_size, TB_Reg b, int b_size);
+
+// sizes are in bytes, anything <= 0 is treated as unknown
+bool tb_alias_may_alias(TB_Function* f, const TB_AliasInfo* ai, TB_Reg a, int a_size, TB_Reg b, int b_size);
+
+// true if addr points into a stack object nobody else can see, calls
+// and other threads can't touch it.
+bool tb_alias_is_local_only(TB_Function* f, const TB_AliasInfo* ai, TB_Reg addr);
+
+////////////////////////////////
+// Memory SSA (tb_memssa.c)
+////////////////////////////////
+// all of memory is treated as one SSA variable, every node which writes to it
+// is a def (stores, memory ops, calls, atomics), loads and returns are uses
+// and phis merge the states at joins.
+typedef enum {
+    TB_MEMORY_LIVE_ON_ENTRY,
+    TB_MEMORY_DEF,
+    TB_MEMORY_USE,
+    TB_MEMORY_PHI,
+} TB_MemoryAccessKind;
+
+typedef struct {
+    TB_MemoryAccessKind kind;
+    TB_Label bb;
+
+    // TB_NULL_REG for phis and live on entry
+    TB_Reg node;
+
+    // defs and uses: the memory state right before them
+    int defining;
+
+    // phis: one operand per predecessor, same order as the preds
+    int operand_count;
+    int* operands;
+} TB_MemoryAccess;
+
+typedef struct {
+    // [0] is the memory state coming into the function
+    size_t access_count;
+    TB_MemoryAccess* accesses;
+
+    // [node_count] -1 for nodes which don't touch memory
+    int* node_access;
+    // [node_count] block order position + block, handy for dominance inside a block
+    int* node_order;
+    TB_Label* node_bb;
+
+    // [bb_count] -1 if there's no phi at the top of the block
+    int* bb_phi;
+
+    // users of access i are users[user_start[i] .. user_start[i+1]]
+    int* user_start;
+    int* users;
+} TB_MemorySSA;
+
+// everything lives in the tls, it's only good until memory nodes
+// get added or removed.
+TB_MemorySSA tb_get_memory_ssa(TB_Function* f, TB_TemporaryStorage* tls);
+
+// does node a come before b on every path
+bool tb_memssa_node_dominates(TB_Function* f, const TB_MemorySSA* mssa, TB_Reg a, TB_Reg b);
+
+// can the access read (or write) any of [addr, addr+size), size <= 0 is unknown
+bool tb_memssa_may_read(TB_Function* f, const TB_AliasInfo* ai, const TB_MemoryAccess* a, TB_Reg addr, int size);
+bool tb_memssa_may_write(TB_Function* f, const TB_AliasInfo* ai, const TB_MemoryAccess* a, TB_Reg addr, int size);
+
+////////////////////////////////
+// Call graph (tb_callgraph.c)
+////////////////////////////////
+// functions are referred to by their index in funcs
+typedef struct {
+    size_t func_count;
+    TB_Function** funcs;
+
+    // direct calls only, no duplicates
+    DynArray(size_t)* callees;
+    DynArray(size_t)* callers;
+
+    // SCCs are in bottom-up order, each one's functions are
+    // scc_funcs[scc_start[i] .. scc_start[i+1]]
+    size_t scc_count;
+    size_t* scc_of;
+    size_t* scc_start;
+    size_t* scc_funcs;
+
+    // TB_Function* -> index, see tb_call_graph_find
+    void* index;
+} TB_CallGraph;
+
+// funcs isn't copied, it has to stay around as long as the call graph
+TB_CallGraph tb_build_call_graph(size_t func_count, TB_Function** funcs);
+void tb_free_call_graph(TB_CallGraph* cg);
+
+// SIZE_MAX if f isn't part of the graph
+size_t tb_call_graph_find(const TB_CallGraph* cg, TB_Function* f);
+
 uint32_t tb_emit_const_patch(TB_Module* m, TB_Function* source, size_t pos, const void* ptr,size_t len, size_t local_thread_id);
 void tb_emit_symbol_patch(TB_Module* m, TB_Function* source, const TB_Symbol* target, size_t pos, bool is_function, size_t local_thread_id);
 
 TB_Reg* tb_vla_reserve(TB_Function* f, size_t count);
 
+// called by the code gen when the function it's emitting doesn't fit into the
+// space it was given. base is the start of the function and used is how much
+// has been written, returns the new start (the function might get moved into
+// a new chunk) and the new capacity.
+uint8_t* tb__code_region_grow(TB_Module* m, uint8_t* base, size_t used, size_t extra, size_t* out_capacity);
+
 // trusty lil hash functions
 uint32_t tb__crc32(uint32_t crc, size_t length, const void* data);
 
@@ -109,6 +109,9 @@ void tb_jitheap_free_region(TB_JITHeap* c, void* ptr, size_t s) {
 }
 
 TB_API TB_JITContext* tb_module_begin_jit(TB_Module* m, size_t jit_heap_capacity) {
+    tb__merge_symbols(m);
+    tb_helper_layout_data(m);
+
     // ICodeGen* restrict codegen = tb__find_code_generator(m);
 
     TB_JITContext* jit = tb_platform_heap_alloc(sizeof(TB_JITContext));
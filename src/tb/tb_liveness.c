@@ -0,0 +1,300 @@
+// Liveness analysis, shared by anything which needs to know what values are
+// alive where (mostly the register allocators).
+//
+// Only the values which are used outside of the block they're defined in get
+// a bit in the live sets, everything else lives and dies inside its block so
+// the intervals are enough for them. The sets are rows of 64bit words per block
+// and the solver is just straight loops over them so the compiler can go wide.
+//
+// Phi inputs count as uses at the end of the predecessor they come from, the
+// phi itself is a def at the top of its block.
+#include "tb_internal.h"
+
+typedef struct {
+    size_t words;
+
+    // [bb * words]
+    uint64_t* gen;
+    uint64_t* kill;
+    uint64_t* phi_out;
+} LiveScratch;
+
+static uint64_t* row(uint64_t* sets, size_t words, TB_Label bb) {
+    return &sets[bb * words];
+}
+
+static void bit_set(uint64_t* set, int i) {
+    set[i / 64] |= 1ull << (i % 64);
+}
+
+static bool bit_get(const uint64_t* set, int i) {
+    return set[i / 64] & (1ull << (i % 64));
+}
+
+// successors of a block, the same ones the postorder walk sees
+static void for_each_succ(TB_Function* f, TB_Label bb, void (*fn)(void* ctx, TB_Label s), void* ctx) {
+    TB_Node* end = &f->nodes[f->bbs[bb].end];
+
+    switch (end->type) {
+        case TB_GOTO: fn(ctx, end->goto_.label); break;
+        case TB_IF: fn(ctx, end->if_.if_true), fn(ctx, end->if_.if_false); break;
+        case TB_SWITCH: {
+            size_t entry_count = (end->switch_.entries_end - end->switch_.entries_start) / 2;
+            TB_SwitchEntry* entries = (TB_SwitchEntry*) &f->vla.data[end->switch_.entries_start];
+
+            FOREACH_N(i, 0, entry_count) fn(ctx, entries[i].value);
+            fn(ctx, end->switch_.default_label);
+            break;
+        }
+        default: break;
+    }
+}
+
+typedef struct {
+    size_t words;
+    uint64_t* restrict out;
+    const uint64_t* live_in;
+} UnionCtx;
+
+static void union_succ_in(void* arg, TB_Label s) {
+    UnionCtx* ctx = arg;
+
+    uint64_t* restrict out = ctx->out;
+    const uint64_t* restrict in = row((uint64_t*) ctx->live_in, ctx->words, s);
+    FOREACH_N(i, 0, ctx->words) out[i] |= in[i];
+}
+
+TB_Liveness tb_get_liveness(TB_Function* f) {
+    size_t bb_count = f->bb_count, node_count = f->node_count;
+    TB_TemporaryStorage* tls = tb_tls_steal();
+    void* mark = tb_tls_mark(tls);
+
+    TB_Liveness l = { .bb_count = bb_count, .node_count = node_count };
+
+    // one allocation for all the per node arrays
+    int* mem = tb_platform_heap_alloc(node_count * 5 * sizeof(int) + bb_count * 2 * sizeof(int));
+    l.order     = mem;
+    l.timeline  = mem + node_count;
+    l.bit       = mem + 2*node_count;
+    l.intervals = (TB_LiveInterval*) (mem + 3*node_count);
+    l.bb_first  = mem + 5*node_count;
+    l.bb_last   = mem + 5*node_count + bb_count;
+
+    TB_Label* def_block = tb_tls_push(tls, node_count * sizeof(TB_Label));
+    FOREACH_N(i, 0, node_count) {
+        l.order[i] = -1, l.bit[i] = -1, def_block[i] = -1;
+    }
+
+    // build the timeline, it's the same order the backends walk the nodes in
+    int time = 0;
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        l.bb_first[bb] = time;
+
+        TB_FOR_NODE(r, f, bb) {
+            def_block[r] = bb;
+            l.timeline[time] = r;
+            l.order[r] = time++;
+        }
+
+        l.bb_last[bb] = time - 1;
+    }
+    l.timeline_length = time;
+
+    // figure out which values cross blocks
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(r, f, bb) {
+            if (tb_node_is_phi_node(f, r)) {
+                int count = tb_node_get_phi_width(f, r);
+                TB_PhiInput* inputs = tb_node_get_phi_inputs(f, r);
+
+                FOREACH_N(j, 0, count) {
+                    TB_Reg src = inputs[j].val;
+                    if (src != TB_NULL_REG && def_block[src] >= 0 && l.bit[src] < 0) {
+                        l.bit[src] = l.value_count++;
+                    }
+                }
+            } else {
+                TB_Node* n = &f->nodes[r];
+                TB_FOR_INPUT_IN_NODE(it, f, n) {
+                    TB_Reg src = it.r;
+                    if (src != TB_NULL_REG && def_block[src] >= 0 && def_block[src] != bb && l.bit[src] < 0) {
+                        l.bit[src] = l.value_count++;
+                    }
+                }
+            }
+        }
+    }
+
+    size_t words = (l.value_count + 63) / 64;
+    l.words = words;
+
+    l.values = tb_platform_heap_alloc((l.value_count ? l.value_count : 1) * sizeof(TB_Reg));
+    FOREACH_N(i, 0, node_count) {
+        if (l.bit[i] >= 0) l.values[l.bit[i]] = i;
+    }
+
+    size_t set_size = bb_count * words * sizeof(uint64_t);
+    l.live_in = tb_platform_heap_alloc(2 * set_size + sizeof(uint64_t));
+    l.live_out = l.live_in + bb_count * words;
+    memset(l.live_in, 0, 2 * set_size);
+
+    LiveScratch s = {
+        .words = words,
+        .gen = tb_tls_push(tls, set_size),
+        .kill = tb_tls_push(tls, set_size),
+        .phi_out = tb_tls_push(tls, set_size),
+    };
+    memset(s.gen, 0, set_size);
+    memset(s.kill, 0, set_size);
+    memset(s.phi_out, 0, set_size);
+
+    // local sets, anything used here but defined elsewhere is upward exposed
+    // since SSA means a def in the same block always comes first.
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        uint64_t* gen = row(s.gen, words, bb);
+        uint64_t* kill = row(s.kill, words, bb);
+
+        TB_FOR_NODE(r, f, bb) {
+            if (l.bit[r] >= 0) bit_set(kill, l.bit[r]);
+
+            if (tb_node_is_phi_node(f, r)) {
+                int count = tb_node_get_phi_width(f, r);
+                TB_PhiInput* inputs = tb_node_get_phi_inputs(f, r);
+
+                FOREACH_N(j, 0, count) {
+                    TB_Reg src = inputs[j].val;
+                    if (src != TB_NULL_REG && l.bit[src] >= 0) {
+                        bit_set(row(s.phi_out, words, inputs[j].label), l.bit[src]);
+                    }
+                }
+            } else {
+                TB_Node* n = &f->nodes[r];
+                TB_FOR_INPUT_IN_NODE(it, f, n) {
+                    TB_Reg src = it.r;
+                    if (src != TB_NULL_REG && l.bit[src] >= 0 && def_block[src] != bb) {
+                        bit_set(gen, l.bit[src]);
+                    }
+                }
+            }
+        }
+    }
+
+    // iterate to a fixpoint in postorder, it's a backwards problem so that's
+    // the order which converges fastest. we walk it ourselves rather than going
+    // through the analysis cache since codegen isn't supposed to leave anything
+    // in there.
+    if (words > 0) {
+        TB_Label* postorder = tb_tls_push(tls, bb_count * sizeof(TB_Label));
+        int postorder_count = tb__get_postorder(f, tls, postorder);
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            FOREACH_N(i, 0, postorder_count) {
+                TB_Label bb = postorder[i];
+
+                uint64_t* restrict out = row(l.live_out, words, bb);
+                uint64_t* restrict in = row(l.live_in, words, bb);
+                const uint64_t* restrict gen = row(s.gen, words, bb);
+                const uint64_t* restrict kill = row(s.kill, words, bb);
+                const uint64_t* restrict phi_out = row(s.phi_out, words, bb);
+
+                // out = phi_out | in[succ]...
+                FOREACH_N(w, 0, words) out[w] = phi_out[w];
+
+                UnionCtx ctx = { words, out, l.live_in };
+                for_each_succ(f, bb, union_succ_in, &ctx);
+
+                // in = gen | (out & ~kill)
+                uint64_t diff = 0;
+                FOREACH_N(w, 0, words) {
+                    uint64_t new_in = gen[w] | (out[w] & ~kill[w]);
+                    diff |= new_in ^ in[w];
+                    in[w] = new_in;
+                }
+
+                changed |= (diff != 0);
+            }
+        }
+    }
+
+    // intervals start out at the def and get stretched over every use
+    FOREACH_N(i, 0, node_count) {
+        l.intervals[i] = (TB_LiveInterval){ l.order[i], l.order[i] };
+    }
+
+    #define STRETCH(v, lo, hi) do {                                    \
+        TB_LiveInterval* li_ = &l.intervals[v];                        \
+        if (li_->start > (lo)) li_->start = (lo);                      \
+        if (li_->end < (hi)) li_->end = (hi);                          \
+    } while (0)
+
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        TB_FOR_NODE(r, f, bb) {
+            if (tb_node_is_phi_node(f, r)) {
+                int count = tb_node_get_phi_width(f, r);
+                TB_PhiInput* inputs = tb_node_get_phi_inputs(f, r);
+
+                FOREACH_N(j, 0, count) {
+                    TB_Reg src = inputs[j].val;
+                    if (src != TB_NULL_REG && def_block[src] >= 0) {
+                        int end = l.bb_last[inputs[j].label];
+                        STRETCH(src, l.order[src], end);
+                    }
+                }
+            } else {
+                TB_Node* n = &f->nodes[r];
+                TB_FOR_INPUT_IN_NODE(it, f, n) {
+                    if (it.r != TB_NULL_REG && def_block[it.r] >= 0) {
+                        STRETCH(it.r, l.order[it.r], l.order[r]);
+                    }
+                }
+            }
+        }
+    }
+
+    // and across every block they're live through
+    FOREACH_N(bb, 0, bb_count) {
+        if (l.bb_first[bb] > l.bb_last[bb]) continue;
+
+        const uint64_t* in = row(l.live_in, words, bb);
+        const uint64_t* out = row(l.live_out, words, bb);
+        FOREACH_N(w, 0, words) {
+            uint64_t bits = in[w];
+            while (bits) {
+                int i = tb_ffs64(bits) - 1;
+                bits &= bits - 1;
+
+                STRETCH(l.values[w*64 + i], l.bb_first[bb], l.bb_first[bb]);
+            }
+
+            bits = out[w];
+            while (bits) {
+                int i = tb_ffs64(bits) - 1;
+                bits &= bits - 1;
+
+                TB_Reg v = l.values[w*64 + i];
+                STRETCH(v, def_block[v] == bb ? l.order[v] : l.bb_first[bb], l.bb_last[bb]);
+            }
+        }
+    }
+    #undef STRETCH
+
+    tb_tls_restore(tls, mark);
+    return l;
+}
+
+void tb_free_liveness(TB_Liveness* l) {
+    tb_platform_heap_free(l->live_in);
+    tb_platform_heap_free(l->values);
+    tb_platform_heap_free(l->order);
+}
+
+bool tb_liveness_is_live_in(const TB_Liveness* l, TB_Label bb, TB_Reg r) {
+    return l->bit[r] >= 0 && bit_get(&l->live_in[bb * l->words], l->bit[r]);
+}
+
+bool tb_liveness_is_live_out(const TB_Liveness* l, TB_Label bb, TB_Reg r) {
+    return l->bit[r] >= 0 && bit_get(&l->live_out[bb * l->words], l->bit[r]);
+}
@@ -0,0 +1,308 @@
+// Memory SSA construction
+//
+// We put a phi at every join and fill the operands with whatever state falls
+// out of each predecessor, then fold away the phis which only ever see one
+// state (or themselves). It's not the minimal placement you'd get out of the
+// dominance frontiers but after the pruning it ends up the same for the most
+// part and it's a lot less code.
+#include "tb_internal.h"
+
+#define NO_STATE (-2)
+
+static TB_MemoryAccessKind classify(TB_NodeTypeEnum t) {
+    switch (t) {
+        case TB_LOAD:
+        case TB_MEMCMP:
+        case TB_RET:
+        return TB_MEMORY_USE;
+
+        case TB_STORE:
+        case TB_MEMCLR:
+        case TB_MEMCPY:
+        case TB_MEMSET:
+        case TB_INITIALIZE:
+        case TB_ICALL:
+        case TB_CALL:
+        case TB_SCALL:
+        case TB_VCALL:
+        case TB_ATOMIC_TEST_AND_SET:
+        case TB_ATOMIC_CLEAR:
+        case TB_ATOMIC_LOAD:
+        case TB_ATOMIC_XCHG:
+        case TB_ATOMIC_ADD:
+        case TB_ATOMIC_SUB:
+        case TB_ATOMIC_AND:
+        case TB_ATOMIC_XOR:
+        case TB_ATOMIC_OR:
+        case TB_ATOMIC_CMPXCHG:
+        case TB_ATOMIC_CMPXCHG2:
+        return TB_MEMORY_DEF;
+
+        default:
+        return TB_MEMORY_LIVE_ON_ENTRY;
+    }
+}
+
+// the state at the end of bb, walks up through blocks which don't do anything
+// to memory and only have one way in.
+static int block_exit(TB_Function* f, TB_Predeccesors preds, const int* last_def, const int* bb_phi, TB_Label bb) {
+    FOREACH_N(steps, 0, f->bb_count) {
+        if (last_def[bb] != NO_STATE) return last_def[bb];
+        if (bb_phi[bb] >= 0) return bb_phi[bb];
+        if (preds.count[bb] != 1) return 0;
+
+        bb = preds.preds[bb][0];
+    }
+
+    // unreachable cycle of empty blocks
+    return 0;
+}
+
+static int block_entry(TB_Function* f, TB_Predeccesors preds, const int* last_def, const int* bb_phi, TB_Label bb) {
+    if (bb_phi[bb] >= 0) return bb_phi[bb];
+    if (preds.count[bb] != 1) return 0;
+
+    return block_exit(f, preds, last_def, bb_phi, preds.preds[bb][0]);
+}
+
+static int resolve(int* forward, int a) {
+    while (forward[a] >= 0) a = forward[a];
+    return a;
+}
+
+TB_MemorySSA tb_get_memory_ssa(TB_Function* f, TB_TemporaryStorage* tls) {
+    size_t node_count = f->node_count, bb_count = f->bb_count;
+    TB_Predeccesors preds = tb_function_get_predeccesors(f);
+
+    TB_MemorySSA mssa = {
+        .node_access = tb_tls_push(tls, node_count * sizeof(int)),
+        .node_order = tb_tls_push(tls, node_count * sizeof(int)),
+        .node_bb = tb_tls_push(tls, node_count * sizeof(TB_Label)),
+        .bb_phi = tb_tls_push(tls, bb_count * sizeof(int)),
+    };
+
+    // count everything up front so the accesses are one array
+    size_t access_count = 1, operand_count = 0;
+    int time = 0;
+    FOREACH_N(i, 0, node_count) {
+        mssa.node_access[i] = -1, mssa.node_order[i] = -1, mssa.node_bb[i] = -1;
+    }
+
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        if (preds.count[bb] >= 2) {
+            mssa.bb_phi[bb] = access_count++;
+            operand_count += preds.count[bb];
+        } else {
+            mssa.bb_phi[bb] = -1;
+        }
+
+        TB_FOR_NODE(r, f, bb) {
+            mssa.node_order[r] = time++;
+            mssa.node_bb[r] = bb;
+
+            if (classify(f->nodes[r].type) != TB_MEMORY_LIVE_ON_ENTRY) {
+                mssa.node_access[r] = access_count++;
+            }
+        }
+    }
+
+    mssa.access_count = access_count;
+    mssa.accesses = tb_tls_push(tls, access_count * sizeof(TB_MemoryAccess));
+    int* operands = tb_tls_push(tls, operand_count * sizeof(int));
+    mssa.user_start = tb_tls_push(tls, (access_count + 1) * sizeof(int));
+
+    void* mark = tb_tls_mark(tls);
+    int* last_def = tb_tls_push(tls, bb_count * sizeof(int));
+    int* forward = tb_tls_push(tls, access_count * sizeof(int));
+    FOREACH_N(i, 0, access_count) forward[i] = -1;
+
+    mssa.accesses[0] = (TB_MemoryAccess){ .kind = TB_MEMORY_LIVE_ON_ENTRY, .bb = 0 };
+
+    // chain up the accesses inside each block, the first one in the block
+    // gets patched once we know what the entry states are.
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        if (mssa.bb_phi[bb] >= 0) {
+            mssa.accesses[mssa.bb_phi[bb]] = (TB_MemoryAccess){
+                .kind = TB_MEMORY_PHI,
+                .bb = bb,
+                .operand_count = preds.count[bb],
+                .operands = operands,
+            };
+            operands += preds.count[bb];
+        }
+
+        int state = NO_STATE;
+        TB_FOR_NODE(r, f, bb) {
+            int a = mssa.node_access[r];
+            if (a < 0) continue;
+
+            TB_MemoryAccessKind kind = classify(f->nodes[r].type);
+            mssa.accesses[a] = (TB_MemoryAccess){ .kind = kind, .bb = bb, .node = r, .defining = state };
+            if (kind == TB_MEMORY_DEF) state = a;
+        }
+
+        last_def[bb] = state;
+    }
+
+    TB_FOR_BASIC_BLOCK(bb, f) {
+        int entry = block_entry(f, preds, last_def, mssa.bb_phi, bb);
+
+        TB_FOR_NODE(r, f, bb) {
+            int a = mssa.node_access[r];
+            if (a >= 0 && mssa.accesses[a].defining == NO_STATE) {
+                mssa.accesses[a].defining = entry;
+            }
+        }
+
+        if (mssa.bb_phi[bb] >= 0) {
+            TB_MemoryAccess* phi = &mssa.accesses[mssa.bb_phi[bb]];
+            FOREACH_N(i, 0, phi->operand_count) {
+                phi->operands[i] = block_exit(f, preds, last_def, mssa.bb_phi, preds.preds[bb][i]);
+            }
+        }
+    }
+
+    // fold away phis which only merge one state (ignoring themselves)
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        FOREACH_N(bb, 0, bb_count) {
+            int p = mssa.bb_phi[bb];
+            if (p < 0) continue;
+
+            TB_MemoryAccess* phi = &mssa.accesses[p];
+            int same = -1;
+            bool trivial = true;
+            FOREACH_N(i, 0, phi->operand_count) {
+                int op = resolve(forward, phi->operands[i]);
+                if (op == p || op == same) continue;
+                if (same >= 0) {
+                    trivial = false;
+                    break;
+                }
+                same = op;
+            }
+
+            if (trivial) {
+                forward[p] = same >= 0 ? same : 0;
+                mssa.bb_phi[bb] = -1;
+                phi->operand_count = 0;
+                changed = true;
+            }
+        }
+    }
+
+    // point everything at the final states and build the reverse edges
+    memset(mssa.user_start, 0, (access_count + 1) * sizeof(int));
+
+    size_t edge_count = 0;
+    FOREACH_N(i, 1, access_count) {
+        TB_MemoryAccess* a = &mssa.accesses[i];
+
+        if (a->kind == TB_MEMORY_PHI) {
+            FOREACH_N(j, 0, a->operand_count) {
+                a->operands[j] = resolve(forward, a->operands[j]);
+                mssa.user_start[a->operands[j]] += 1;
+            }
+            edge_count += a->operand_count;
+        } else {
+            a->defining = resolve(forward, a->defining);
+            mssa.user_start[a->defining] += 1;
+            edge_count += 1;
+        }
+    }
+    tb_tls_restore(tls, mark);
+
+    // prefix sum into ranges, then drop every edge into its range
+    int sum = 0;
+    FOREACH_N(i, 0, access_count + 1) {
+        int c = mssa.user_start[i];
+        mssa.user_start[i] = sum;
+        sum += c;
+    }
+
+    mssa.users = tb_tls_push(tls, (edge_count ? edge_count : 1) * sizeof(int));
+    int* fill = tb_tls_push(tls, access_count * sizeof(int));
+    memcpy(fill, mssa.user_start, access_count * sizeof(int));
+
+    FOREACH_N(i, 1, access_count) {
+        TB_MemoryAccess* a = &mssa.accesses[i];
+
+        if (a->kind == TB_MEMORY_PHI) {
+            FOREACH_N(j, 0, a->operand_count) {
+                mssa.users[fill[a->operands[j]]++] = i;
+            }
+        } else {
+            mssa.users[fill[a->defining]++] = i;
+        }
+    }
+
+    return mssa;
+}
+
+bool tb_memssa_node_dominates(TB_Function* f, const TB_MemorySSA* mssa, TB_Reg a, TB_Reg b) {
+    TB_Label a_bb = mssa->node_bb[a], b_bb = mssa->node_bb[b];
+    if (a_bb == b_bb) {
+        return mssa->node_order[a] < mssa->node_order[b];
+    }
+
+    return tb_function_dominates(f, a_bb, b_bb);
+}
+
+// calls and atomics can see anything which isn't private to the function
+static bool may_touch_visible(TB_Function* f, const TB_AliasInfo* ai, TB_Node* n, TB_Reg addr, int size) {
+    if (!tb_alias_is_local_only(f, ai, addr)) return true;
+
+    return n->type >= TB_ATOMIC_TEST_AND_SET && n->type <= TB_ATOMIC_CMPXCHG2 &&
+        tb_alias_may_alias(f, ai, n->atomic.addr, 0, addr, size);
+}
+
+bool tb_memssa_may_read(TB_Function* f, const TB_AliasInfo* ai, const TB_MemoryAccess* a, TB_Reg addr, int size) {
+    if (a->node == TB_NULL_REG) return false;
+
+    TB_Node* n = &f->nodes[a->node];
+    switch (n->type) {
+        case TB_LOAD:
+        return tb_alias_may_alias(f, ai, n->load.address, tb_alias_access_size(ai, n->dt), addr, size);
+
+        case TB_MEMCPY:
+        return tb_alias_may_alias(f, ai, n->mem_op.src, tb_alias_mem_op_size(f, n->mem_op.size), addr, size);
+
+        case TB_STORE:
+        case TB_MEMSET:
+        case TB_MEMCLR:
+        case TB_INITIALIZE:
+        return false;
+
+        // the caller gets to see whatever's left in memory
+        case TB_RET:
+        return !tb_alias_is_local_only(f, ai, addr);
+
+        default:
+        return may_touch_visible(f, ai, n, addr, size);
+    }
+}
+
+bool tb_memssa_may_write(TB_Function* f, const TB_AliasInfo* ai, const TB_MemoryAccess* a, TB_Reg addr, int size) {
+    if (a->kind != TB_MEMORY_DEF) return false;
+
+    TB_Node* n = &f->nodes[a->node];
+    switch (n->type) {
+        case TB_STORE:
+        return tb_alias_may_alias(f, ai, n->store.address, tb_alias_access_size(ai, n->dt), addr, size);
+
+        case TB_MEMSET:
+        case TB_MEMCPY:
+        return tb_alias_may_alias(f, ai, n->mem_op.dst, tb_alias_mem_op_size(f, n->mem_op.size), addr, size);
+
+        case TB_MEMCLR:
+        return tb_alias_may_alias(f, ai, n->clear.dst, n->clear.size, addr, size);
+
+        case TB_INITIALIZE:
+        return tb_alias_may_alias(f, ai, n->init.addr, 0, addr, size);
+
+        default:
+        return may_touch_visible(f, ai, n, addr, size);
+    }
+}
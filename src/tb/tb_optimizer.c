@@ -104,7 +104,13 @@ static bool end_lua_pass(lua_State* L, int arg_count) {
 #endif
 
 #define TB_DEBUG_DIFF_TOOL 0
-static bool schedule_function_level_opts(TB_Module* m, size_t pass_count, const TB_Pass passes[]) {
+
+// lua passes can poke at anything so they count as editing operands by hand
+static bool pass_edits_operands(const TB_Pass* p) {
+    return p->edits_operands || p->l_state != NULL;
+}
+
+static bool run_function_passes(TB_Function* f, size_t pass_count, const TB_Pass passes[]) {
     bool changes = false;
 
     #if TB_DEBUG_DIFF_TOOL
@@ -115,113 +121,124 @@ static bool schedule_function_level_opts(TB_Module* m, size_t pass_count, const
     };
     #endif
 
-    TB_FOR_FUNCTIONS(f, m) {
-        // printf("ORIGINAL\n");
-        // tb_function_print(f, tb_default_print_callback, stdout, false);
-        // printf("\n\n");
+    // printf("ORIGINAL\n");
+    // tb_function_print(f, tb_default_print_callback, stdout, false);
+    // printf("\n\n");
 
-        if (tb_function_validate(f) > 0) {
-            fprintf(stderr, "Validator failed on %s on original IR\n", f->super.name);
-            abort();
-        }
+    if (tb_function_validate(f) > 0) {
+        fprintf(stderr, "Validator failed on %s on original IR\n", f->super.name);
+        abort();
+    }
 
-        #if TB_DEBUG_DIFF_TOOL
-        tb_function_print(f, print_to_buffer, buffers[buffer_num], false);
-        buffer_num = 1;
-        #endif
+    #if TB_DEBUG_DIFF_TOOL
+    tb_function_print(f, print_to_buffer, buffers[buffer_num], false);
+    buffer_num = 1;
+    #endif
 
-        FOREACH_N(j, 0, pass_count) {
-            switch (passes[j].mode) {
-                case TB_BASIC_BLOCK_PASS: {
-                    TB_FOR_BASIC_BLOCK(bb, f) {
-                        if (passes[j].l_state != NULL) {
-                            #ifdef TB_USE_LUAJIT
-                            lua_State* L = begin_lua_pass(passes[j].l_state);
-                            lua_pushlightuserdata(L, f);
-                            lua_pushinteger(L, bb);
-                            changes |= end_lua_pass(L, 2);
-                            #else
-                            tb_panic("Not compiled with luajit support");
-                            #endif
-                        } else {
-                            changes |= passes[j].bb_run(f, bb);
-                        }
-                    }
-                    break;
-                }
+    FOREACH_N(j, 0, pass_count) {
+        bool pass_changes = false;
 
-                case TB_LOOP_PASS: {
-                    // We probably want a function to get all this info together
-                    TB_TemporaryStorage* tls = tb_tls_allocate();
-                    TB_Predeccesors preds = tb_get_temp_predeccesors(f, tls);
-
-                    TB_Label* doms = tb_tls_push(tls, f->bb_count * sizeof(TB_Label));
-                    tb_get_dominators(f, preds, doms);
-
-                    // probably don't wanna do this using heap allocations
-                    TB_LoopInfo loops = tb_get_loop_info(f, preds, doms);
-
-                    FOREACH_N(k, 0, loops.count) {
-                        const TB_Loop* l = &loops.loops[k];
-
-                        if (passes[j].l_state != NULL) {
-                            #ifdef TB_USE_LUAJIT
-                            lua_State* L = begin_lua_pass(passes[j].l_state);
-                            lua_pushlightuserdata(L, f);
-                            lua_pushlightuserdata(L, (void*) l);
-                            changes |= end_lua_pass(L, 2);
-                            #else
-                            tb_panic("Not compiled with luajit support");
-                            #endif
-                        } else {
-                            changes |= passes[j].loop_run(f, l);
-                        }
-                    }
+        // the def-use index can't follow passes which rewrite operands by
+        // hand so it's dropped, the next pass which wants it rebuilds it.
+        bool edits_operands = pass_edits_operands(&passes[j]);
+        if (edits_operands) {
+            tb_function_free_uses(f);
+        }
 
-                    tb_free_loop_info(loops);
-                    break;
+        switch (passes[j].mode) {
+            case TB_BASIC_BLOCK_PASS: {
+                TB_FOR_BASIC_BLOCK(bb, f) {
+                    if (passes[j].l_state != NULL) {
+                        #ifdef TB_USE_LUAJIT
+                        lua_State* L = begin_lua_pass(passes[j].l_state);
+                        lua_pushlightuserdata(L, f);
+                        lua_pushinteger(L, bb);
+                        pass_changes |= end_lua_pass(L, 2);
+                        #else
+                        tb_panic("Not compiled with luajit support");
+                        #endif
+                    } else {
+                        pass_changes |= passes[j].bb_run(f, bb);
+                    }
                 }
+                break;
+            }
 
-                case TB_FUNCTION_PASS:
-                if (passes[j].l_state != NULL) {
-                    #ifdef TB_USE_LUAJIT
-                    lua_State* L = begin_lua_pass(passes[j].l_state);
-                    lua_pushlightuserdata(L, f);
-                    changes |= end_lua_pass(L, 1);
-                    #else
-                    tb_panic("Not compiled with luajit support");
-                    #endif
-                } else {
-                    changes |= passes[j].func_run(f);
-
-                    // printf("%s\n", passes[j].name);
-                    // tb_function_print(f, tb_default_print_callback, stdout, false);
-                    // printf("\n\n");
-
-                    if (tb_function_validate(f) > 0) {
-                        fprintf(stderr, "Validator failed on %s after %s\n", f->super.name, passes[j].name);
-                        abort();
+            case TB_LOOP_PASS: {
+                // the loops (and the preds + doms they're built from) stick
+                // around on the function until some pass breaks them
+                const TB_LoopInfo* loops = tb_function_get_loop_info(f);
+
+                FOREACH_N(k, 0, loops->count) {
+                    const TB_Loop* l = &loops->loops[k];
+
+                    if (passes[j].l_state != NULL) {
+                        #ifdef TB_USE_LUAJIT
+                        lua_State* L = begin_lua_pass(passes[j].l_state);
+                        lua_pushlightuserdata(L, f);
+                        lua_pushlightuserdata(L, (void*) l);
+                        pass_changes |= end_lua_pass(L, 2);
+                        #else
+                        tb_panic("Not compiled with luajit support");
+                        #endif
+                    } else {
+                        pass_changes |= passes[j].loop_run(f, l);
                     }
                 }
                 break;
+            }
 
-                default: tb_unreachable();
+            case TB_FUNCTION_PASS:
+            if (passes[j].l_state != NULL) {
+                #ifdef TB_USE_LUAJIT
+                lua_State* L = begin_lua_pass(passes[j].l_state);
+                lua_pushlightuserdata(L, f);
+                pass_changes |= end_lua_pass(L, 1);
+                #else
+                tb_panic("Not compiled with luajit support");
+                #endif
+            } else {
+                pass_changes |= passes[j].func_run(f);
+
+                // printf("%s\n", passes[j].name);
+                // tb_function_print(f, tb_default_print_callback, stdout, false);
+                // printf("\n\n");
+
+                if (tb_function_validate(f) > 0) {
+                    fprintf(stderr, "Validator failed on %s after %s\n", f->super.name, passes[j].name);
+                    abort();
+                }
             }
+            break;
 
-            // tb_function_print(f, tb_default_print_callback, stdout, false);
+            default: tb_unreachable();
+        }
 
-            #if TB_DEBUG_DIFF_TOOL
-            tb_function_print(f, print_to_buffer, buffers[buffer_num], false);
-            int next = (buffer_num + 1) % 2;
-            print_diff(passes[j].name, buffers[next], buffers[buffer_num]);
-            buffer_num = next;
-            #endif
+        // it might've built its own copy halfway through
+        if (edits_operands) {
+            tb_function_free_uses(f);
+        }
 
-            // pause
-            // printf("Was just %s\n", passes[j].name);
-            // getchar();
-            // printf("==================================================\n\n\n");
+        // the loop pass is iterating the cached loop info so we only
+        // throw things out once it's done with them.
+        if (pass_changes) {
+            tb_function_invalidate_analysis(f, TB_ANALYSIS_ALL & ~passes[j].preserves);
+            changes = true;
         }
+
+        // tb_function_print(f, tb_default_print_callback, stdout, false);
+
+        #if TB_DEBUG_DIFF_TOOL
+        tb_function_print(f, print_to_buffer, buffers[buffer_num], false);
+        int next = (buffer_num + 1) % 2;
+        print_diff(passes[j].name, buffers[next], buffers[buffer_num]);
+        buffer_num = next;
+        #endif
+
+        // pause
+        // printf("Was just %s\n", passes[j].name);
+        // getchar();
+        // printf("==================================================\n\n\n");
     }
 
     #if TB_DEBUG_DIFF_TOOL
@@ -229,6 +246,43 @@ static bool schedule_function_level_opts(TB_Module* m, size_t pass_count, const
     tb_platform_heap_free(buffers[0]);
     #endif
 
+    // the IR can be changed by anyone once we're done, don't leave stale
+    // analysis lying around.
+    tb_function_invalidate_analysis(f, TB_ANALYSIS_ALL);
+    return changes;
+}
+
+static bool run_call_graph_pass(TB_Module* m, TB_Function* f, const TB_Pass* pass) {
+    // only f gets modified, the callees are read-only here
+    if (pass_edits_operands(pass)) {
+        tb_function_free_uses(f);
+    }
+
+    if (pass->l_state != NULL) {
+        #ifdef TB_USE_LUAJIT
+        lua_State* L = begin_lua_pass(pass->l_state);
+        lua_pushlightuserdata(L, m);
+        lua_pushlightuserdata(L, f);
+        return end_lua_pass(L, 2);
+        #else
+        tb_panic("Not compiled with luajit support");
+        #endif
+    }
+
+    bool changes = pass->cg_run(m, f);
+    if (pass_edits_operands(pass)) {
+        tb_function_free_uses(f);
+    }
+
+    if (tb_function_validate(f) > 0) {
+        fprintf(stderr, "Validator failed on %s after %s\n", f->super.name, pass->name);
+        abort();
+    }
+
+    if (changes) {
+        tb_function_invalidate_analysis(f, TB_ANALYSIS_ALL & ~pass->preserves);
+    }
+
     return changes;
 }
 
@@ -238,47 +292,259 @@ static bool schedule_module_level_opt(TB_Module* m, const TB_Pass* pass) {
         tb_unreachable();
     }
 
+    // it can touch any function so all their def-use indices go
+    bool edits_operands = pass_edits_operands(pass);
+    if (edits_operands) {
+        TB_FOR_FUNCTIONS(f, m) {
+            tb_function_free_uses(f);
+        }
+    }
+
+    bool changes;
     if (pass->l_state != NULL) {
         #ifdef TB_USE_LUAJIT
         lua_State* L = begin_lua_pass(pass->l_state);
         lua_pushlightuserdata(L, m);
-        return end_lua_pass(L, 1);
+        changes = end_lua_pass(L, 1);
         #else
         fprintf(stderr, "Not compiled with luajit support");
         return false;
         #endif
     } else {
-        return pass->mod_run(m);
+        changes = pass->mod_run(m);
     }
+
+    if (edits_operands) {
+        TB_FOR_FUNCTIONS(f, m) {
+            tb_function_free_uses(f);
+        }
+    }
+
+    return changes;
 }
 
-TB_API bool tb_module_optimize(TB_Module* m, size_t pass_count, const TB_Pass passes[]) {
+////////////////////////////////
+// Pass scheduling
+////////////////////////////////
+// A window is a run of function and call graph passes between two module passes,
+// it gets turned into one job graph where each stage has one job per function
+// (function passes) or one job per SCC (call graph passes):
+//
+//   -func -cg -func
+//
+//   funcA:func  ->  SCC(A):cg  ->  funcA:func
+//                    ^
+//   funcB:func  ->  SCC(B):cg  ->  funcB:func    (A calls B)
+//
+// A job can't start until the last stage is done touching the functions it's
+// about to modify (that includes any call graph jobs reading them as a callee)
+// and for call graph stages until the callees' SCCs are done. So no stage waits
+// on the whole module unless it has to.
+//
+// Windows end at module passes (those are full sync points) and before a second
+// call graph stage since something like the inliner changes the call graph.
+typedef struct {
+    // either a run of function-level passes or a single call graph pass
+    bool is_call_graph;
+    size_t pass_count;
+    const TB_Pass* passes;
+
+    size_t first_job;
+} Stage;
+
+typedef struct {
+    TB_Module* m;
+
+    size_t func_count;
+    TB_Function** funcs;
+
+    size_t stage_count;
+    Stage* stages;
+
+    // only built if we've got a call graph stage
+    TB_CallGraph cg;
+
+    // job -> stage & item (function or SCC)
+    uint32_t* job_stage;
+    size_t* job_item;
+
+    tb_atomic_int changes;
+} Window;
+
+static size_t owner_job(Window* w, const Stage* s, size_t f) {
+    return s->first_job + (s->is_call_graph ? w->cg.scc_of[f] : f);
+}
+
+// job is about to modify f so the previous stage needs to be done
+// writing and reading it.
+static void wait_on_previous_stage(Window* w, TB_Job* jobs, size_t job, const Stage* prev, size_t f) {
+    tb__job_depends(jobs, job, owner_job(w, prev, f));
+
+    if (prev->is_call_graph) {
+        dyn_array_for(i, w->cg.callers[f]) {
+            tb__job_depends(jobs, job, owner_job(w, prev, w->cg.callers[f][i]));
+        }
+    }
+}
+
+static void window_task(void* user_data, size_t i, int worker) {
+    Window* w = user_data;
+    const Stage* s = &w->stages[w->job_stage[i]];
+    size_t item = w->job_item[i];
+
     bool changes = false;
+    if (s->is_call_graph) {
+        FOREACH_N(j, w->cg.scc_start[item], w->cg.scc_start[item + 1]) {
+            changes |= run_call_graph_pass(w->m, w->funcs[w->cg.scc_funcs[j]], s->passes);
+        }
+    } else {
+        changes = run_function_passes(w->funcs[item], s->pass_count, s->passes);
+    }
 
-    size_t i = 0;
-    while (i < pass_count) {
-        // anything below or equal to function-level passes can be trivially
-        // parallel and thus we handle this as a
-        size_t sync = i;
-        for (; sync < pass_count; sync++) {
-            if (passes[sync].mode > TB_FUNCTION_PASS) break;
+    if (changes) {
+        tb_atomic_int_store(&w->changes, 1);
+    }
+}
+
+static bool schedule_window(TB_Module* m, size_t pass_count, const TB_Pass passes[], int thread_count) {
+    // lua states can't be shared across threads
+    FOREACH_N(i, 0, pass_count) {
+        if (passes[i].l_state != NULL) thread_count = 1;
+    }
+
+    Window w = { .m = m };
+
+    // a single run of function passes doesn't need any of the fancy stuff
+    bool is_simple = true;
+    FOREACH_N(i, 0, pass_count) {
+        if (passes[i].mode == TB_CALL_GRAPH_PASS) is_simple = false;
+    }
+
+    if (is_simple && thread_count == 1) {
+        bool changes = false;
+        TB_FOR_FUNCTIONS(f, m) {
+            changes |= run_function_passes(f, pass_count, passes);
         }
+        return changes;
+    }
 
-        // TODO(NeGate): convert this into a trivial parallel dispatch
-        if (sync != i) {
-            changes |= schedule_function_level_opts(m, sync - i, &passes[i]);
-            i = sync;
+    DynArray(TB_Function*) funcs = dyn_array_create(TB_Function*, m->symbol_count[TB_SYMBOL_FUNCTION] + 1);
+    TB_FOR_FUNCTIONS(f, m) {
+        dyn_array_put(funcs, f);
+    }
+    w.funcs = funcs;
+    w.func_count = dyn_array_length(funcs);
+
+    // split the window into stages
+    DynArray(Stage) stages = dyn_array_create(Stage, 4);
+    for (size_t i = 0; i < pass_count;) {
+        if (passes[i].mode == TB_CALL_GRAPH_PASS) {
+            dyn_array_put(stages, (Stage){ true, 1, &passes[i] });
+            i += 1;
+        } else {
+            size_t j = i;
+            while (j < pass_count && passes[j].mode <= TB_FUNCTION_PASS) j++;
+
+            dyn_array_put(stages, (Stage){ false, j - i, &passes[i] });
+            i = j;
         }
+    }
+    w.stages = stages;
+    w.stage_count = dyn_array_length(stages);
+
+    if (!is_simple) {
+        w.cg = tb_build_call_graph(w.func_count, w.funcs);
+    }
+
+    size_t job_count = 0;
+    FOREACH_N(k, 0, w.stage_count) {
+        w.stages[k].first_job = job_count;
+        job_count += w.stages[k].is_call_graph ? w.cg.scc_count : w.func_count;
+    }
 
-        // synchronize and handle the module level stuff
-        // TODO(NeGate): this requires special scheduling to be threaded
-        // but it's completely possible
-        for (; i < pass_count; i++) {
-            if (passes[i].mode <= TB_FUNCTION_PASS) break;
+    TB_Job* jobs = tb_platform_heap_alloc(job_count * sizeof(TB_Job));
+    memset(jobs, 0, job_count * sizeof(TB_Job));
+    w.job_stage = tb_platform_heap_alloc(job_count * sizeof(uint32_t));
+    w.job_item = tb_platform_heap_alloc(job_count * sizeof(size_t));
 
-            // run module level
+    FOREACH_N(k, 0, w.stage_count) {
+        const Stage* s = &w.stages[k];
+        const Stage* prev = k > 0 ? &w.stages[k - 1] : NULL;
+
+        size_t item_count = s->is_call_graph ? w.cg.scc_count : w.func_count;
+        FOREACH_N(item, 0, item_count) {
+            size_t job = s->first_job + item;
+            w.job_stage[job] = k;
+            w.job_item[job] = item;
+
+            if (!s->is_call_graph) {
+                if (prev) wait_on_previous_stage(&w, jobs, job, prev, item);
+                continue;
+            }
+
+            FOREACH_N(j, w.cg.scc_start[item], w.cg.scc_start[item + 1]) {
+                size_t f = w.cg.scc_funcs[j];
+                if (prev) wait_on_previous_stage(&w, jobs, job, prev, f);
+
+                // bottom-up, callees inside of the same SCC don't count
+                dyn_array_for(e, w.cg.callees[f]) {
+                    tb__job_depends(jobs, job, owner_job(&w, s, w.cg.callees[f][e]));
+                }
+            }
+        }
+    }
+
+    if (is_simple) {
+        // no dependencies so we can just use the work stealing dispatch
+        tb__parallel_for(job_count, thread_count, window_task, &w);
+    } else {
+        tb__run_jobs(job_count, jobs, thread_count, window_task, &w);
+    }
+
+    if (!is_simple) {
+        tb_free_call_graph(&w.cg);
+    }
+
+    tb_platform_heap_free(w.job_item);
+    tb_platform_heap_free(w.job_stage);
+    tb_platform_heap_free(jobs);
+    dyn_array_destroy(stages);
+    dyn_array_destroy(funcs);
+    return w.changes;
+}
+
+TB_API bool tb_module_optimize(TB_Module* m, size_t pass_count, const TB_Pass passes[]) {
+    return tb_module_optimize_parallel(m, pass_count, passes, 1);
+}
+
+TB_API bool tb_module_optimize_parallel(TB_Module* m, size_t pass_count, const TB_Pass passes[], int thread_count) {
+    tb__merge_symbols(m);
+    bool changes = false;
+
+    size_t i = 0;
+    while (i < pass_count) {
+        // module passes are full sync points, everything before it is done and
+        // nothing after it has started.
+        if (passes[i].mode == TB_MODULE_PASS) {
             changes |= schedule_module_level_opt(m, &passes[i]);
+            i += 1;
+            continue;
         }
+
+        // everything else up until the next sync point is one window
+        size_t end = i;
+        bool has_call_graph = false;
+        for (; end < pass_count; end++) {
+            if (passes[end].mode == TB_MODULE_PASS) break;
+
+            if (passes[end].mode == TB_CALL_GRAPH_PASS) {
+                if (has_call_graph) break;
+                has_call_graph = true;
+            }
+        }
+
+        changes |= schedule_window(m, end - i, &passes[i], thread_count);
+        i = end;
     }
 
     return changes;
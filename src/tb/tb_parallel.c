@@ -0,0 +1,301 @@
+// These are the little work dispatchers used by the optimizer (and anything else
+// that wants to go wide across functions).
+//
+// tb__parallel_for: every worker owns a contiguous range of indices [head, tail)
+// which it eats from the front, once it runs dry it'll go steal the back half of
+// someone else's range. The range is packed into one word so both the owner and
+// the thieves can race on it with a single CAS, ranges only ever shrink or get
+// handed over while empty so we don't have to worry about ABA.
+//
+// tb__run_jobs: a DAG of jobs, each job has a pending dependency count and once
+// it hits zero it's pushed onto a shared ready queue, idle workers sleep until
+// something shows up there.
+#include "tb_internal.h"
+
+#define RANGE(head, tail)  (((size_t)(head) << 32ull) | (size_t)(tail))
+#define RANGE_HEAD(r)      ((uint32_t) ((r) >> 32ull))
+#define RANGE_TAIL(r)      ((uint32_t) (r))
+
+typedef struct {
+    // keep them on separate cache lines, they're all being hammered
+    alignas(64) tb_atomic_size_t range;
+} WorkRange;
+
+typedef struct {
+    int thread_count;
+    WorkRange* ranges;
+
+    TB_ParallelTask* task;
+    void* user_data;
+} ParallelCtx;
+
+static bool pop_local(WorkRange* r, size_t* out) {
+    for (;;) {
+        size_t old = tb_atomic_size_load(&r->range);
+        uint32_t head = RANGE_HEAD(old), tail = RANGE_TAIL(old);
+        if (head >= tail) return false;
+
+        if (tb_atomic_size_cmpxchg(&r->range, old, RANGE(head + 1, tail))) {
+            *out = head;
+            return true;
+        }
+    }
+}
+
+static bool steal(WorkRange* victim, WorkRange* self) {
+    for (;;) {
+        size_t old = tb_atomic_size_load(&victim->range);
+        uint32_t head = RANGE_HEAD(old), tail = RANGE_TAIL(old);
+        if (head >= tail) return false;
+
+        // take the back half (or the whole thing if there's just one left)
+        uint32_t mid = head + (tail - head) / 2;
+        if (tb_atomic_size_cmpxchg(&victim->range, old, RANGE(head, mid))) {
+            // our range is empty so nobody else is touching it
+            tb_atomic_size_store(&self->range, RANGE(mid, tail));
+            return true;
+        }
+    }
+}
+
+static void worker_run(ParallelCtx* ctx, int id) {
+    WorkRange* self = &ctx->ranges[id];
+
+    for (;;) {
+        size_t i;
+        while (pop_local(self, &i)) {
+            ctx->task(ctx->user_data, i, id);
+        }
+
+        // look for some victim, if everyone is empty we're done. it's possible
+        // we miss work that's in the middle of being stolen but that just means
+        // the thief is gonna run it.
+        bool found = false;
+        FOREACH_N(j, 1, ctx->thread_count) {
+            int victim = (id + j) % ctx->thread_count;
+            if (steal(&ctx->ranges[victim], self)) {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) break;
+    }
+}
+
+////////////////////////////////
+// Thread spawning
+////////////////////////////////
+typedef void WorkerFunc(void* ctx, int id);
+
+typedef struct {
+    WorkerFunc* func;
+    void* ctx;
+    int id;
+} Worker;
+
+static void worker_entry(void* arg) {
+    Worker* w = arg;
+    w->func(w->ctx, w->id);
+
+    // these threads are ours, don't leak their scratch space
+    tb_free_thread_resources();
+}
+
+// the calling thread is worker 0 and it'll wait for the rest to join
+static void run_on_threads(int thread_count, WorkerFunc* func, void* ctx) {
+    Worker* workers = tb_platform_heap_alloc(thread_count * sizeof(Worker));
+    TB_Thread** threads = tb_platform_heap_alloc(thread_count * sizeof(TB_Thread*));
+    FOREACH_N(i, 1, thread_count) {
+        workers[i] = (Worker){ func, ctx, i };
+        threads[i] = tb_platform_thread_create(worker_entry, &workers[i]);
+
+        // if we couldn't make the thread, the other workers will pick up
+        // its work so it's fine.
+    }
+
+    func(ctx, 0);
+
+    FOREACH_N(i, 1, thread_count) {
+        if (threads[i] != NULL) tb_platform_thread_join(threads[i]);
+    }
+
+    tb_platform_heap_free(threads);
+    tb_platform_heap_free(workers);
+}
+
+////////////////////////////////
+// Parallel for
+////////////////////////////////
+static void parallel_for_worker(void* ctx, int id) {
+    worker_run(ctx, id);
+}
+
+void tb__parallel_for(size_t count, int thread_count, TB_ParallelTask* task, void* user_data) {
+    assert(count < UINT32_MAX && "too many work items for the dispatcher");
+
+    if (thread_count <= 0) thread_count = tb_platform_cpu_count();
+    if (thread_count > count) thread_count = count;
+
+    // not worth spinning up threads for
+    if (thread_count <= 1) {
+        FOREACH_N(i, 0, count) task(user_data, i, 0);
+        return;
+    }
+
+    ParallelCtx ctx = {
+        .thread_count = thread_count,
+        .ranges = tb_platform_heap_alloc(thread_count * sizeof(WorkRange)),
+        .task = task,
+        .user_data = user_data,
+    };
+
+    // evenly split the work up front, stealing handles the imbalance
+    FOREACH_N(i, 0, thread_count) {
+        size_t head = (count * i) / thread_count;
+        size_t tail = (count * (i + 1)) / thread_count;
+        ctx.ranges[i].range = RANGE(head, tail);
+    }
+
+    run_on_threads(thread_count, parallel_for_worker, &ctx);
+    tb_platform_heap_free(ctx.ranges);
+}
+
+////////////////////////////////
+// Job graph
+////////////////////////////////
+// Jobs become ready once all their dependencies are done. Every job gets pushed
+// into the ready queue exactly once so it's just an array with a write cursor
+// and a read cursor. Each push posts the semaphore once and idle workers sleep
+// on it, once the last job is done it's posted once more per worker so they all
+// wake up to find the queue drained and leave.
+typedef struct {
+    size_t count;
+    int thread_count;
+    TB_Job* jobs;
+
+    TB_ParallelTask* task;
+    void* user_data;
+
+    TB_Semaphore* ready;
+    tb_atomic_size_t* queue;
+    alignas(64) tb_atomic_size_t head;
+    alignas(64) tb_atomic_size_t tail;
+    alignas(64) tb_atomic_size_t done;
+} JobCtx;
+
+static void push_ready(JobCtx* ctx, size_t i) {
+    size_t slot = tb_atomic_size_add(&ctx->tail, 1);
+    tb_atomic_size_store(&ctx->queue[slot], i + 1);
+    tb_platform_sema_post(ctx->ready, 1);
+}
+
+static void job_worker(void* arg, int id) {
+    JobCtx* ctx = arg;
+
+    for (;;) {
+        tb_platform_sema_wait(ctx->ready);
+
+        // every post is either a published job or a wake up to leave, the
+        // wake ups only come after the last job so they always land past the end.
+        size_t head = tb_atomic_size_add(&ctx->head, 1);
+        if (head >= ctx->count) break;
+
+        // the post we got might've been for a later slot, whoever claimed this
+        // one is right between grabbing it and publishing so this is short.
+        size_t i;
+        while (i = tb_atomic_size_load(&ctx->queue[head]), i == 0) {
+            tb_platform_thread_yield();
+        }
+        i -= 1;
+
+        TB_Job* job = &ctx->jobs[i];
+        ctx->task(ctx->user_data, i, id);
+
+        dyn_array_for(j, job->succ) {
+            size_t s = job->succ[j];
+            if (tb_atomic_int_add(&ctx->jobs[s].pending, -1) == 1) {
+                push_ready(ctx, s);
+            }
+        }
+
+        if (tb_atomic_size_add(&ctx->done, 1) + 1 == ctx->count) {
+            tb_platform_sema_post(ctx->ready, ctx->thread_count);
+        }
+    }
+}
+
+// Kahn's algorithm on a copy of the pending counts, if we can't reach every
+// job then some of them are waiting on each other and the workers would
+// never wake up.
+static bool jobs_are_acyclic(size_t count, TB_Job* jobs) {
+    int* pending = tb_platform_heap_alloc(count * sizeof(int));
+    size_t* stack = tb_platform_heap_alloc(count * sizeof(size_t));
+
+    size_t top = 0;
+    FOREACH_N(i, 0, count) {
+        pending[i] = jobs[i].pending;
+        if (pending[i] == 0) stack[top++] = i;
+    }
+
+    size_t visited = 0;
+    while (top > 0) {
+        size_t i = stack[--top];
+        visited++;
+
+        dyn_array_for(j, jobs[i].succ) {
+            size_t s = jobs[i].succ[j];
+            if (--pending[s] == 0) stack[top++] = s;
+        }
+    }
+
+    tb_platform_heap_free(stack);
+    tb_platform_heap_free(pending);
+    return visited == count;
+}
+
+void tb__job_depends(TB_Job* jobs, size_t job, size_t dep) {
+    if (job == dep) return;
+
+    jobs[job].pending += 1;
+    dyn_array_put(jobs[dep].succ, job);
+}
+
+void tb__run_jobs(size_t count, TB_Job* jobs, int thread_count, TB_ParallelTask* task, void* user_data) {
+    if (thread_count <= 0) thread_count = tb_platform_cpu_count();
+    if (thread_count > count) thread_count = count;
+
+    if (count == 0) return;
+    if (!jobs_are_acyclic(count, jobs)) {
+        tb_panic("tb__run_jobs: the job graph has a cycle\n");
+    }
+
+    JobCtx ctx = {
+        .count = count,
+        .thread_count = thread_count,
+        .jobs = jobs,
+        .task = task,
+        .user_data = user_data,
+        .ready = tb_platform_sema_create(0),
+        .queue = tb_platform_heap_alloc(count * sizeof(tb_atomic_size_t)),
+    };
+    memset(ctx.queue, 0, count * sizeof(tb_atomic_size_t));
+
+    FOREACH_N(i, 0, count) {
+        if (jobs[i].pending == 0) push_ready(&ctx, i);
+    }
+
+    if (thread_count <= 1) {
+        job_worker(&ctx, 0);
+    } else {
+        run_on_threads(thread_count, job_worker, &ctx);
+    }
+
+    assert(ctx.done == count && ctx.tail == count);
+
+    FOREACH_N(i, 0, count) {
+        dyn_array_destroy(jobs[i].succ);
+    }
+    tb_platform_sema_destroy(ctx.ready);
+    tb_platform_heap_free(ctx.queue);
+}
@@ -31,6 +31,11 @@ void* tb_platform_valloc(size_t size);
 void  tb_platform_vfree(void* ptr, size_t size);
 bool  tb_platform_vprotect(void* ptr, size_t size, TB_MemProtect prot);
 
+// reserves address space without backing it, tb_platform_vcommit makes pages within
+// it usable (read-write). it's freed with tb_platform_vfree using the reserved size.
+void* tb_platform_vreserve(size_t size);
+bool  tb_platform_vcommit(void* ptr, size_t size);
+
 ////////////////////////////////
 // General Heap allocator
 ////////////////////////////////
@@ -41,19 +46,29 @@ void* tb_platform_heap_realloc(void* ptr, size_t size);
 void  tb_platform_heap_free(void* ptr);
 
 ////////////////////////////////
-// String arena
+// Threads
 ////////////////////////////////
-char* tb_platform_string_alloc(const char* str);
-void  tb_platform_string_free();
+typedef struct TB_Thread TB_Thread;
+typedef void TB_ThreadFunc(void* arg);
 
-////////////////////////////////
-// Persistent arena allocator
-////////////////////////////////
-void tb_platform_arena_init();
+// used by the parallel dispatchers (optimizer, batch compile), the spawned
+// thread is expected to clean up its own TB thread resources before returning.
+TB_Thread* tb_platform_thread_create(TB_ThreadFunc* func, void* arg);
+void tb_platform_thread_join(TB_Thread* t);
+void tb_platform_thread_yield(void);
+
+// counting semaphore, the job dispatcher parks idle workers on one instead of
+// spinning while they wait for dependencies to finish.
+typedef struct TB_Semaphore TB_Semaphore;
+
+TB_Semaphore* tb_platform_sema_create(int initial);
+void tb_platform_sema_destroy(TB_Semaphore* s);
+void tb_platform_sema_post(TB_Semaphore* s, int count);
+void tb_platform_sema_wait(TB_Semaphore* s);
 
-// this persistent arena allocator is used all of the backend
-// worker threads to store data until the end of compilation.
-void* tb_platform_arena_alloc(size_t size);
+// number of logical cores, never returns less than 1
+int tb_platform_cpu_count(void);
 
-// NOTE(NeGate): Free is supposed to free all allocations.
-void tb_platform_arena_free(void);
+// makes sure tb_free_thread_resources gets called once the current thread exits,
+// that way threads which never call it themselves still give their slot back.
+void tb_platform_free_at_thread_exit(void);
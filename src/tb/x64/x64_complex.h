@@ -681,50 +681,26 @@ TB_FunctionOutput x64_complex_compile_function(TB_Function* restrict f, const TB
     ////////////////////////////////
     // Allocate all the memory we'll need
     ////////////////////////////////
-    bool is_ctx_heap_allocated = false;
     X64_ComplexCtx* restrict ctx = NULL;
     {
-        // if we can't fit our memory usage into memory, we fallback
         FunctionTallyComplex tally = tally_memory_usage_complex(f);
-        is_ctx_heap_allocated = !tb_tls_can_fit(tls, tally.memory_usage);
-
-        if (is_ctx_heap_allocated) {
-            // printf("Could not allocate x64 code gen context: using heap fallback.
-            // (%zu bytes)\n", tally.memory_usage);
-            ctx = tb_platform_heap_alloc(sizeof(X64_ComplexCtx));
-            *ctx = (X64_ComplexCtx) {
-                .emit = {
-                    .f             = f,
-                    .capacity      = out_capacity,
-                    .data          = out,
-                    .labels        = tb_platform_heap_alloc(f->bb_count * sizeof(uint32_t)),
-                    .label_patches = tb_platform_heap_alloc(tally.label_patch_count * sizeof(LabelPatch)),
-                    .ret_patches   = tb_platform_heap_alloc(tally.return_count * sizeof(ReturnPatch))
-                },
-            };
-
-            ctx->use_count  = tb_platform_heap_alloc(f->node_count * sizeof(TB_Reg));
-            ctx->phis       = tb_platform_heap_alloc(tally.phi_count * sizeof(PhiValue));
-            ctx->insts      = tb_platform_heap_alloc(f->node_count * 2 * sizeof(MIR_Inst));
-            ctx->parameters = tb_platform_heap_alloc(f->prototype->param_count * sizeof(TreeVReg));
-        } else {
-            ctx = tb_tls_push(tls, sizeof(X64_ComplexCtx));
-            *ctx = (X64_ComplexCtx) {
-                .emit = {
-                    .f             = f,
-                    .capacity      = out_capacity,
-                    .data          = out,
-                    .labels        = tb_tls_push(tls, f->bb_count * sizeof(uint32_t)),
-                    .label_patches = tb_tls_push(tls, tally.label_patch_count * sizeof(LabelPatch)),
-                    .ret_patches   = tb_tls_push(tls, tally.return_count * sizeof(ReturnPatch))
-                },
-            };
-
-            ctx->use_count  = tb_tls_push(tls, f->node_count * sizeof(TB_Reg));
-            ctx->phis       = tb_tls_push(tls, tally.phi_count * sizeof(PhiValue));
-            ctx->insts      = tb_tls_push(tls, f->node_count * 2 * sizeof(MIR_Inst));
-            ctx->parameters = tb_tls_push(tls, f->prototype->param_count * sizeof(TreeVReg));
-        }
+
+        ctx = tb_tls_push(tls, sizeof(X64_ComplexCtx));
+        *ctx = (X64_ComplexCtx) {
+            .emit = {
+                .f             = f,
+                .capacity      = out_capacity,
+                .data          = out,
+                .labels        = tb_tls_push(tls, f->bb_count * sizeof(uint32_t)),
+                .label_patches = tb_tls_push(tls, tally.label_patch_count * sizeof(LabelPatch)),
+                .ret_patches   = tb_tls_push(tls, tally.return_count * sizeof(ReturnPatch))
+            },
+        };
+
+        ctx->use_count  = tb_tls_push(tls, f->node_count * sizeof(TB_Reg));
+        ctx->phis       = tb_tls_push(tls, tally.phi_count * sizeof(PhiValue));
+        ctx->insts      = tb_tls_push(tls, f->node_count * 2 * sizeof(MIR_Inst));
+        ctx->parameters = tb_tls_push(tls, f->prototype->param_count * sizeof(TreeVReg));
 
         ctx->inst_cap = f->node_count * 2;
 
@@ -735,7 +711,7 @@ TB_FunctionOutput x64_complex_compile_function(TB_Function* restrict f, const TB
         ctx->is_sysv = (f->super.module->target_abi == TB_ABI_SYSTEMV);
 
         f->line_count = 0;
-        f->lines = tb_platform_arena_alloc(tally.line_info_count * sizeof(TB_Line));
+        f->lines = tb__arena_alloc(f->super.module, tally.line_info_count * sizeof(TB_Line));
     }
 
     ////////////////////////////////
@@ -872,17 +848,5 @@ TB_FunctionOutput x64_complex_compile_function(TB_Function* restrict f, const TB
         .prologue_epilogue_metadata = ctx->regs_to_save
     };
 
-    if (is_ctx_heap_allocated) {
-        tb_platform_heap_free(ctx->emit.labels);
-        tb_platform_heap_free(ctx->emit.label_patches);
-        tb_platform_heap_free(ctx->emit.ret_patches);
-
-        tb_platform_heap_free(ctx->use_count);
-        tb_platform_heap_free(ctx->phis);
-
-        tb_platform_heap_free(ctx->insts);
-        tb_platform_heap_free(ctx->parameters);
-        tb_platform_heap_free(ctx);
-    }
     return func_out;
 }
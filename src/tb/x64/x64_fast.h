@@ -598,6 +598,12 @@ static Val fast_get_tile_mapping(X64_FastCtx* restrict ctx, TB_Function* f, TB_R
     // printf("TILE USED UP! r%u\n", r);
     ctx->tile.mapping = 0;
 
+    // if the tile was holding onto a reloaded base, it dies with this node
+    if (ctx->gpr_allocator[ctx->tile.base] == r) {
+        ctx->gpr_allocator[ctx->tile.base] = TB_TEMP_REG;
+        ctx->temp_load_reg = ctx->tile.base;
+    }
+
     return (Val) {
         VAL_MEM,
         .mem = {
@@ -826,7 +832,7 @@ static void fast_eval_basic_block(X64_FastCtx* restrict ctx, TB_Function* f, TB_
                     EMIT1(&ctx->emit, mod_rx_rm(MOD_INDIRECT, dst_xmm, RBP));
                     EMIT4(&ctx->emit, 0);
 
-                    uint32_t* rdata_payload = tb_platform_arena_alloc(sizeof(uint32_t));
+                    uint32_t* rdata_payload = tb__arena_alloc(f->super.module, sizeof(uint32_t));
                     *rdata_payload = imm;
 
                     uint32_t pos = tb_emit_const_patch(
@@ -863,7 +869,7 @@ static void fast_eval_basic_block(X64_FastCtx* restrict ctx, TB_Function* f, TB_
                     EMIT1(&ctx->emit, mod_rx_rm(MOD_INDIRECT, dst_xmm, RBP));
                     EMIT4(&ctx->emit, 0);
 
-                    uint64_t* rdata_payload = tb_platform_arena_alloc(sizeof(uint64_t));
+                    uint64_t* rdata_payload = tb__arena_alloc(f->super.module, sizeof(uint64_t));
                     *rdata_payload = imm;
 
                     uint32_t pos = tb_emit_const_patch(
@@ -941,6 +947,13 @@ static void fast_eval_basic_block(X64_FastCtx* restrict ctx, TB_Function* f, TB_
                     assert(ctx->tile.mapping == 0);
                     addr.mem.disp += n->member_access.offset;
 
+                    // the base got reloaded from a spill, the tile owns that
+                    // register now so it can't be freed at the end of this node
+                    if (addr.mem.base == ctx->temp_load_reg) {
+                        ctx->gpr_allocator[addr.mem.base] = r;
+                        ctx->temp_load_reg = GPR_NONE;
+                    }
+
                     ctx->tile.mapping = r;
                     ctx->tile.base    = addr.mem.base;
                     ctx->tile.index   = addr.mem.index;
@@ -1784,12 +1797,12 @@ static void fast_eval_basic_block(X64_FastCtx* restrict ctx, TB_Function* f, TB_
 
                     void* payload = NULL;
                     if (dt.data == TB_FLT_64) {
-                        uint64_t* rdata_payload = tb_platform_arena_alloc(2 * sizeof(uint64_t));
+                        uint64_t* rdata_payload = tb__arena_alloc(f->super.module, 2 * sizeof(uint64_t));
                         rdata_payload[0] = (1ull << 63ull);
                         rdata_payload[1] = (1ull << 63ull);
                         payload = rdata_payload;
                     } else {
-                        uint32_t* rdata_payload = tb_platform_arena_alloc(4 * sizeof(uint32_t));
+                        uint32_t* rdata_payload = tb__arena_alloc(f->super.module, 4 * sizeof(uint32_t));
                         rdata_payload[0] = (1ull << 31ull);
                         rdata_payload[1] = (1ull << 31ull);
                         rdata_payload[2] = (1ull << 31ull);
@@ -1951,8 +1964,10 @@ static void fast_eval_basic_block(X64_FastCtx* restrict ctx, TB_Function* f, TB_
                         // Win64 has 4 GPR parameters (RCX, RDX, R8, R9)
                         // SysV has 6 of them (RDI, RSI, RDX, RCX, R8, R9)
                         if ((ctx->is_sysv && j < 6) || j < 4) {
-                            // don't evict if the guy in the slot is based
-                            if (ctx->gpr_allocator[parameter_gprs[j]] != param_reg) {
+                            // don't evict if the guy in the slot is based, unless
+                            // he's still needed after the call since we're about
+                            // to clobber his register.
+                            if (ctx->gpr_allocator[parameter_gprs[j]] != param_reg || ctx->use_count[param_reg] > 1) {
                                 // since we evict now we don't need to later
                                 fast_evict_gpr(ctx, f, parameter_gprs[j]);
                                 caller_saved &= ~(1u << parameter_gprs[j]);
@@ -2422,9 +2437,7 @@ static FunctionTallySimple tally_memory_usage_simple(TB_Function* restrict f) {
     };
 }
 
-// entry point to the x64 fast isel, it's got some nice features like when the
-// temporary storage can't fit the necessary memory, it'll fallback to the heap
-// to avoid just crashing.
+// entry point to the x64 fast isel
 TB_FunctionOutput x64_fast_compile_function(TB_Function* restrict f, const TB_FeatureSet* features, uint8_t* out, size_t out_capacity, size_t local_thread_id) {
     typedef struct {
         // pos, origin is relative to the function body.
@@ -2437,47 +2450,29 @@ TB_FunctionOutput x64_fast_compile_function(TB_Function* restrict f, const TB_Fe
     TB_TemporaryStorage* tls = tb_tls_allocate();
     DynArray(JumpTablePatch) jump_table_patches = NULL;
 
-    // Allocate all the memory we'll need
-    bool is_ctx_heap_allocated = false;
+    // Allocate all the memory we'll need, the scratch grows so even
+    // the big functions can live in there.
     X64_FastCtx* restrict ctx = NULL;
     {
-        // if we can't fit our memory usage into memory, we fallback
         FunctionTallySimple tally = tally_memory_usage_simple(f);
-        is_ctx_heap_allocated = !tb_tls_can_fit(tls, tally.memory_usage);
 
         size_t ctx_size = sizeof(X64_FastCtx) + (f->node_count * sizeof(AddressDesc));
-        if (is_ctx_heap_allocated) {
-            ctx = tb_platform_heap_alloc(ctx_size);
-            *ctx = (X64_FastCtx) {
-                .emit = {
-                    .f             = f,
-                    .capacity      = out_capacity,
-                    .data          = out,
-                    .labels        = tb_platform_heap_alloc(f->bb_count * sizeof(uint32_t)),
-                    .label_patches = tb_platform_heap_alloc(tally.label_patch_count * sizeof(LabelPatch)),
-                    .ret_patches   = tb_platform_heap_alloc(tally.return_count * sizeof(ReturnPatch))
-                },
-                .ordinal = tb_platform_heap_alloc(f->node_count * sizeof(int)),
-                .use_count = tb_platform_heap_alloc(f->node_count * sizeof(TB_Reg))
-            };
-        } else {
-            ctx = tb_tls_push(tls, ctx_size);
-            *ctx = (X64_FastCtx) {
-                .emit = {
-                    .f             = f,
-                    .capacity      = out_capacity,
-                    .data          = out,
-                    .labels        = tb_tls_push(tls, f->bb_count * sizeof(uint32_t)),
-                    .label_patches = tb_tls_push(tls, tally.label_patch_count * sizeof(LabelPatch)),
-                    .ret_patches   = tb_tls_push(tls, tally.return_count * sizeof(ReturnPatch))
-                },
-                .ordinal = tb_tls_push(tls, f->node_count * sizeof(int)),
-                .use_count = tb_tls_push(tls, f->node_count * sizeof(TB_Reg))
-            };
-        }
+        ctx = tb_tls_push(tls, ctx_size);
+        *ctx = (X64_FastCtx) {
+            .emit = {
+                .f             = f,
+                .capacity      = out_capacity,
+                .data          = out,
+                .labels        = tb_tls_push(tls, f->bb_count * sizeof(uint32_t)),
+                .label_patches = tb_tls_push(tls, tally.label_patch_count * sizeof(LabelPatch)),
+                .ret_patches   = tb_tls_push(tls, tally.return_count * sizeof(ReturnPatch))
+            },
+            .ordinal = tb_tls_push(tls, f->node_count * sizeof(int)),
+            .use_count = tb_tls_push(tls, f->node_count * sizeof(TB_Reg))
+        };
 
         f->line_count = 0;
-        f->lines = tb_platform_arena_alloc(tally.line_info_count * sizeof(TB_Line));
+        f->lines = tb__arena_alloc(f->super.module, tally.line_info_count * sizeof(TB_Line));
 
         ctx->gpr_available = 14;
         ctx->xmm_available = 16;
@@ -2910,13 +2905,5 @@ TB_FunctionOutput x64_fast_compile_function(TB_Function* restrict f, const TB_Fe
         .stack_slots = stack_slots
     };
 
-    if (is_ctx_heap_allocated) {
-        tb_platform_heap_free(ctx->use_count);
-
-        tb_platform_heap_free(ctx->emit.labels);
-        tb_platform_heap_free(ctx->emit.label_patches);
-        tb_platform_heap_free(ctx->emit.ret_patches);
-        tb_platform_heap_free(ctx);
-    }
     return func_out;
 }